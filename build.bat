@@ -8,7 +8,12 @@ if not exist ".\bin" mkdir .\bin
 
 set FLAGS=/Fe: ./bin/emulator.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi
 set INCLUDE_DIR=/I./src
-set LIBS=user32.lib gdi32.lib
-set CPP=src/emulator.cpp src/win32.cpp
+set LIBS=user32.lib gdi32.lib winmm.lib
+rem set PROFILE=1 before building to compile in the guest profiler behind --profile=FILE
+if defined PROFILE set FLAGS=%FLAGS% /DCHIP8_PROFILE=1
+set CPP=src/emulator.cpp src/jit.cpp src/upscale.cpp src/snapshot.cpp src/rewind.cpp src/codec.cpp src/movie.cpp src/profile.cpp src/aot.cpp src/audio.cpp src/quirks.cpp src/recorder.cpp src/broadcast.cpp src/emulation.cpp src/pacer.cpp src/win32.cpp
+rem set AOT=file.cpp to link in a ROM recompiled by ./bin/recompile behind --core=aot
+if defined AOT set FLAGS=%FLAGS% /DCHIP8_AOT=1
+if defined AOT set CPP=%CPP% %AOT%
 
 cl.exe %CPP% %LIBS% %FLAGS%
\ No newline at end of file
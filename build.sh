@@ -0,0 +1,33 @@
+#!/bin/sh
+# Linux build, the Windows host is built with build.bat
+
+if [ ! -d "./build" ]; then mkdir ./build; fi
+if [ ! -d "./bin" ]; then mkdir ./bin; fi
+
+CXX=${CXX:-g++}
+FLAGS="-std=c++17 -O2 -g -Wall -Wno-unused-variable"
+INCLUDE_DIR="-I./src"
+LIBS=""
+
+# PROFILE=1 ./build.sh compiles in the guest profiler behind --profile=FILE
+if [ -n "$PROFILE" ]; then FLAGS="$FLAGS -DCHIP8_PROFILE=1"; fi
+# AOT=file.cpp ./build.sh links a ROM recompiled by ./bin/recompile into every binary behind --core=aot
+if [ -n "$AOT" ]; then FLAGS="$FLAGS -DCHIP8_AOT=1"; fi
+CPP="src/emulator.cpp src/jit.cpp src/upscale.cpp src/snapshot.cpp src/rewind.cpp src/codec.cpp src/movie.cpp src/profile.cpp src/aot.cpp src/audio.cpp src/quirks.cpp src/recorder.cpp src/broadcast.cpp $AOT src/emulation.cpp src/pacer.cpp src/posix.cpp src/linux.cpp"
+
+$CXX $CPP $INCLUDE_DIR $FLAGS $LIBS -pthread -o ./bin/emulator || exit 1
+
+BENCH_CPP="src/emulator.cpp src/jit.cpp src/upscale.cpp src/snapshot.cpp src/rewind.cpp src/codec.cpp src/movie.cpp src/profile.cpp src/aot.cpp src/audio.cpp src/quirks.cpp src/recorder.cpp src/broadcast.cpp $AOT src/batch.cpp src/pacer.cpp src/posix.cpp src/bench.cpp"
+$CXX $BENCH_CPP $INCLUDE_DIR $FLAGS $LIBS -pthread -o ./bin/bench || exit 1
+
+RUNNER_CPP="src/emulator.cpp src/jit.cpp src/upscale.cpp src/snapshot.cpp src/rewind.cpp src/codec.cpp src/movie.cpp src/profile.cpp src/aot.cpp src/audio.cpp src/quirks.cpp src/recorder.cpp src/broadcast.cpp $AOT src/pool.cpp src/pacer.cpp src/posix.cpp src/runner.cpp"
+$CXX $RUNNER_CPP $INCLUDE_DIR $FLAGS $LIBS -pthread -o ./bin/runner || exit 1
+
+RECOMPILE_CPP="src/emulator.cpp src/jit.cpp src/upscale.cpp src/snapshot.cpp src/rewind.cpp src/codec.cpp src/movie.cpp src/profile.cpp src/aot.cpp src/audio.cpp src/quirks.cpp src/recorder.cpp src/broadcast.cpp $AOT src/pacer.cpp src/posix.cpp src/recompile.cpp"
+$CXX $RECOMPILE_CPP $INCLUDE_DIR $FLAGS $LIBS -o ./bin/recompile || exit 1
+
+FRAMES_CPP="src/recorder.cpp src/codec.cpp src/pacer.cpp src/posix.cpp src/frames.cpp"
+$CXX $FRAMES_CPP $INCLUDE_DIR $FLAGS $LIBS -pthread -o ./bin/frames || exit 1
+
+SPECTATE_CPP="src/recorder.cpp src/codec.cpp src/movie.cpp src/pacer.cpp src/posix.cpp src/spectate.cpp"
+$CXX $SPECTATE_CPP $INCLUDE_DIR $FLAGS $LIBS -pthread -o ./bin/spectate || exit 1
@@ -0,0 +1,138 @@
+#include "chip8.h"
+#include "aot.h"
+
+#include <cstdlib>
+#include <cstring>
+
+struct Aot {
+    const Aot_program *program;
+    int32_t entry[MEMORY_SIZE]; // block starting at each address, -1 for none
+    uint8_t coverage[MEMORY_SIZE]; // number of blocks compiled from each byte
+    bool *live; // per block, its bytes in memory are the ones it was compiled from
+    bool compatible; // the machine runs the profile the blocks were compiled with
+};
+
+#if CHIP8_AOT
+extern const Aot_program AOT_PROGRAM; // in the generated file
+#endif
+
+static bool
+matches(const Aot_program *program, const Aot_block &block, const uint8_t *memory)
+{
+    return block.end <= program->image_size &&
+        std::memcmp(memory + block.start, program->image + block.start, block.end - block.start) == 0;
+}
+
+Aot *
+aot_create()
+{
+#if CHIP8_AOT
+    const Aot_program *program = &AOT_PROGRAM;
+    Aot *aot = reinterpret_cast<Aot*>(malloc(sizeof(Aot)));
+
+    if (!aot)
+    {
+        return NULL;
+    }
+
+    aot->program = program;
+    aot->compatible = false;
+    aot->live = reinterpret_cast<bool*>(calloc(program->block_count, sizeof(bool)));
+
+    if (!aot->live)
+    {
+        free(aot);
+        return NULL;
+    }
+
+    std::memset(aot->entry, 0xFF, sizeof(aot->entry));
+    std::memset(aot->coverage, 0, sizeof(aot->coverage));
+
+    for (uint32_t i = 0; i < program->block_count; ++i)
+    {
+        const Aot_block &block = program->blocks[i];
+        aot->entry[block.start] = static_cast<int32_t>(i);
+
+        for (uint16_t j = block.start; j < block.end; ++j)
+        {
+            ++aot->coverage[j];
+        }
+    }
+
+    return aot;
+#else
+    return NULL;
+#endif
+}
+
+void
+aot_destroy(Aot *aot)
+{
+    free(aot->live);
+    free(aot);
+}
+
+uint32_t
+aot_reset(Aot *aot, const uint8_t *memory, uint8_t quirks)
+{
+    uint32_t live = 0;
+    aot->compatible = quirks == aot->program->quirks;
+
+    for (uint32_t i = 0; i < aot->program->block_count; ++i)
+    {
+        aot->live[i] = aot->compatible && matches(aot->program, aot->program->blocks[i], memory);
+        live += aot->live[i];
+    }
+
+    return live;
+}
+
+const char *
+aot_rom(Aot *aot)
+{
+    return aot->program->rom;
+}
+
+// Blocks are entered only when they fit what's left of the batch, so timers tick on exactly the same instruction
+// as the interpreter. Wherever the generated code stops the interpreter takes one step before it is tried again
+uint32_t
+aot_execute(Chip8 &c, uint32_t count)
+{
+    Aot *aot = c.aot;
+    uint32_t executed = 0;
+
+    while (executed < count)
+    {
+        executed += aot->program->run(c, aot->live, count - executed);
+
+        if (executed < count)
+        {
+            executed += c.interpret(1);
+        }
+    }
+
+    return executed;
+}
+
+// Re-checks every block compiled from the written byte, so code the ROM rewrites interprets and code a restored
+// state puts back runs compiled again
+void
+aot_invalidate(Aot *aot, const uint8_t *memory, uint16_t address)
+{
+    if (!aot->coverage[address])
+    {
+        return;
+    }
+
+    int first = address - MAX_AOT_BLOCK_INSTRUCTIONS * 2 + 1;
+
+    for (int start = first < 0 ? 0 : first; start <= address; ++start)
+    {
+        int32_t id = aot->entry[start];
+
+        if (id >= 0 && aot->program->blocks[id].end > address)
+        {
+            aot->live[id] = aot->compatible && matches(aot->program, aot->program->blocks[id], memory);
+        }
+    }
+}
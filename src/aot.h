@@ -0,0 +1,61 @@
+#pragma once
+#include "chip8.h"
+
+// Ahead-of-time recompiled ROMs. ./bin/recompile turns a ROM into a C++ file with one function per basic block and
+// AOT=file.cpp ./build.sh links it into every binary behind --core=aot. A block only runs while the memory it was
+// compiled from is unchanged, everything else (other ROMs, unpredicted BNNN targets, rewritten code) interprets
+#if !defined(CHIP8_AOT)
+#define CHIP8_AOT 0
+#endif
+
+const int MAX_AOT_BLOCK_INSTRUCTIONS = 64; // longer straight-line code is split, invalidation looks back this far
+
+// Runs block after block from c.pc for up to budget instructions and returns how many ran. Stops with c.pc at the
+// first block that is stale or longer than what's left, or at an address no block starts at
+typedef uint32_t (*Aot_run)(Chip8 &c, const bool *live, uint32_t budget);
+
+struct Aot_block {
+    uint16_t start;
+    uint16_t end; // one past the last byte compiled
+    uint16_t count; // instructions every run executes, skips only change where it exits
+};
+
+// What a generated file defines as AOT_PROGRAM
+struct Aot_program {
+    const char *rom; // the file it was recompiled from
+    const uint8_t *image; // memory right after load, from address zero to the end of the last block
+    uint32_t image_size;
+    const Aot_block *blocks; // sorted by start, live is indexed the same way
+    uint32_t block_count;
+    Aot_run run;
+    uint8_t quirks; // QUIRK_PROFILES the blocks were compiled with, other profiles interpret
+};
+
+Aot *aot_create(); // NULL when no program is linked in or out of memory
+void aot_destroy(Aot *aot);
+// After memory was replaced, returns the blocks that still match. None do under a different profile
+uint32_t aot_reset(Aot *aot, const uint8_t *memory, uint8_t quirks);
+uint32_t aot_execute(Chip8 &c, uint32_t count);
+const char *aot_rom(Aot *aot);
+
+// One instruction with its operands and quirks fixed at compile time, the switch over ops.inl folds down to the
+// single op. address is the pc after the instruction and the pc to continue from is returned
+template <typename QUIRKS, uint8_t OPERATION, uint8_t X, uint8_t Y, uint8_t NN, uint16_t NNN>
+inline uint16_t
+Chip8::aot_step(uint16_t address)
+{
+    const Instruction in = { OPERATION, X, Y, NN, NNN };
+
+    switch (in.op)
+    {
+#define OP(name) case name:
+#define NEXT break;
+#include "ops.inl"
+#undef OP
+#undef NEXT
+        default:
+            break;
+    }
+
+    return address;
+}
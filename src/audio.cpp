@@ -0,0 +1,494 @@
+#include "audio.h"
+#include "handoff.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+enum AUDIO_SINKS { AUDIO_SINK_RAW, AUDIO_SINK_WAV, AUDIO_SINK_DEVICE };
+
+const uint32_t AUDIO_RING_SIZE = 8192; // samples, 170ms, only a stalled device sink gets near it
+const uint32_t AUDIO_CHUNK = 256; // samples generated between pushes
+const uint32_t WAV_HEADER_SIZE = 44;
+const uint32_t AUDIO_BLOCK_MS = 5; // device buffers, the latency target moves in these steps
+const uint32_t AUDIO_BLOCK_SAMPLES = AUDIO_SAMPLE_RATE * AUDIO_BLOCK_MS / 1000;
+const uint32_t AUDIO_DEVICE_BLOCKS = static_cast<uint32_t>(AUDIO_MAX_LATENCY / AUDIO_BLOCK_MS);
+const uint32_t MAX_TARGET_BLOCKS = AUDIO_DEVICE_BLOCKS - 1; // leaves a block of room for what arrives between refills
+const double AUDIO_SETTLE_MS = 5000; // without an underrun before the latency target shrinks again
+
+static_assert(AUDIO_SAMPLE_RATE * AUDIO_BLOCK_MS % 1000 == 0, "blocks are whole samples");
+
+#if defined(_WIN32)
+struct Audio_device {
+    HWAVEOUT out;
+    HANDLE done; // auto-reset, signalled by the driver whenever a block finished playing
+    WAVEHDR headers[AUDIO_DEVICE_BLOCKS];
+    int16_t blocks[AUDIO_DEVICE_BLOCKS][AUDIO_BLOCK_SAMPLES];
+};
+#else
+struct Audio_device {};
+#endif
+
+struct Audio {
+    uint8_t sink; // AUDIO_SINKS
+    FILE *file;
+    Spsc_queue<int16_t, AUDIO_RING_SIZE> ring;
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> overruns;
+    bool stopped;
+
+    // Only touched by the emulating thread
+    uint64_t position; // the next sample to generate
+    uint64_t end_sample; // the tone is on before this one, from the sound timer at the last audio_generate
+    uint32_t phase; // through one wave or the whole XO-CHIP pattern, in 1/2^32
+
+    // Only touched by the device thread until it is joined
+    Audio_device *device;
+    std::thread thread;
+    std::atomic<bool> stop;
+    uint64_t underruns;
+    uint32_t target_blocks; // queued on the device ahead of what plays
+    uint64_t measurements;
+    double total_latency;
+    double max_latency;
+
+    std::mutex pacer_lock;
+    Pacer *pacer;
+
+    Audio() : samples(0), overruns(0), stop(false) {}
+};
+
+static void
+put_u32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static void
+put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+// RIFF header for data_size bytes of samples, written with zero sizes on open and patched on close
+static void
+wav_header(uint8_t *out, uint32_t data_size)
+{
+    std::memcpy(out, "RIFF", 4);
+    put_u32(out + 4, WAV_HEADER_SIZE - 8 + data_size);
+    std::memcpy(out + 8, "WAVEfmt ", 8);
+    put_u32(out + 16, 16);
+    put_u16(out + 20, 1); // PCM
+    put_u16(out + 22, 1); // mono
+    put_u32(out + 24, AUDIO_SAMPLE_RATE);
+    put_u32(out + 28, AUDIO_SAMPLE_RATE * 2);
+    put_u16(out + 32, 2);
+    put_u16(out + 34, 16);
+    std::memcpy(out + 36, "data", 4);
+    put_u32(out + 40, data_size);
+}
+
+// Files take the samples as little endian 16 bit, the byte order of every host this builds for
+static void
+drain_file(Audio *audio)
+{
+    int16_t chunk[AUDIO_CHUNK];
+    uint32_t count = 0;
+
+    while (audio->ring.pop(chunk[count]))
+    {
+        if (++count == AUDIO_CHUNK)
+        {
+            std::fwrite(chunk, sizeof(int16_t), count, audio->file);
+            count = 0;
+        }
+    }
+
+    std::fwrite(chunk, sizeof(int16_t), count, audio->file);
+}
+
+#if defined(_WIN32)
+
+static double
+steady_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool
+queued(const WAVEHDR &header)
+{
+    return (*reinterpret_cast<const volatile DWORD*>(&header.dwFlags) & WHDR_INQUEUE) != 0;
+}
+
+static bool
+device_open(Audio *audio)
+{
+    Audio_device *device = reinterpret_cast<Audio_device*>(calloc(1, sizeof(Audio_device)));
+    device->done = CreateEventA(NULL, FALSE, FALSE, NULL);
+
+    WAVEFORMATEX format = {};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 1;
+    format.nSamplesPerSec = AUDIO_SAMPLE_RATE;
+    format.nAvgBytesPerSec = AUDIO_SAMPLE_RATE * 2;
+    format.nBlockAlign = 2;
+    format.wBitsPerSample = 16;
+
+    if (!device->done || waveOutOpen(&device->out, WAVE_MAPPER, &format, reinterpret_cast<DWORD_PTR>(device->done), 0,
+        CALLBACK_EVENT) != MMSYSERR_NOERROR)
+    {
+        if (device->done)
+        {
+            CloseHandle(device->done);
+        }
+
+        free(device);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < AUDIO_DEVICE_BLOCKS; ++i)
+    {
+        device->headers[i].lpData = reinterpret_cast<LPSTR>(device->blocks[i]);
+        device->headers[i].dwBufferLength = sizeof(device->blocks[i]);
+        waveOutPrepareHeader(device->out, &device->headers[i], sizeof(WAVEHDR));
+    }
+
+    audio->device = device;
+    return true;
+}
+
+static void
+device_close(Audio *audio)
+{
+    Audio_device *device = audio->device;
+    waveOutReset(device->out); // hands every queued block back
+
+    for (uint32_t i = 0; i < AUDIO_DEVICE_BLOCKS; ++i)
+    {
+        waveOutUnprepareHeader(device->out, &device->headers[i], sizeof(WAVEHDR));
+    }
+
+    waveOutClose(device->out);
+    CloseHandle(device->done);
+    free(device);
+    audio->device = NULL;
+}
+
+// Keeps target_blocks queued on the device. A block the ring can't fill is padded with silence and counts as an
+// underrun, which grows the target by a block. Samples beyond what fits under AUDIO_MAX_LATENCY are dropped as an
+// overrun instead of being played late, and a target that went AUDIO_SETTLE_MS without an underrun shrinks again
+static void
+play(Audio *audio)
+{
+    Audio_device *device = audio->device;
+    double clean_since = steady_ms();
+    const uint32_t max_samples = static_cast<uint32_t>(AUDIO_MAX_LATENCY * AUDIO_SAMPLE_RATE / 1000);
+
+    while (!audio->stop.load(std::memory_order_relaxed))
+    {
+        uint32_t busy = 0;
+        Pacer *pacer;
+
+        {
+            std::lock_guard<std::mutex> lock(audio->pacer_lock);
+            pacer = audio->pacer;
+        }
+
+        // Silence before the first sample and after emulation stopped is expected, not an underrun
+        bool producing = pacer && audio->samples.load(std::memory_order_relaxed);
+
+        for (uint32_t i = 0; i < AUDIO_DEVICE_BLOCKS; ++i)
+        {
+            busy += queued(device->headers[i]);
+        }
+
+        for (uint32_t i = 0; i < AUDIO_DEVICE_BLOCKS && busy < audio->target_blocks; ++i)
+        {
+            WAVEHDR &header = device->headers[i];
+
+            if (queued(header))
+            {
+                continue;
+            }
+
+            int16_t *block = device->blocks[i];
+            uint32_t count = 0;
+
+            while (count < AUDIO_BLOCK_SAMPLES && audio->ring.pop(block[count]))
+            {
+                ++count;
+            }
+
+            if (count < AUDIO_BLOCK_SAMPLES && producing)
+            {
+                ++audio->underruns;
+                audio->target_blocks = std::min(audio->target_blocks + 1, MAX_TARGET_BLOCKS);
+                clean_since = steady_ms();
+            }
+
+            std::memset(block + count, 0, (AUDIO_BLOCK_SAMPLES - count) * sizeof(int16_t));
+            waveOutWrite(device->out, &header, sizeof(WAVEHDR));
+            ++busy;
+        }
+
+        uint32_t ahead = busy * AUDIO_BLOCK_SAMPLES + audio->ring.size();
+
+        if (ahead > max_samples)
+        {
+            int16_t sample;
+
+            for (uint32_t i = ahead - max_samples; i > 0 && audio->ring.pop(sample); --i)
+            {
+            }
+
+            audio->overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (steady_ms() - clean_since > AUDIO_SETTLE_MS)
+        {
+            audio->target_blocks = std::max(audio->target_blocks - 1, static_cast<uint32_t>(AUDIO_MIN_LATENCY / AUDIO_BLOCK_MS));
+            clean_since = steady_ms();
+        }
+
+        // A sample pushed now plays after everything queued on the device and in the ring
+        double latency = (busy * AUDIO_BLOCK_SAMPLES + audio->ring.size()) * 1000.0 / AUDIO_SAMPLE_RATE;
+        audio->total_latency += latency;
+        audio->max_latency = std::max(audio->max_latency, latency);
+        ++audio->measurements;
+
+        // Held across the wake so emulation_stop can't destroy the pacer in between
+        {
+            std::lock_guard<std::mutex> lock(audio->pacer_lock);
+
+            if (audio->pacer)
+            {
+                pacer_wake(audio->pacer);
+            }
+        }
+
+        WaitForSingleObject(device->done, AUDIO_BLOCK_MS);
+    }
+}
+
+#else
+
+static bool
+device_open(Audio *audio)
+{
+    return false;
+}
+
+static void
+device_close(Audio *audio)
+{
+}
+
+static void
+play(Audio *audio)
+{
+}
+
+#endif
+
+Audio *
+audio_create(const char *target)
+{
+    Audio *audio = new Audio();
+    audio->file = NULL;
+    audio->stopped = false;
+    audio->position = 0;
+    audio->end_sample = 0;
+    audio->phase = 0;
+    audio->device = NULL;
+    audio->underruns = 0;
+    audio->target_blocks = static_cast<uint32_t>(AUDIO_MIN_LATENCY / AUDIO_BLOCK_MS);
+    audio->measurements = 0;
+    audio->total_latency = 0;
+    audio->max_latency = 0;
+    audio->pacer = NULL;
+
+    size_t length = std::strlen(target);
+
+    if (std::strcmp(target, "device") == 0)
+    {
+        audio->sink = AUDIO_SINK_DEVICE;
+
+        if (!device_open(audio))
+        {
+            delete audio;
+            return NULL;
+        }
+
+        audio->thread = std::thread(play, audio);
+        return audio;
+    }
+
+    audio->sink = length > 4 && std::strcmp(target + length - 4, ".wav") == 0 ? AUDIO_SINK_WAV : AUDIO_SINK_RAW;
+    audio->file = std::fopen(target, "wb");
+
+    if (!audio->file)
+    {
+        delete audio;
+        return NULL;
+    }
+
+    if (audio->sink == AUDIO_SINK_WAV)
+    {
+        uint8_t header[WAV_HEADER_SIZE];
+        wav_header(header, 0);
+        std::fwrite(header, 1, sizeof(header), audio->file);
+    }
+
+    return audio;
+}
+
+void
+audio_stop(Audio *audio)
+{
+    if (audio->stopped)
+    {
+        return;
+    }
+
+    audio->stopped = true;
+
+    if (audio->sink == AUDIO_SINK_DEVICE)
+    {
+        audio->stop.store(true, std::memory_order_relaxed);
+        audio->thread.join();
+        device_close(audio);
+    }
+    else
+    {
+        drain_file(audio);
+        std::fflush(audio->file);
+    }
+}
+
+void
+audio_destroy(Audio *audio)
+{
+    audio_stop(audio);
+
+    if (audio->file)
+    {
+        // A WAV past 4GB keeps its zero sizes, players then read to the end of the file
+        uint64_t data_size = audio->samples.load() * sizeof(int16_t);
+
+        if (audio->sink == AUDIO_SINK_WAV && data_size <= UINT32_MAX - WAV_HEADER_SIZE && std::fseek(audio->file, 0, SEEK_SET) == 0)
+        {
+            uint8_t header[WAV_HEADER_SIZE];
+            wav_header(header, static_cast<uint32_t>(data_size));
+            std::fwrite(header, 1, sizeof(header), audio->file);
+        }
+
+        std::fclose(audio->file);
+    }
+
+    delete audio;
+}
+
+void
+audio_set_pacer(Audio *audio, Pacer *pacer)
+{
+    std::lock_guard<std::mutex> lock(audio->pacer_lock);
+    audio->pacer = pacer;
+}
+
+Audio_stats
+audio_stats(Audio *audio)
+{
+    Audio_stats stats = {};
+    stats.samples = audio->samples.load();
+    stats.overruns = audio->overruns.load();
+
+    if (audio->sink == AUDIO_SINK_DEVICE)
+    {
+        stats.underruns = audio->underruns;
+        stats.mean_latency = audio->measurements ? audio->total_latency / audio->measurements : 0;
+        stats.max_latency = audio->max_latency;
+        stats.target_latency = audio->target_blocks * AUDIO_BLOCK_MS;
+    }
+
+    return stats;
+}
+
+// Phase advance per sample. XO-CHIP steps through its 128 one-bit pattern at 4000 * 2^((pitch - 64) / 48) samples
+// per second, until a ROM loads a pattern it beeps like the others
+static uint32_t
+phase_step(const Chip8 &c, bool pattern)
+{
+    double hz = pattern ? 4000 * std::pow(2.0, (c.pitch - 64) / 48.0) / 128 : AUDIO_TONE_HZ;
+    return static_cast<uint32_t>(hz / AUDIO_SAMPLE_RATE * 4294967296.0);
+}
+
+// The sound timer only changes on ticks and audio_generate runs at least once per tick, so everything between two
+// calls plays from what the timer said at the first. The tone ends on the sample of the tick that takes the timer
+// to zero, and starts at most one tick late: on the call after the FX18 that set it
+void
+audio_generate(Audio *audio, const Chip8 &c)
+{
+    uint64_t target = c.cycles * AUDIO_SAMPLE_RATE / c.ips;
+
+    // Rewinds and loaded states go back in time, what was already played stays played
+    if (target < audio->position)
+    {
+        audio->position = target;
+    }
+
+    bool pattern = c.mode == MODE_XOCHIP && std::any_of(c.pattern, c.pattern + 16, [](uint8_t b) { return b != 0; });
+    uint32_t step = phase_step(c, pattern);
+
+    while (audio->position < target)
+    {
+        uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(target - audio->position, AUDIO_CHUNK));
+        bool dropped = false;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            int16_t sample = 0;
+
+            if (audio->position + i < audio->end_sample)
+            {
+                bool high = pattern ? (c.pattern[audio->phase >> 28] >> (7 - ((audio->phase >> 25) & 7))) & 1 : audio->phase >> 31;
+                sample = high ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            }
+
+            audio->phase += step;
+            dropped |= !audio->ring.push(sample);
+        }
+
+        audio->position += count;
+        audio->samples.fetch_add(count, std::memory_order_relaxed);
+
+        if (dropped)
+        {
+            audio->overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (audio->sink != AUDIO_SINK_DEVICE)
+        {
+            drain_file(audio);
+        }
+    }
+
+    // First sample at or after the instruction the timer reaches zero on
+    uint64_t end_cycle = tick_cycle(c.ticks + c.sound_timer, c.ips);
+    audio->end_sample = c.sound_timer ? (end_cycle * AUDIO_SAMPLE_RATE + c.ips - 1) / c.ips : 0;
+}
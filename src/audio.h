@@ -0,0 +1,25 @@
+#pragma once
+#include "chip8.h"
+#include "pacer.h"
+#include "win32.h"
+
+// Sound timer output. Samples are generated on the emulating thread from the instruction count, sample n being
+// the tone at emulated time n / AUDIO_SAMPLE_RATE, so what is heard doesn't depend on how the host paced the run.
+// They reach the sink through a lock-free ring: file sinks drain it on the same thread, the Windows device sink
+// on a thread of its own that keeps the device AUDIO_MIN_LATENCY to AUDIO_MAX_LATENCY ms ahead
+struct Audio;
+
+const uint32_t AUDIO_SAMPLE_RATE = 48000; // mono signed 16 bit
+const uint32_t AUDIO_TONE_HZ = 440; // the CHIP-8 and SUPER-CHIP square wave, XO-CHIP plays its pattern instead
+const int16_t AUDIO_AMPLITUDE = 8000;
+const double AUDIO_MIN_LATENCY = 10;
+const double AUDIO_MAX_LATENCY = 20;
+
+// "device" for the Windows audio device, otherwise a file path, WAV when it ends in .wav and raw samples if not.
+// NULL when the sink can't be opened
+Audio *audio_create(const char *target);
+void audio_destroy(Audio *audio); // stops the sink and finishes the file
+void audio_generate(Audio *audio, const Chip8 &c); // every sample up to c.cycles, call after each batch
+void audio_set_pacer(Audio *audio, Pacer *pacer); // woken whenever the device sink wants samples, NULL for none
+void audio_stop(Audio *audio); // ends playback, the stats are final afterwards
+Audio_stats audio_stats(Audio *audio);
@@ -0,0 +1,1034 @@
+#include "batch.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+// Lanes run at the default rate, where the timers tick after every STEPS_PER_TICK instructions as in run_application
+const uint32_t STEPS_PER_TICK = DEFAULT_IPS / TIMER_HZ;
+static_assert(DEFAULT_IPS % TIMER_HZ == 0, "batch timers assume a whole number of instructions per tick");
+const uint32_t ALL_LANES = (1u << BATCH_WIDTH) - 1;
+const uint32_t INITIAL_POOL_PAGES = PAGE_COUNT * 2;
+const uint32_t SOLO_STEPS = 256; // how long split up lanes run on their own before checking whether they met again
+
+// Loops over the lanes of a chunk that run the same instruction, written with selects instead of branches
+#define LANES for (uint32_t l = 0; l < BATCH_WIDTH; ++l)
+
+// One chunk's slice of every field
+struct Chunk {
+    Batch *batch;
+    uint32_t first; // global index of the chunk's lane 0
+
+    uint8_t *registers;
+    uint16_t *stack;
+    uint64_t *video;
+    uint16_t *pc;
+    uint16_t *index;
+    uint16_t *sp;
+    uint16_t *delay_timer;
+    uint16_t *sound_timer;
+    uint16_t *keys;
+    uint16_t *owned;
+    uint32_t *rng;
+    uint64_t *changed; // the chunk's own, lanes' lines are in the batch
+
+    uint8_t *v(int x) { return registers + x * BATCH_WIDTH; }
+};
+
+static Chunk
+get_chunk(Batch *batch, uint32_t chunk)
+{
+    uint32_t first = chunk * BATCH_WIDTH;
+
+    Chunk result;
+    result.batch = batch;
+    result.first = first;
+    result.registers = batch->registers + first * 16;
+    result.stack = batch->stack + first * 16;
+    result.video = batch->video + first * SCREEN_HEIGHT;
+    result.pc = batch->pc + first;
+    result.index = batch->index + first;
+    result.sp = batch->sp + first;
+    result.delay_timer = batch->delay_timer + first;
+    result.sound_timer = batch->sound_timer + first;
+    result.keys = batch->keys + first;
+    result.owned = batch->owned + first;
+    result.rng = batch->rng + first;
+    result.changed = batch->chunk_changed + chunk * CHANGED_WORDS;
+    return result;
+}
+
+static inline uint16_t
+page_bit(uint16_t address)
+{
+    return static_cast<uint16_t>(1 << ((address & MEMORY_MASK) / PAGE_SIZE));
+}
+
+static inline uint8_t *
+lane_byte(const Batch *batch, uint32_t lane, uint16_t address)
+{
+    address &= MEMORY_MASK;
+    uint32_t page = batch->pages[lane * PAGE_COUNT + address / PAGE_SIZE];
+    return batch->pool + static_cast<size_t>(page) * PAGE_SIZE + address % PAGE_SIZE;
+}
+
+uint8_t
+batch_read_memory(const Batch *batch, uint32_t lane, uint16_t address)
+{
+    return *lane_byte(batch, lane, address);
+}
+
+// The first write to a page gives the lane its own copy, the shared pages and decoded stay untouched
+static void
+copy_page(Batch *batch, uint32_t lane, uint16_t address)
+{
+    uint32_t &page = batch->pages[lane * PAGE_COUNT + address / PAGE_SIZE];
+
+    if (batch->pool_pages == batch->pool_capacity)
+    {
+        batch->pool_capacity *= 2;
+        batch->pool = reinterpret_cast<uint8_t*>(realloc(batch->pool, static_cast<size_t>(batch->pool_capacity) * PAGE_SIZE));
+    }
+
+    std::memcpy(batch->pool + static_cast<size_t>(batch->pool_pages) * PAGE_SIZE, batch->pool + static_cast<size_t>(page) * PAGE_SIZE, PAGE_SIZE);
+    page = batch->pool_pages++;
+    batch->owned[lane] |= page_bit(address);
+}
+
+// Lines never written with anything but the shared bytes can still run the shared decode, even on an owned page
+static inline bool
+line_changed(const Batch *batch, uint32_t lane, uint16_t address)
+{
+    uint32_t line = (address & MEMORY_MASK) / CHANGED_LINE;
+    return (batch->changed[lane * CHANGED_WORDS + line / 64] >> (line % 64)) & 1;
+}
+
+static inline void
+write_lane_memory(Batch *batch, uint32_t lane, uint16_t address, uint8_t value)
+{
+    address &= MEMORY_MASK;
+
+    if (!(batch->owned[lane] & page_bit(address)))
+    {
+        copy_page(batch, lane, address);
+    }
+
+    if (value != batch->pool[address])
+    {
+        uint32_t line = address / CHANGED_LINE;
+        batch->changed[lane * CHANGED_WORDS + line / 64] |= 1ull << (line % 64);
+        batch->chunk_changed[lane / BATCH_WIDTH * CHANGED_WORDS + line / 64] |= 1ull << (line % 64);
+    }
+
+    *lane_byte(batch, lane, address) = value;
+}
+
+// One lane seen through the members ops.inl expects from Chip8, so divergent lanes and the instructions
+// the chunk loops don't cover run the exact same code as the single instance cores
+struct Lane {
+    template <typename T>
+    struct Strided {
+        T *base;
+        T &operator[](int i) const { return base[i * BATCH_WIDTH]; }
+    };
+
+    struct Stack {
+        uint16_t *base;
+        uint16_t &operator[](int i) const { return base[(i & 0xF) * BATCH_WIDTH]; }
+    };
+
+    struct Memory {
+        const Batch *batch;
+        uint32_t lane;
+        uint8_t operator[](int address) const { return *lane_byte(batch, lane, static_cast<uint16_t>(address)); }
+    };
+
+    struct Keypad {
+        uint16_t keys;
+        bool operator[](int key) const { return (keys >> (key & 0xF)) & 1; }
+    };
+
+    // The batch engine doesn't render, dirty tiles are thrown away
+    struct Dirty {
+        uint8_t ignored;
+        uint8_t &operator[](int) { return ignored; }
+    };
+
+    Batch *batch;
+    uint32_t lane;
+    Strided<uint8_t> registers;
+    Strided<uint64_t> video;
+    Stack stack;
+    Memory memory;
+    Keypad keypad;
+    Dirty dirty;
+    uint32_t video_writes; // only the recorder reads it
+    uint16_t &index;
+    uint16_t &sp;
+    uint16_t &delay_timer;
+    uint16_t &sound_timer;
+    uint32_t &rng;
+    static const uint16_t memory_mask = MEMORY_MASK;
+    typedef Legacy_quirks QUIRKS;
+
+    Lane(Chunk &chunk, uint32_t l)
+        : batch(chunk.batch), lane(chunk.first + l),
+          registers{ chunk.registers + l }, video{ chunk.video + l }, stack{ chunk.stack + l },
+          memory{ chunk.batch, chunk.first + l }, keypad{ chunk.keys[l] }, dirty{ 0 }, video_writes(0),
+          index(chunk.index[l]), sp(chunk.sp[l]), delay_timer(chunk.delay_timer[l]), sound_timer(chunk.sound_timer[l]), rng(chunk.rng[l])
+    {
+    }
+
+    void write_memory(uint16_t address, uint8_t value) { write_lane_memory(batch, lane, address, value); }
+    bool any_key() const { return keypad.keys != 0; }
+    uint32_t rand() { return next_random(rng); }
+    uint16_t skip_length(uint16_t) const { return 2; } // lanes only run CHIP-8
+
+    // Returns the address of the next instruction
+    uint16_t
+    execute(const Instruction &in, uint16_t address)
+    {
+        address += 2;
+
+        switch (in.op)
+        {
+#define OP(name) case name:
+#define NEXT break;
+#include "ops.inl"
+#undef OP
+#undef NEXT
+            default:
+                break;
+        }
+
+        return address & MEMORY_MASK;
+    }
+};
+
+// OP_DRW for one lane, as in ops.inl without the dirty tiles
+static void
+draw_lane(Chunk &chunk, uint32_t l, const Instruction &in)
+{
+    uint8_t height = in.nn & 0x000F;
+    uint8_t pos_x = chunk.v(in.x)[l] % SCREEN_WIDTH;
+    uint8_t pos_y = chunk.v(in.y)[l] % SCREEN_HEIGHT;
+    uint16_t index = chunk.index[l];
+    uint64_t *video = chunk.video + l;
+    uint64_t collision = 0;
+
+    for (int i = 0; i < height && pos_y + i < SCREEN_HEIGHT; ++i)
+    {
+        uint64_t sprite = *lane_byte(chunk.batch, chunk.first + l, index + i);
+        uint64_t bits = (sprite << 56) >> pos_x;
+
+        collision |= video[(pos_y + i) * BATCH_WIDTH] & bits;
+        video[(pos_y + i) * BATCH_WIDTH] ^= bits;
+
+        if (pos_x > SCREEN_WIDTH - 8 && pos_y + i + 1 < SCREEN_HEIGHT)
+        {
+            uint64_t spill = sprite << (SCREEN_WIDTH + 56 - pos_x);
+
+            collision |= video[(pos_y + i + 1) * BATCH_WIDTH] & spill;
+            video[(pos_y + i + 1) * BATCH_WIDTH] ^= spill;
+        }
+    }
+
+    chunk.v(0xF)[l] = collision != 0;
+}
+
+// True when every active lane reads the same bytes from the same shared pages at index, up to count bytes on
+static bool
+same_shared_index(Chunk &chunk, const uint8_t *active, int count)
+{
+    uint16_t index = 0;
+    uint8_t found = 0;
+
+    LANES
+    {
+        index = active[l] && !found ? chunk.index[l] : index;
+        found |= active[l];
+    }
+
+    uint16_t pages = page_bit(index) | page_bit(index + count - 1);
+    uint8_t same = 1;
+
+    LANES same &= (active[l] == 0) | ((chunk.index[l] == index) & ((chunk.owned[l] & pages) == 0));
+    return same;
+}
+
+// When the lanes agree on the sprite and where it goes, the rows are XOR'd in across the chunk at once
+static bool
+draw_shared(Chunk &chunk, const Instruction &in, const uint8_t *active)
+{
+    uint8_t height = in.nn & 0x000F;
+
+    if (!same_shared_index(chunk, active, std::max<int>(height, 1)))
+    {
+        return false;
+    }
+
+    uint8_t *vx = chunk.v(in.x);
+    uint8_t *vy = chunk.v(in.y);
+    uint8_t first = 0;
+
+    while (!active[first])
+    {
+        ++first;
+    }
+
+    uint8_t pos_x = vx[first] % SCREEN_WIDTH;
+    uint8_t pos_y = vy[first] % SCREEN_HEIGHT;
+    uint8_t same = 1;
+
+    LANES same &= (active[l] == 0) | ((vx[l] % SCREEN_WIDTH == pos_x) & (vy[l] % SCREEN_HEIGHT == pos_y));
+
+    if (!same)
+    {
+        return false;
+    }
+
+    uint16_t index = chunk.index[first];
+    uint64_t collision[BATCH_WIDTH] = {};
+
+    for (int i = 0; i < height && pos_y + i < SCREEN_HEIGHT; ++i)
+    {
+        uint64_t sprite = chunk.batch->pool[(index + i) & MEMORY_MASK];
+        uint64_t bits = (sprite << 56) >> pos_x;
+        uint64_t spill = pos_x > SCREEN_WIDTH - 8 && pos_y + i + 1 < SCREEN_HEIGHT ? sprite << (SCREEN_WIDTH + 56 - pos_x) : 0;
+        uint64_t *row = chunk.video + (pos_y + i) * BATCH_WIDTH;
+        uint64_t *below = spill ? row + BATCH_WIDTH : row;
+
+        LANES
+        {
+            uint64_t mask = active[l] ? bits : 0;
+            collision[l] |= row[l] & mask;
+            row[l] ^= mask;
+        }
+
+        LANES
+        {
+            uint64_t mask = active[l] ? spill : 0;
+            collision[l] |= below[l] & mask;
+            below[l] ^= mask;
+        }
+    }
+
+    uint8_t *vf = chunk.v(0xF);
+    LANES vf[l] = active[l] ? collision[l] != 0 : vf[l];
+    return true;
+}
+
+// FX65 with every lane reading the same shared bytes is a broadcast into each register
+static bool
+load_shared(Chunk &chunk, const Instruction &in, const uint8_t *active)
+{
+    if (!same_shared_index(chunk, active, in.x + 1))
+    {
+        return false;
+    }
+
+    uint16_t index = 0;
+    LANES index = active[l] ? chunk.index[l] : index;
+
+    for (int i = 0; i <= in.x; ++i)
+    {
+        uint8_t value = chunk.batch->pool[(index + i) & MEMORY_MASK];
+        uint8_t *v = chunk.v(i);
+        LANES v[l] = active[l] ? value : v[l];
+    }
+
+    return true;
+}
+
+// Runs one instruction on the active lanes, which all sit at address. Semantics follow ops.inl
+static void
+execute(Chunk &chunk, const Instruction &in, uint16_t address, const uint8_t *active)
+{
+    uint16_t next = address + 2;
+    uint16_t target[BATCH_WIDTH];
+
+    // Registers are worked on in local copies and stored back, a uint8_t pointer may alias every other field
+    // and would have them reloaded on every lane. VX, VY and VF can be the same register, so stores are redone in order
+    uint8_t *vx = chunk.v(in.x);
+    uint8_t *vf = chunk.v(0xF);
+    uint8_t x[BATCH_WIDTH];
+    uint8_t y[BATCH_WIDTH];
+    uint8_t flag[BATCH_WIDTH];
+    std::memcpy(x, vx, sizeof(x));
+    std::memcpy(y, chunk.v(in.y), sizeof(y));
+
+    LANES target[l] = next;
+
+    switch (in.op)
+    {
+        case OP_SYS:
+        case OP_JMP:
+            LANES target[l] = in.nnn;
+            break;
+        case OP_SE_VX_NN:
+            LANES target[l] = next + (x[l] == in.nn ? 2 : 0);
+            break;
+        case OP_SNE_VX_NN:
+            LANES target[l] = next + (x[l] != in.nn ? 2 : 0);
+            break;
+        case OP_SE_VX_VY:
+            LANES target[l] = next + (x[l] == y[l] ? 2 : 0);
+            break;
+        case OP_SNE_VX_VY:
+            LANES target[l] = next + (x[l] != y[l] ? 2 : 0);
+            break;
+        case OP_LD_VX_NN:
+            LANES x[l] = active[l] ? in.nn : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_ADD_VX_NN:
+            LANES x[l] = active[l] ? static_cast<uint8_t>(x[l] + in.nn) : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_LD_VX_VY:
+            LANES x[l] = active[l] ? y[l] : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_OR:
+            LANES x[l] = active[l] ? x[l] | y[l] : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_AND:
+            LANES x[l] = active[l] ? x[l] & y[l] : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_XOR:
+            LANES x[l] = active[l] ? x[l] ^ y[l] : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_ADD_VX_VY:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SUBN:
+        case OP_SHL:
+        {
+            // VF is written first, then VX is computed from the registers as they are after that
+            std::memcpy(flag, vf, sizeof(flag));
+            uint16_t sum[BATCH_WIDTH];
+            LANES sum[l] = x[l] + y[l];
+
+            switch (in.op)
+            {
+                case OP_ADD_VX_VY:
+                    LANES flag[l] = active[l] ? (sum[l] >= 0xFF ? 1 : 0) : flag[l];
+                    break;
+                case OP_SUB:
+                    LANES flag[l] = active[l] ? (x[l] >= y[l] ? 1 : 0) : flag[l];
+                    break;
+                case OP_SHR:
+                    LANES flag[l] = active[l] ? x[l] & 0x1 : flag[l];
+                    break;
+                case OP_SUBN:
+                    LANES flag[l] = active[l] ? (y[l] >= x[l] ? 1 : 0) : flag[l];
+                    break;
+                default:
+                    LANES flag[l] = active[l] ? (x[l] & 0x80) >> 7 : flag[l];
+                    break;
+            }
+
+            std::memcpy(vf, flag, sizeof(flag));
+
+            if (in.x == 0xF)
+            {
+                std::memcpy(x, flag, sizeof(x));
+            }
+
+            if (in.y == 0xF)
+            {
+                std::memcpy(y, flag, sizeof(y));
+            }
+
+            switch (in.op)
+            {
+                case OP_ADD_VX_VY:
+                    LANES x[l] = active[l] ? static_cast<uint8_t>(sum[l]) : x[l];
+                    break;
+                case OP_SUB:
+                    LANES x[l] = active[l] ? static_cast<uint8_t>(x[l] - y[l]) : x[l];
+                    break;
+                case OP_SHR:
+                    LANES x[l] = active[l] ? x[l] >> 1 : x[l];
+                    break;
+                case OP_SUBN:
+                    LANES x[l] = active[l] ? static_cast<uint8_t>(y[l] - x[l]) : x[l];
+                    break;
+                default:
+                    LANES x[l] = active[l] ? static_cast<uint8_t>(x[l] << 1) : x[l];
+                    break;
+            }
+
+            std::memcpy(vx, x, sizeof(x));
+        } break;
+        case OP_LD_I:
+            LANES chunk.index[l] = active[l] ? in.nnn : chunk.index[l];
+            break;
+        case OP_JMP_V0:
+            LANES target[l] = chunk.v(0)[l] + in.nnn;
+            break;
+        case OP_SKP:
+        case OP_SKNP: // both skip while the key is down, as in ops.inl
+            LANES target[l] = next + (((chunk.keys[l] >> (x[l] & 0xF)) & 1) ? 2 : 0);
+            break;
+        case OP_LD_VX_K:
+            // Lanes without a key down wait on the instruction
+            LANES
+            {
+                uint16_t keys = chunk.keys[l];
+                uint8_t key = 0;
+
+                while (keys && !((keys >> key) & 1))
+                {
+                    ++key;
+                }
+
+                x[l] = active[l] && keys ? key : x[l];
+                target[l] = keys ? next : address;
+            }
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_LD_VX_DT:
+            LANES x[l] = active[l] ? static_cast<uint8_t>(chunk.delay_timer[l]) : x[l];
+            std::memcpy(vx, x, sizeof(x));
+            break;
+        case OP_LD_DT:
+            LANES chunk.delay_timer[l] = active[l] ? x[l] : chunk.delay_timer[l];
+            break;
+        case OP_LD_ST:
+            LANES chunk.sound_timer[l] = active[l] ? x[l] : chunk.sound_timer[l];
+            break;
+        case OP_ADD_I:
+            LANES chunk.index[l] = active[l] ? static_cast<uint16_t>(chunk.index[l] + x[l]) : chunk.index[l];
+            break;
+        case OP_LD_F:
+            LANES chunk.index[l] = active[l] ? static_cast<uint16_t>(5 * x[l]) : chunk.index[l];
+            break;
+        case OP_CLS:
+            for (int i = 0; i < SCREEN_HEIGHT; ++i)
+            {
+                uint64_t *row = chunk.video + i * BATCH_WIDTH;
+                LANES row[l] = active[l] ? 0 : row[l];
+            }
+            break;
+        case OP_CALL:
+            LANES
+            {
+                if (active[l])
+                {
+                    chunk.stack[(chunk.sp[l] & 0xF) * BATCH_WIDTH + l] = next;
+                    ++chunk.sp[l];
+                }
+            }
+            LANES target[l] = in.nnn;
+            break;
+        case OP_RET:
+            LANES
+            {
+                if (active[l])
+                {
+                    target[l] = chunk.stack[(--chunk.sp[l] & 0xF) * BATCH_WIDTH + l];
+                }
+            }
+            break;
+        case OP_RND:
+        {
+            uint32_t *rng = chunk.rng;
+            LANES
+            {
+                uint32_t state = rng[l];
+                uint32_t value = next_random(state);
+                rng[l] = active[l] ? state : rng[l];
+                x[l] = active[l] ? static_cast<uint8_t>((value % 255) & in.nn) : x[l];
+            }
+            std::memcpy(vx, x, sizeof(x));
+        } break;
+        case OP_DRW:
+            if (!draw_shared(chunk, in, active))
+            {
+                LANES
+                {
+                    if (active[l])
+                    {
+                        draw_lane(chunk, l, in);
+                    }
+                }
+            }
+            break;
+        case OP_LD_VX_I:
+            if (!load_shared(chunk, in, active))
+            {
+                LANES
+                {
+                    if (active[l])
+                    {
+                        for (int i = 0; i <= in.x; ++i)
+                        {
+                            chunk.v(i)[l] = *lane_byte(chunk.batch, chunk.first + l, chunk.index[l] + i);
+                        }
+                    }
+                }
+            }
+            break;
+        case OP_LD_I_VX:
+            LANES
+            {
+                if (active[l])
+                {
+                    for (int i = 0; i <= in.x; ++i)
+                    {
+                        write_lane_memory(chunk.batch, chunk.first + l, chunk.index[l] + i, chunk.v(i)[l]);
+                    }
+                }
+            }
+            break;
+        default:
+            // Instructions that block or are rare enough not to need their own loop
+            LANES
+            {
+                if (active[l])
+                {
+                    target[l] = Lane(chunk, l).execute(in, address);
+                }
+            }
+            break;
+    }
+
+    LANES chunk.pc[l] = active[l] ? target[l] & MEMORY_MASK : chunk.pc[l];
+}
+
+// A lane that owns the page still runs the shared instruction as long as it hasn't changed those two bytes
+static inline bool
+shared_code(Chunk &chunk, uint32_t l, uint16_t address)
+{
+    if (!(chunk.owned[l] & (page_bit(address) | page_bit(address + 1))))
+    {
+        return true;
+    }
+
+    const Batch *batch = chunk.batch;
+    uint32_t lane = chunk.first + l;
+    uint16_t after = (address + 1) & MEMORY_MASK;
+
+    if (!line_changed(batch, lane, address) && !line_changed(batch, lane, after))
+    {
+        return true;
+    }
+
+    return *lane_byte(batch, lane, address) == batch->pool[address] && *lane_byte(batch, lane, after) == batch->pool[after];
+}
+
+// Whether any lane of the chunk changed the line, while none has they all run the shared decode
+static inline bool
+chunk_changed(Chunk &chunk, uint16_t address)
+{
+    uint32_t line = (address & MEMORY_MASK) / CHANGED_LINE;
+    return (chunk.changed[line / 64] >> (line % 64)) & 1;
+}
+
+static inline Instruction
+fetch(Chunk &chunk, uint32_t l, uint16_t address)
+{
+    Batch *batch = chunk.batch;
+
+    if (!shared_code(chunk, l, address))
+    {
+        uint32_t lane = chunk.first + l;
+        return decode(batch_read_memory(batch, lane, address) << 8 | batch_read_memory(batch, lane, address + 1));
+    }
+
+    Instruction &entry = batch->decoded[address];
+
+    if (entry.op == OP_UNDECODED)
+    {
+        entry = decode(batch->pool[address] << 8 | batch->pool[(address + 1) & MEMORY_MASK]);
+    }
+
+    return entry;
+}
+
+// Every lane runs exactly one instruction. Lanes at the same address share it, lanes that have rewritten
+// the instruction can't use the shared decode and run alone
+static void
+step(Chunk &chunk)
+{
+    // Lanes still together on shared code skip the search for groups below
+    uint16_t first = chunk.pc[0];
+    uint8_t together = 1;
+
+    LANES together &= chunk.pc[l] == first;
+
+    if (together && !chunk_changed(chunk, first) && !chunk_changed(chunk, first + 1))
+    {
+        uint8_t active[BATCH_WIDTH];
+        LANES active[l] = 1;
+        execute(chunk, fetch(chunk, 0, first), first, active);
+        return;
+    }
+
+    uint32_t remaining = ALL_LANES;
+
+    while (remaining)
+    {
+        uint32_t leader = 0;
+
+        while (!((remaining >> leader) & 1))
+        {
+            ++leader;
+        }
+
+        uint16_t address = chunk.pc[leader];
+        uint16_t code = page_bit(address) | page_bit(address + 1);
+        Instruction in = fetch(chunk, leader, address);
+
+        if (!shared_code(chunk, leader, address))
+        {
+            chunk.pc[leader] = Lane(chunk, leader).execute(in, address);
+            remaining &= ~(1u << leader);
+            continue;
+        }
+
+        uint8_t active[BATCH_WIDTH];
+        uint8_t owners = 0;
+        uint32_t group = 0;
+
+        LANES active[l] = ((remaining >> l) & 1) & (chunk.pc[l] == address);
+        LANES owners |= active[l] & ((chunk.owned[l] & code) != 0);
+
+        if (owners)
+        {
+            LANES active[l] = active[l] && shared_code(chunk, l, address);
+        }
+
+        LANES group |= static_cast<uint32_t>(active[l]) << l;
+
+        // A lane that is on its own isn't worth a pass over the whole chunk
+        if (group == (1u << leader))
+        {
+            chunk.pc[leader] = Lane(chunk, leader).execute(in, address);
+        }
+        else
+        {
+            execute(chunk, in, address, active);
+        }
+
+        remaining &= ~group;
+    }
+}
+
+// Whether any lane left the address of lane 0
+static bool
+split_up(Chunk &chunk)
+{
+    uint8_t apart = 0;
+    LANES apart |= chunk.pc[l] != chunk.pc[0];
+    return apart;
+}
+
+// One lane copied out of the chunk for a run of instructions on its own, registers and the small fields
+// live in the struct so the compiler can keep them in registers between instructions
+struct Solo {
+    Batch *batch;
+    uint32_t lane;
+    uint8_t registers[16];
+    Lane::Strided<uint64_t> video;
+    Lane::Stack stack;
+    Lane::Memory memory;
+    Lane::Keypad keypad;
+    Lane::Dirty dirty;
+    uint32_t video_writes;
+    uint16_t index;
+    uint16_t sp;
+    uint16_t delay_timer;
+    uint16_t sound_timer;
+    uint32_t rng;
+    uint64_t changed[CHANGED_WORDS]; // the lane's changed lines, kept here so fetching shared code doesn't go back to the batch
+    static const uint16_t memory_mask = MEMORY_MASK;
+    typedef Legacy_quirks QUIRKS;
+
+    Solo(Chunk &chunk, uint32_t l)
+        : batch(chunk.batch), lane(chunk.first + l),
+          video{ chunk.video + l }, stack{ chunk.stack + l }, memory{ chunk.batch, chunk.first + l }, keypad{ chunk.keys[l] }, dirty{ 0 }, video_writes(0),
+          index(chunk.index[l]), sp(chunk.sp[l]), delay_timer(chunk.delay_timer[l]), sound_timer(chunk.sound_timer[l]), rng(chunk.rng[l])
+    {
+        std::memcpy(changed, batch->changed + static_cast<size_t>(lane) * CHANGED_WORDS, sizeof(changed));
+
+        for (int i = 0; i < 16; ++i)
+        {
+            registers[i] = chunk.v(i)[l];
+        }
+    }
+
+    void
+    store(Chunk &chunk, uint32_t l) const
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            chunk.v(i)[l] = registers[i];
+        }
+
+        chunk.index[l] = index;
+        chunk.sp[l] = sp;
+        chunk.delay_timer[l] = delay_timer;
+        chunk.sound_timer[l] = sound_timer;
+        chunk.rng[l] = rng;
+    }
+
+    void
+    write_memory(uint16_t address, uint8_t value)
+    {
+        write_lane_memory(batch, lane, address, value);
+        std::memcpy(changed, batch->changed + static_cast<size_t>(lane) * CHANGED_WORDS, sizeof(changed));
+    }
+
+    bool any_key() const { return keypad.keys != 0; }
+    uint32_t rand() { return next_random(rng); }
+    uint16_t skip_length(uint16_t) const { return 2; } // lanes only run CHIP-8
+
+    // One loop over the whole run like Chip8::interpret_quirks, with the timers ticking every STEPS_PER_TICK
+    // instructions from now on
+    uint16_t
+    run(Chunk &chunk, uint32_t l, uint16_t address, uint64_t now, uint32_t steps)
+    {
+        uint32_t until_tick = STEPS_PER_TICK - static_cast<uint32_t>(now % STEPS_PER_TICK);
+
+        const Instruction *decoded = batch->decoded;
+
+        for (uint32_t i = 0; i < steps; ++i)
+        {
+            // Shared code the lane hasn't changed goes straight to the decoded instruction
+            uint32_t line = address / CHANGED_LINE;
+            uint32_t after = ((address + 1) & MEMORY_MASK) / CHANGED_LINE;
+            bool shared = !((changed[line / 64] >> (line % 64)) & 1) && !((changed[after / 64] >> (after % 64)) & 1) &&
+                decoded[address].op != OP_UNDECODED;
+            Instruction in = shared ? decoded[address] : fetch(chunk, l, address);
+            address += 2;
+
+            switch (in.op)
+            {
+#define OP(name) case name:
+#define NEXT break;
+#include "ops.inl"
+#undef OP
+#undef NEXT
+                default:
+                    break;
+            }
+
+            address &= MEMORY_MASK;
+
+            if (--until_tick == 0)
+            {
+                delay_timer -= delay_timer > 0;
+                sound_timer -= sound_timer > 0;
+                until_tick = STEPS_PER_TICK;
+            }
+        }
+
+        return address;
+    }
+};
+
+// Lanes never see each other, so once they have split up each one runs on its own for a while, with its
+// own timer ticks. Long runs keep the host's branch predictors on one program at a time
+static void
+run_alone(Chunk &chunk, uint64_t now, uint32_t steps)
+{
+    for (uint32_t l = 0; l < BATCH_WIDTH; ++l)
+    {
+        Solo solo(chunk, l);
+        chunk.pc[l] = solo.run(chunk, l, chunk.pc[l], now, steps);
+        solo.store(chunk, l);
+    }
+}
+
+static void
+tick_timers(Chunk &chunk)
+{
+    LANES chunk.delay_timer[l] = chunk.delay_timer[l] > 0 ? chunk.delay_timer[l] - 1 : 0;
+    LANES chunk.sound_timer[l] = chunk.sound_timer[l] > 0 ? chunk.sound_timer[l] - 1 : 0;
+}
+
+Batch *
+batch_create(const uint8_t *rom, uint64_t rom_size, uint32_t lanes, uint32_t seed)
+{
+    if (lanes == 0)
+    {
+        return NULL;
+    }
+
+    Batch *batch = reinterpret_cast<Batch*>(calloc(1, sizeof(Batch)));
+
+    if (!batch)
+    {
+        return NULL;
+    }
+
+    batch->lanes = lanes;
+    batch->chunks = (lanes + BATCH_WIDTH - 1) / BATCH_WIDTH;
+
+    size_t count = static_cast<size_t>(batch->chunks) * BATCH_WIDTH;
+
+    batch->registers = reinterpret_cast<uint8_t*>(calloc(count * 16, sizeof(uint8_t)));
+    batch->stack = reinterpret_cast<uint16_t*>(calloc(count * 16, sizeof(uint16_t)));
+    batch->video = reinterpret_cast<uint64_t*>(calloc(count * SCREEN_HEIGHT, sizeof(uint64_t)));
+    batch->pc = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->index = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->sp = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->delay_timer = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->sound_timer = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->keys = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->owned = reinterpret_cast<uint16_t*>(calloc(count, sizeof(uint16_t)));
+    batch->changed = reinterpret_cast<uint64_t*>(calloc(count * CHANGED_WORDS, sizeof(uint64_t)));
+    batch->chunk_changed = reinterpret_cast<uint64_t*>(calloc(batch->chunks * CHANGED_WORDS, sizeof(uint64_t)));
+    batch->rng = reinterpret_cast<uint32_t*>(calloc(count, sizeof(uint32_t)));
+    batch->pages = reinterpret_cast<uint32_t*>(calloc(count * PAGE_COUNT, sizeof(uint32_t)));
+    batch->pool_capacity = INITIAL_POOL_PAGES;
+    batch->pool = reinterpret_cast<uint8_t*>(calloc(batch->pool_capacity, PAGE_SIZE));
+    batch->pool_pages = PAGE_COUNT;
+
+    if (!batch->registers || !batch->stack || !batch->video || !batch->pc || !batch->index || !batch->sp ||
+        !batch->delay_timer || !batch->sound_timer || !batch->keys || !batch->owned || !batch->changed || !batch->chunk_changed || !batch->rng || !batch->pages || !batch->pool)
+    {
+        batch_destroy(batch);
+        return NULL;
+    }
+
+    std::copy(font, font + FONT_SIZE, batch->pool);
+    std::copy(rom, rom + std::min<uint64_t>(rom_size, MEMORY_SIZE - MEMORY_START_ADDRESS), batch->pool + MEMORY_START_ADDRESS);
+
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        batch->pc[lane] = MEMORY_START_ADDRESS;
+
+        batch->rng[lane] = random_seed(seed, static_cast<uint32_t>(lane));
+
+        for (int page = 0; page < PAGE_COUNT; ++page)
+        {
+            batch->pages[lane * PAGE_COUNT + page] = page;
+        }
+    }
+
+    return batch;
+}
+
+void
+batch_destroy(Batch *batch)
+{
+    free(batch->registers);
+    free(batch->stack);
+    free(batch->video);
+    free(batch->pc);
+    free(batch->index);
+    free(batch->sp);
+    free(batch->delay_timer);
+    free(batch->sound_timer);
+    free(batch->keys);
+    free(batch->owned);
+    free(batch->changed);
+    free(batch->chunk_changed);
+    free(batch->rng);
+    free(batch->pages);
+    free(batch->pool);
+    free(batch);
+}
+
+void
+batch_set_keys(Batch *batch, uint32_t lane, uint16_t keys)
+{
+    batch->keys[lane] = keys;
+}
+
+// Chunk by chunk rather than step by step so each chunk's state stays in cache for the whole run. At each tick
+// the chunk decides whether its lanes are together enough to share instructions until the next one
+void
+batch_run(Batch *batch, uint32_t steps)
+{
+    for (uint32_t i = 0; i < batch->chunks; ++i)
+    {
+        Chunk chunk = get_chunk(batch, i);
+        uint32_t done = 0;
+
+        while (done < steps)
+        {
+            uint64_t now = batch->steps + done;
+
+            if (split_up(chunk))
+            {
+                uint32_t count = std::min(SOLO_STEPS, steps - done);
+                run_alone(chunk, now, count);
+                done += count;
+                continue;
+            }
+
+            uint32_t count = std::min(STEPS_PER_TICK - static_cast<uint32_t>(now % STEPS_PER_TICK), steps - done);
+
+            for (uint32_t j = 0; j < count; ++j)
+            {
+                step(chunk);
+            }
+
+            done += count;
+
+            if ((now + count) % STEPS_PER_TICK == 0)
+            {
+                tick_timers(chunk);
+            }
+        }
+    }
+
+    batch->steps += steps;
+}
+
+// Everything the lane doesn't have (hooks, rewind, movie, queued keys, the other modes' state) is left zero
+void
+batch_copy_lane(const Batch *batch, uint32_t lane, Chip8 *out)
+{
+    uint32_t chunk = lane / BATCH_WIDTH;
+    uint32_t l = lane % BATCH_WIDTH;
+
+    std::memset(out, 0, sizeof(*out));
+
+    for (int i = 0; i < 16; ++i)
+    {
+        out->registers[i] = batch->registers[(chunk * 16 + i) * BATCH_WIDTH + l];
+        out->stack[i] = batch->stack[(chunk * 16 + i) * BATCH_WIDTH + l];
+        out->keypad[i] = (batch->keys[lane] >> i) & 1;
+    }
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        out->video[i] = batch->video[(chunk * SCREEN_HEIGHT + i) * BATCH_WIDTH + l];
+    }
+
+    out->memory = out->base_memory;
+
+    for (int i = 0; i < MEMORY_SIZE; ++i)
+    {
+        out->memory[i] = batch_read_memory(batch, lane, static_cast<uint16_t>(i));
+    }
+
+    out->memory_mask = MEMORY_MASK;
+    out->mode = MODE_CHIP8;
+    out->quirks = QUIRKS_LEGACY;
+    out->planes = 1;
+    out->pitch = DEFAULT_PITCH;
+
+    out->index = batch->index[lane];
+    out->pc = batch->pc[lane];
+    out->sp = batch->sp[lane];
+    out->delay_timer = batch->delay_timer[lane];
+    out->sound_timer = batch->sound_timer[lane];
+    out->rng = batch->rng[lane];
+    out->cycles = batch->steps;
+    out->ticks = batch->steps / STEPS_PER_TICK;
+    out->ips = DEFAULT_IPS;
+    out->speed = 1;
+    out->running = true;
+    out->core = CORE_INTERPRETER;
+    std::memset(out->dirty, 0xFF, sizeof(out->dirty));
+}
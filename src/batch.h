@@ -0,0 +1,53 @@
+#pragma once
+#include "chip8.h"
+
+#include <cstdint>
+
+// Many instances of one ROM in little memory, for searches and tests over large populations of inputs. State is
+// kept as structure of arrays and memory as copy on write pages, so a lane costs a few hundred bytes instead of a
+// whole Chip8. Lanes of a chunk that sit at the same address share one decode and run the instruction in one loop,
+// the rest run one after the other. Lanes only implement the legacy quirk profile
+
+const uint32_t BATCH_WIDTH = 16; // lanes stepped together, each chunk of lanes keeps its state contiguous
+const int PAGE_SIZE = 256;
+const int PAGE_COUNT = MEMORY_SIZE / PAGE_SIZE;
+const int CHANGED_LINE = 16; // bytes per bit of Batch::changed
+const int CHANGED_WORDS = MEMORY_SIZE / CHANGED_LINE / 64;
+
+struct Batch {
+    uint32_t lanes; // instances asked for
+    uint32_t chunks; // lanes / BATCH_WIDTH rounded up, the padding lanes in the last chunk run but are never reported
+
+    // Per chunk fields hold BATCH_WIDTH values per element, e.g. registers[(chunk * 16 + x) * BATCH_WIDTH + lane]
+    uint8_t *registers;
+    uint16_t *stack;
+    uint64_t *video;
+
+    // Per lane fields are indexed by chunk * BATCH_WIDTH + lane
+    uint16_t *pc;
+    uint16_t *index;
+    uint16_t *sp;
+    uint16_t *delay_timer;
+    uint16_t *sound_timer;
+    uint16_t *keys; // bit N set while key N is down
+    uint16_t *owned; // bit N set once the lane has written to page N and has its own copy
+    uint64_t *changed; // [lane][CHANGED_WORDS], bit N set once the lane wrote something other than the shared byte in line N
+    uint64_t *chunk_changed; // [chunk][CHANGED_WORDS], changed of the chunk's lanes ORed together
+    uint32_t *rng; // xorshift state for CXNN, lane N starts where a single instance with stream N would
+
+    // Memory is copy on write, every lane starts out pointing at the shared pages 0 to PAGE_COUNT - 1 of the pool
+    uint32_t *pages; // [lane][PAGE_COUNT]
+    uint8_t *pool;
+    uint32_t pool_pages;
+    uint32_t pool_capacity;
+
+    uint64_t steps; // instructions executed by every lane so far
+    Instruction decoded[MEMORY_SIZE]; // of the shared pages only, so it never needs invalidating
+};
+
+Batch *batch_create(const uint8_t *rom, uint64_t rom_size, uint32_t lanes, uint32_t seed);
+void batch_destroy(Batch *batch);
+void batch_set_keys(Batch *batch, uint32_t lane, uint16_t keys);
+void batch_run(Batch *batch, uint32_t steps); // every lane executes steps instructions
+uint8_t batch_read_memory(const Batch *batch, uint32_t lane, uint16_t address);
+void batch_copy_lane(const Batch *batch, uint32_t lane, Chip8 *out); // machine state only, for inspecting a lane with the usual tools
@@ -0,0 +1,1081 @@
+#include "win32.h"
+#include "posix.h"
+#include "chip8.h"
+#include "aot.h"
+#include "batch.h"
+#include "upscale.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "recorder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Compares the instructions/second of every core on every ROM, e.g. ./bin/bench --cycles=20000000 ./roms
+// plus the synthetic opcode mixes below, with the render cost per frame. --json writes the results for scripts
+// With --upscale it instead times full redraws for every upscale kernel, filter and scale
+// With --batch it runs populations of each ROM on the batch engine and reports aggregate instructions/second
+// With --snapshot it times in-memory save states the way run-ahead uses them
+// With --rewind it records a minute of every ROM with changing keys and reports compression and costs per frame
+// With --video it compares throughput with and without the frame stream recorder on the interpreter and the JIT
+#if CHIP8_AOT
+const char *CORES[] = { "interpreter", "threaded", "jit", "aot" }; // aot only recompiled one of the ROMs
+#else
+const char *CORES[] = { "interpreter", "threaded", "jit" };
+#endif
+const int CORE_COUNT = sizeof(CORES) / sizeof(CORES[0]);
+const uint64_t DEFAULT_CYCLES = 20000000;
+const uint64_t DEFAULT_REPEAT = 3;
+const uint64_t DEFAULT_WARMUP = 1;
+const uint64_t KEY_FRAMES = 30; // scripted keys change twice a second of emulated time
+const uint64_t KEY_CYCLES = KEY_FRAMES * DEFAULT_IPS / 60; // the same instructions apart at any --ips
+const uint64_t RENDER_FRAMES = 600;
+const char *FILTER_NAMES[] = { "none", "scale2x", "scale3x" };
+const int UPSCALE_SCALES[] = { 4, 15, 30, 60 }; // 60 is 3840x1920
+const int UPSCALE_FRAMES = 50;
+const uint32_t BATCH_SIZES[] = { 1000, 10000, 100000 };
+const uint32_t BATCH_INPUT_STEPS = 480; // each lane picks new keys every 60 emulated frames
+const uint64_t SNAPSHOT_WARMUP_FRAMES = 600;
+const int SNAPSHOT_ROUNDS = 100000;
+const uint64_t REWIND_FRAMES = 3600;
+const uint64_t REWIND_KEY_FRAMES = 30;
+const uint64_t REWIND_BUDGET = 64 * 1024 * 1024; // large enough that nothing is dropped
+const char *VIDEO_CORES[] = { "interpreter", "jit" };
+
+// Keys every ROM sees in the throughput and render runs, so ROMs that wait for input get going and every run
+// of the same build executes exactly the same instructions
+static void
+script_keys(Chip8 *machine, uint32_t &keys)
+{
+    uint32_t value = next_random(keys);
+    std::memset(machine->keypad, false, sizeof(machine->keypad));
+    machine->keypad[value & 0xF] = (value >> 4) & 1;
+}
+
+// video records a frame stream to that path, NULL for none. Throughput runs go at MAX_IPS, where the timer ticks
+// are too far apart to cap how many instructions the cores get in one call. Idle skipping is off so every
+// instruction counted ran on the core
+static void *
+create_application(const std::string &rom, const char *core, uint32_t ips, const char *video)
+{
+    std::string rom_arg = rom;
+    std::string core_arg = std::string("--core=") + core;
+    std::string ips_arg = "--ips=" + std::to_string(ips);
+    std::string video_arg = std::string("--video=") + (video ? video : "");
+    char program[] = "bench";
+    char seed_arg[] = "--seed=1";
+    char skip_idle_arg[] = "--skip-idle=off";
+    char *argv[] = { program, &rom_arg[0], &core_arg[0], seed_arg, skip_idle_arg, &ips_arg[0], &video_arg[0] };
+
+    void *application = NULL;
+    int width, height;
+    const char *window_title;
+
+    if (!init_application(video ? 7 : 6, argv, &application, &width, &height, &window_title) || !application)
+    {
+        return NULL;
+    }
+
+    return application;
+}
+
+// Instructions/second of each timed run, after warmup runs that are thrown away. A fresh machine each time so
+// every run starts from the same state
+static std::vector<double>
+measure(const std::string &rom, const char *core, uint64_t cycles, uint64_t repeat, uint64_t warmup)
+{
+    std::vector<double> runs;
+
+    for (uint64_t i = 0; i < warmup + repeat; ++i)
+    {
+        void *application = create_application(rom, core, MAX_IPS, NULL);
+
+        if (!application)
+        {
+            return runs;
+        }
+
+        Chip8 *machine = reinterpret_cast<Chip8*>(application);
+        uint32_t keys = random_seed(1, 1);
+        Run_stats stats = {};
+
+        double start_time = time_ms();
+
+        while (stats.cycles < cycles)
+        {
+            script_keys(machine, keys);
+
+            if (!run_application(application, std::min(cycles, stats.cycles + KEY_CYCLES), 0, stats))
+            {
+                break;
+            }
+        }
+
+        double elapsed = (time_ms() - start_time) / 1000;
+
+        destroy_application(application);
+
+        if (i >= warmup && elapsed > 0)
+        {
+            runs.push_back(stats.cycles / elapsed);
+        }
+    }
+
+    return runs;
+}
+
+// Mean cost of the renders a window host does once per frame, dirty tiles only, at the default scale
+static double
+measure_render(const std::string &rom)
+{
+    void *application = NULL;
+    std::string rom_arg = rom;
+    char program[] = "bench";
+    char seed_arg[] = "--seed=1";
+    char *argv[] = { program, &rom_arg[0], seed_arg };
+    int width, height;
+    const char *window_title;
+
+    if (!init_application(3, argv, &application, &width, &height, &window_title) || !application)
+    {
+        return 0;
+    }
+
+    Chip8 *machine = reinterpret_cast<Chip8*>(application);
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    Dirty_rects dirty = {};
+    uint32_t keys = random_seed(1, 1);
+    Run_stats stats = {};
+    double elapsed = 0;
+
+    while (stats.frames < RENDER_FRAMES)
+    {
+        if (stats.frames % KEY_FRAMES == 0)
+        {
+            script_keys(machine, keys);
+        }
+
+        if (!run_application(application, 0, stats.frames + 1, stats))
+        {
+            break;
+        }
+
+        double start_time = time_ms();
+        render_application(application, pixels.data(), width, height, dirty);
+        elapsed += time_ms() - start_time;
+    }
+
+    destroy_application(application);
+
+    return stats.frames ? elapsed * 1000 / stats.frames : 0;
+}
+
+// Small loops that each hammer one part of the core, written out as ROM files so they take the same path as
+// real ROMs
+struct Synthetic_rom {
+    const char *name;
+    std::vector<uint8_t> code;
+};
+
+static const Synthetic_rom SYNTHETIC_ROMS[] = {
+    // Font sprite drawn at a new position each time, wrapping around the screen
+    { "synthetic-drw", { 0x60, 0x00, 0x61, 0x00, 0xA0, 0x00, 0xD0, 0x15, 0x70, 0x03, 0x71, 0x01, 0x12, 0x06 } },
+    // All sixteen registers loaded, changed and stored back every pass
+    { "synthetic-memory", { 0xA3, 0x00, 0xFF, 0x65, 0x70, 0x01, 0xFF, 0x55, 0x12, 0x02 } },
+    // Every 8XYN flavour, with carries and borrows flowing from one into the next
+    { "synthetic-alu", { 0x60, 0x13, 0x61, 0x57, 0x62, 0x9B, 0x63, 0xDF,
+        0x80, 0x14, 0x81, 0x25, 0x82, 0x36, 0x83, 0x07, 0x80, 0x3E, 0x81, 0x01, 0x82, 0x12, 0x83, 0x23, 0x84, 0x30,
+        0x12, 0x08 } },
+};
+
+static bool
+write_synthetic_roms(const std::string &dir, std::vector<std::string> &roms)
+{
+    for (const Synthetic_rom &rom : SYNTHETIC_ROMS)
+    {
+        std::string path = dir + "/" + rom.name;
+        FILE *file = std::fopen(path.c_str(), "wb");
+
+        if (!file)
+        {
+            return false;
+        }
+
+        bool written = std::fwrite(rom.code.data(), rom.code.size(), 1, file) == 1;
+
+        if (std::fclose(file) != 0 || !written)
+        {
+            return false;
+        }
+
+        roms.push_back(path);
+    }
+
+    return true;
+}
+
+static void
+write_json_string(FILE *out, const char *text)
+{
+    std::fputc('"', out);
+
+    for (const char *c = text; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            std::fputc('\\', out);
+        }
+
+        std::fputc(*c, out);
+    }
+
+    std::fputc('"', out);
+}
+
+struct Core_result {
+    double median; // instructions/second
+    double best;
+    double worst;
+};
+
+static void
+bench_cores(const std::vector<std::string> &roms, uint64_t cycles, uint64_t repeat, uint64_t warmup, const char *json_path)
+{
+    // Throughput per ROM and core, render cost per ROM since it doesn't depend on the core
+    std::vector<Core_result> results(roms.size() * CORE_COUNT);
+    std::vector<double> renders(roms.size());
+    bool table = !json_path || std::strcmp(json_path, "-") != 0;
+
+    if (table)
+    {
+        std::printf("%-24s", "MIPS (median)");
+
+        for (int core = 0; core < CORE_COUNT; ++core)
+        {
+            std::printf("%14s", CORES[core]);
+        }
+
+        std::printf("%14s\n", "render us");
+    }
+
+    std::vector<double> totals(CORE_COUNT, 0);
+
+    for (size_t i = 0; i < roms.size(); ++i)
+    {
+        const char *name = std::strrchr(roms[i].c_str(), '/');
+
+        if (table)
+        {
+            std::printf("%-24s", name ? name + 1 : roms[i].c_str());
+        }
+
+        for (int core = 0; core < CORE_COUNT; ++core)
+        {
+            std::vector<double> runs = measure(roms[i], CORES[core], cycles, repeat, warmup);
+            Core_result &result = results[i * CORE_COUNT + core];
+            result = Core_result();
+
+            if (!runs.empty())
+            {
+                std::sort(runs.begin(), runs.end());
+                result.median = runs.size() % 2 ? runs[runs.size() / 2] : (runs[runs.size() / 2 - 1] + runs[runs.size() / 2]) / 2;
+                result.best = runs.back();
+                result.worst = runs.front();
+            }
+
+            totals[core] += result.median;
+
+            if (table)
+            {
+                std::printf("%14.1f", result.median / 1000000);
+                std::fflush(stdout);
+            }
+        }
+
+        renders[i] = measure_render(roms[i]);
+
+        if (table)
+        {
+            std::printf("%14.1f\n", renders[i]);
+        }
+    }
+
+    if (table)
+    {
+        std::printf("%-24s", "mean");
+
+        for (int core = 0; core < CORE_COUNT; ++core)
+        {
+            std::printf("%14.1f", roms.empty() ? 0 : totals[core] / roms.size() / 1000000);
+        }
+
+        std::printf("\npeak RSS %llu KB\n", static_cast<unsigned long long>(peak_rss_kb()));
+    }
+
+    if (!json_path)
+    {
+        return;
+    }
+
+    FILE *out = table ? std::fopen(json_path, "w") : stdout;
+
+    if (!out)
+    {
+        std::fprintf(stderr, "Can't write %s\n", json_path);
+        return;
+    }
+
+    std::fprintf(out, "{\n  \"cycles\": %llu,\n  \"repeat\": %llu,\n  \"warmup\": %llu,\n  \"render_frames\": %llu,\n",
+        static_cast<unsigned long long>(cycles), static_cast<unsigned long long>(repeat),
+        static_cast<unsigned long long>(warmup), static_cast<unsigned long long>(RENDER_FRAMES));
+    std::fprintf(out, "  \"peak_rss_kb\": %llu,\n  \"results\": [", static_cast<unsigned long long>(peak_rss_kb()));
+
+    for (size_t i = 0; i < roms.size(); ++i)
+    {
+        const char *name = std::strrchr(roms[i].c_str(), '/');
+
+        for (int core = 0; core < CORE_COUNT; ++core)
+        {
+            const Core_result &result = results[i * CORE_COUNT + core];
+
+            std::fprintf(out, "%s\n    { \"rom\": ", i == 0 && core == 0 ? "" : ",");
+            write_json_string(out, name ? name + 1 : roms[i].c_str());
+            std::fprintf(out, ", \"core\": \"%s\", \"instructions_per_second\": %.0f, \"best\": %.0f, \"worst\": %.0f, "
+                "\"ns_per_instruction\": %.3f, \"render_us_per_frame\": %.2f }", CORES[core], result.median, result.best,
+                result.worst, result.median > 0 ? 1e9 / result.median : 0, renders[i]);
+        }
+    }
+
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+    {
+        std::fclose(out);
+    }
+}
+
+// Best time per output megapixel to redraw a whole noisy frame, the worst case for dirty tracking
+static double
+measure_upscale(const std::string &rom, int kernel, const char *filter, int scale, uint64_t repeat)
+{
+    std::string rom_arg = rom;
+    std::string filter_arg = std::string("--filter=") + filter;
+    std::string scale_arg = "--scale=" + std::to_string(scale);
+    char program[] = "bench";
+    char *argv[] = { program, &rom_arg[0], &filter_arg[0], &scale_arg[0] };
+
+    void *application = NULL;
+    int width, height;
+    const char *window_title;
+
+    if (!upscale_select(kernel) || !init_application(4, argv, &application, &width, &height, &window_title) || !application)
+    {
+        return 0;
+    }
+
+    Chip8 *emulator = reinterpret_cast<Chip8*>(application);
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        emulator->video[i] = state;
+    }
+
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    Dirty_rects dirty;
+    double best = 0;
+
+    for (uint64_t i = 0; i < repeat; ++i)
+    {
+        double start_time = time_ms();
+
+        for (int frame = 0; frame < UPSCALE_FRAMES; ++frame)
+        {
+            invalidate_application(application);
+            render_application(application, pixels.data(), width, height, dirty);
+        }
+
+        double elapsed = (time_ms() - start_time) / UPSCALE_FRAMES;
+        best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+
+    destroy_application(application);
+
+    return best * 1000 / (static_cast<double>(width) * height / 1000000);
+}
+
+static void
+bench_upscale(const std::string &rom, uint64_t repeat)
+{
+    std::printf("%-20s", "us per output MP");
+
+    for (int kernel = 0; kernel < KERNEL_COUNT; ++kernel)
+    {
+        std::printf("%10s", upscale_kernel_name(kernel));
+    }
+
+    std::printf("\n");
+
+    for (const char *filter : FILTER_NAMES)
+    {
+        for (int scale : UPSCALE_SCALES)
+        {
+            char label[32];
+            std::snprintf(label, sizeof(label), "%s x%d", filter, scale);
+            std::printf("%-20s", label);
+
+            for (int kernel = 0; kernel < KERNEL_COUNT; ++kernel)
+            {
+                double cost = measure_upscale(rom, kernel, filter, scale, repeat);
+
+                if (cost > 0)
+                {
+                    std::printf("%10.1f", cost);
+                }
+                else
+                {
+                    std::printf("%10s", "-");
+                }
+            }
+
+            std::printf("\n");
+        }
+    }
+}
+
+// Every lane gets its own pseudo random keys so the population diverges like a real search would. steps is per lane
+static double
+measure_batch(const std::string &rom, uint32_t lanes, uint64_t steps, uint64_t repeat)
+{
+    uint64_t size;
+    std::string rom_arg = rom;
+    uint8_t *data = read_file(&rom_arg[0], &size);
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    double best = 0;
+
+    for (uint64_t i = 0; i < repeat; ++i)
+    {
+        Batch *batch = batch_create(data, size, lanes, static_cast<uint32_t>(i + 1));
+
+        if (!batch)
+        {
+            break;
+        }
+
+        uint32_t state = 0x12345678;
+        double elapsed = 0;
+
+        for (uint64_t done = 0; done < steps; done += BATCH_INPUT_STEPS)
+        {
+            for (uint32_t lane = 0; lane < lanes; ++lane)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                batch_set_keys(batch, lane, (state & 1) ? static_cast<uint16_t>(1 << ((state >> 1) & 0xF)) : 0);
+            }
+
+            double start_time = time_ms();
+            batch_run(batch, static_cast<uint32_t>(std::min<uint64_t>(BATCH_INPUT_STEPS, steps - done)));
+            elapsed += time_ms() - start_time;
+        }
+
+        batch_destroy(batch);
+
+        if (elapsed > 0)
+        {
+            best = std::max(best, static_cast<double>(steps) * lanes / (elapsed / 1000));
+        }
+    }
+
+    free(data);
+
+    return best;
+}
+
+// The same schedule on BATCH_WIDTH separate machines with the interpreter, what the batch engine has to beat
+static double
+measure_single(const std::string &rom, uint64_t steps, uint64_t repeat)
+{
+    uint64_t size;
+    std::string rom_arg = rom;
+    uint8_t *data = read_file(&rom_arg[0], &size);
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    std::vector<Chip8*> machines(BATCH_WIDTH);
+    double best = 0;
+
+    for (Chip8 *&machine : machines)
+    {
+        machine = reinterpret_cast<Chip8*>(calloc(1, sizeof(Chip8)));
+
+        if (!machine)
+        {
+            free(data);
+            return 0;
+        }
+
+        machine->core = CORE_INTERPRETER;
+        machine->quirks = QUIRKS_LEGACY;
+        machine->ips = DEFAULT_IPS;
+        machine->speed = 1;
+    }
+
+    for (uint64_t i = 0; i < repeat; ++i)
+    {
+        for (Chip8 *machine : machines)
+        {
+            machine->load(data, size, static_cast<uint32_t>(i + 1));
+        }
+
+        uint32_t state = 0x12345678;
+        double elapsed = 0;
+
+        for (uint64_t done = 0; done < steps; done += BATCH_INPUT_STEPS)
+        {
+            double start_time = time_ms();
+
+            for (Chip8 *machine : machines)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                std::memset(machine->keypad, false, sizeof(machine->keypad));
+                machine->keypad[(state >> 1) & 0xF] = state & 1;
+                machine->run(std::min<uint64_t>(BATCH_INPUT_STEPS, steps - done));
+            }
+
+            elapsed += time_ms() - start_time;
+        }
+
+        if (elapsed > 0)
+        {
+            best = std::max(best, static_cast<double>(steps) * BATCH_WIDTH / (elapsed / 1000));
+        }
+    }
+
+    for (Chip8 *machine : machines)
+    {
+        free(machine);
+    }
+
+    free(data);
+
+    return best;
+}
+
+// Aggregate instructions/second for each population size, next to the single machine baseline. Every lane and
+// every baseline machine runs the same steps, as many as the largest population can do in cycles but at least one
+// key change, so all columns have diverged for as long
+static void
+bench_batch(const std::vector<std::string> &roms, uint64_t cycles, uint64_t repeat)
+{
+    const int size_count = sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]);
+    uint64_t steps = std::max<uint64_t>(cycles / BATCH_SIZES[size_count - 1], BATCH_INPUT_STEPS);
+    std::printf("%-24s%10s", "batch MIPS", "single");
+
+    for (uint32_t lanes : BATCH_SIZES)
+    {
+        std::printf("%10u", lanes);
+    }
+
+    std::printf("\n");
+
+    std::vector<double> totals(size_count, 0);
+    double single_total = 0;
+
+    for (const std::string &rom : roms)
+    {
+        const char *name = std::strrchr(rom.c_str(), '/');
+        std::printf("%-24s", name ? name + 1 : rom.c_str());
+
+        double single = measure_single(rom, steps, repeat);
+        single_total += single;
+        std::printf("%10.1f", single / 1000000);
+        std::fflush(stdout);
+
+        for (int i = 0; i < size_count; ++i)
+        {
+            double ips = measure_batch(rom, BATCH_SIZES[i], steps, repeat);
+            totals[i] += ips;
+            std::printf("%10.1f", ips / 1000000);
+            std::fflush(stdout);
+        }
+
+        std::printf("\n");
+    }
+
+    std::printf("%-24s%10.1f", "mean", roms.empty() ? 0 : single_total / roms.size() / 1000000);
+
+    for (int i = 0; i < size_count; ++i)
+    {
+        std::printf("%10.1f", roms.empty() ? 0 : totals[i] / roms.size() / 1000000);
+    }
+
+    std::printf("\n");
+}
+
+// Restores alternate between two states a frame apart, so every restore has that frame's changes to undo
+static void
+measure_snapshot(const std::string &rom, const char *core, uint64_t repeat, double *save_ns, double *restore_ns)
+{
+    std::string rom_arg = rom;
+    std::string core_arg = std::string("--core=") + core;
+    char program[] = "bench";
+    char seed_arg[] = "--seed=1";
+    char *argv[] = { program, &rom_arg[0], &core_arg[0], seed_arg };
+
+    void *application = NULL;
+    int width, height;
+    const char *window_title;
+
+    *save_ns = 0;
+    *restore_ns = 0;
+
+    if (!init_application(4, argv, &application, &width, &height, &window_title) || !application)
+    {
+        return;
+    }
+
+    Chip8 *machine = reinterpret_cast<Chip8*>(application);
+    Snapshot *states = reinterpret_cast<Snapshot*>(malloc(2 * sizeof(Snapshot)));
+    Run_stats stats = {};
+
+    run_application(application, 0, SNAPSHOT_WARMUP_FRAMES, stats);
+    snapshot_save(*machine, states[0]);
+    run_application(application, 0, SNAPSHOT_WARMUP_FRAMES + 1, stats);
+    snapshot_save(*machine, states[1]);
+
+    for (uint64_t i = 0; i < repeat; ++i)
+    {
+        double start_time = time_ms();
+
+        for (int j = 0; j < SNAPSHOT_ROUNDS; ++j)
+        {
+            snapshot_save(*machine, states[j & 1]);
+        }
+
+        double save_time = time_ms() - start_time;
+        start_time = time_ms();
+
+        for (int j = 0; j < SNAPSHOT_ROUNDS; ++j)
+        {
+            snapshot_restore(*machine, states[j & 1]);
+        }
+
+        double restore_time = time_ms() - start_time;
+
+        *save_ns = i == 0 ? save_time : std::min(*save_ns, save_time);
+        *restore_ns = i == 0 ? restore_time : std::min(*restore_ns, restore_time);
+    }
+
+    *save_ns *= 1000000.0 / SNAPSHOT_ROUNDS;
+    *restore_ns *= 1000000.0 / SNAPSHOT_ROUNDS;
+
+    free(states);
+    destroy_application(application);
+}
+
+static void
+bench_snapshot(const std::vector<std::string> &roms, uint64_t repeat)
+{
+    std::printf("%-24s", "snapshot ns");
+
+    for (int core = 0; core < CORE_COUNT; ++core)
+    {
+        std::printf("%10s %-9s", "save", CORES[core]);
+        std::printf("%10s", "restore");
+    }
+
+    std::printf("\n");
+
+    for (const std::string &rom : roms)
+    {
+        const char *name = std::strrchr(rom.c_str(), '/');
+        std::printf("%-24s", name ? name + 1 : rom.c_str());
+
+        for (int core = 0; core < CORE_COUNT; ++core)
+        {
+            double save_ns, restore_ns;
+            measure_snapshot(rom, CORES[core], repeat, &save_ns, &restore_ns);
+            std::printf("%10.1f %-9s%10.1f", save_ns, "", restore_ns);
+            std::fflush(stdout);
+        }
+
+        std::printf("\n");
+    }
+}
+
+static void
+bench_rewind(const std::vector<std::string> &roms)
+{
+    std::printf("%-24s%10s%12s%10s%10s\n", "rewind", "ratio", "bytes/frame", "push ns", "step ns");
+
+    double total_ratio = 0;
+
+    for (const std::string &rom : roms)
+    {
+        std::string rom_arg = rom;
+        char program[] = "bench";
+        char seed_arg[] = "--seed=1";
+        char *argv[] = { program, &rom_arg[0], seed_arg };
+
+        void *application = NULL;
+        int width, height;
+        const char *window_title;
+
+        if (!init_application(3, argv, &application, &width, &height, &window_title) || !application)
+        {
+            continue;
+        }
+
+        Chip8 *machine = reinterpret_cast<Chip8*>(application);
+        Rewind *rewind = rewind_create(REWIND_BUDGET);
+        Run_stats stats = {};
+        uint32_t keys = random_seed(1, 1);
+        double push_time = 0;
+
+        rewind_push(rewind, *machine);
+
+        while (stats.frames < REWIND_FRAMES && machine->running)
+        {
+            if (stats.frames % REWIND_KEY_FRAMES == 0)
+            {
+                uint32_t value = next_random(keys);
+                std::memset(machine->keypad, false, sizeof(machine->keypad));
+                machine->keypad[value & 0xF] = (value >> 4) & 1;
+            }
+
+            run_application(application, 0, stats.frames + 1, stats);
+
+            double start_time = time_ms();
+            rewind_push(rewind, *machine);
+            push_time += time_ms() - start_time;
+        }
+
+        Rewind_stats recorded = rewind_stats(rewind);
+
+        double start_time = time_ms();
+        uint64_t steps = 0;
+
+        while (rewind_step(rewind, *machine))
+        {
+            ++steps;
+        }
+
+        double step_time = time_ms() - start_time;
+
+        const char *name = std::strrchr(rom.c_str(), '/');
+        std::printf("%-24s%10.1f%12.1f%10.1f%10.1f\n", name ? name + 1 : rom.c_str(), recorded.ratio,
+            recorded.frames ? static_cast<double>(recorded.used) / recorded.frames : 0,
+            recorded.frames ? push_time * 1000000 / recorded.frames : 0, steps ? step_time * 1000000 / steps : 0);
+
+        total_ratio += recorded.ratio;
+        rewind_destroy(rewind);
+        destroy_application(application);
+    }
+
+    std::printf("%-24s%10.1f\n", "mean", roms.empty() ? 0 : total_ratio / roms.size());
+}
+
+// Instructions/second of one run with the same scripted keys as measure, with the recorder's stats when recording
+static double
+measure_video(const std::string &rom, const char *core, uint64_t cycles, const char *video, Recorder_stats &video_stats, double *thread_ips)
+{
+    void *application = create_application(rom, core, DEFAULT_IPS, video);
+    *thread_ips = 0;
+
+    if (!application)
+    {
+        return 0;
+    }
+
+    Chip8 *machine = reinterpret_cast<Chip8*>(application);
+    uint32_t keys = random_seed(1, 1);
+    Run_stats stats = {};
+
+    double start_time = time_ms();
+    double start_cpu = thread_cpu_ms();
+
+    while (stats.cycles < cycles)
+    {
+        script_keys(machine, keys);
+
+        if (!run_application(application, cycles, stats.frames + KEY_FRAMES, stats))
+        {
+            break;
+        }
+    }
+
+    double elapsed = (time_ms() - start_time) / 1000;
+    double cpu = (thread_cpu_ms() - start_cpu) / 1000;
+
+    if (video && !recorder_stats_application(application, video_stats))
+    {
+        elapsed = 0;
+    }
+
+    destroy_application(application);
+    *thread_ips = elapsed > 0 && cpu > 0 ? stats.cycles / cpu : 0;
+    return elapsed > 0 ? stats.cycles / elapsed : 0;
+}
+
+// Other load only ever slows a run down, so the fastest of the repeats is the one closest to the real cost
+static double
+best(const std::vector<double> &runs)
+{
+    return runs.empty() ? 0 : *std::max_element(runs.begin(), runs.end());
+}
+
+// Runs with and without the recorder alternate so drift in the machine's clock hits both alike. The time spent
+// joining the encoder and finishing the file at exit is left out, like the rest of destroy_application.
+// The thread overhead is the emulating thread's own CPU time, what recording costs with a core free for the
+// encoder. The wall overhead also has the encoder in it whenever the two share a core. Below the mean the worst
+// ROM of each core is shown, the overhead a ROM that draws on nearly every tick pays
+static void
+bench_video(const std::vector<std::string> &roms, uint64_t cycles, uint64_t repeat, uint64_t warmup)
+{
+    char dir[] = "/tmp/chip8-bench-XXXXXX";
+
+    if (!mkdtemp(dir))
+    {
+        std::fprintf(stderr, "Can't create a directory for the frame streams\n");
+        return;
+    }
+
+    std::string path = std::string(dir) + "/video.c8f";
+    const int core_count = sizeof(VIDEO_CORES) / sizeof(VIDEO_CORES[0]);
+
+    std::printf("%-24s", "video");
+
+    for (const char *core : VIDEO_CORES)
+    {
+        std::printf("%14s%10s%10s", core, "thread", "wall");
+    }
+
+    std::printf("%10s%10s%12s\n", "frames", "dropped", "bytes/frame");
+
+    std::vector<double> thread_overheads(core_count, 0);
+    std::vector<double> overheads(core_count, 0);
+    std::vector<double> worst(core_count, 0);
+    std::vector<std::string> worst_roms(core_count);
+
+    for (const std::string &rom : roms)
+    {
+        const char *name = std::strrchr(rom.c_str(), '/');
+        std::printf("%-24s", name ? name + 1 : rom.c_str());
+
+        Recorder_stats video_stats = {};
+
+        for (int core = 0; core < core_count; ++core)
+        {
+            std::vector<double> plain;
+            std::vector<double> recorded;
+            std::vector<double> plain_thread;
+            std::vector<double> recorded_thread;
+
+            for (uint64_t i = 0; i < warmup + repeat; ++i)
+            {
+                Recorder_stats stats;
+                double plain_thread_ips;
+                double recorded_thread_ips;
+                double plain_ips = measure_video(rom, VIDEO_CORES[core], cycles, NULL, stats, &plain_thread_ips);
+                double recorded_ips = measure_video(rom, VIDEO_CORES[core], cycles, path.c_str(), video_stats, &recorded_thread_ips);
+
+                if (i >= warmup)
+                {
+                    plain.push_back(plain_ips);
+                    recorded.push_back(recorded_ips);
+                    plain_thread.push_back(plain_thread_ips);
+                    recorded_thread.push_back(recorded_thread_ips);
+                }
+            }
+
+            double thread_overhead = best(plain_thread) > 0 ? (1 - best(recorded_thread) / best(plain_thread)) * 100 : 0;
+            double overhead = best(plain) > 0 ? (1 - best(recorded) / best(plain)) * 100 : 0;
+            thread_overheads[core] += thread_overhead;
+            overheads[core] += overhead;
+
+            if (worst_roms[core].empty() || thread_overhead > worst[core])
+            {
+                worst[core] = thread_overhead;
+                worst_roms[core] = name ? name + 1 : rom;
+            }
+
+            std::printf("%14.1f%9.1f%%%9.1f%%", best(plain) / 1000000, thread_overhead, overhead);
+            std::fflush(stdout);
+        }
+
+        std::printf("%10llu%10llu%12.1f\n", static_cast<unsigned long long>(video_stats.frames),
+            static_cast<unsigned long long>(video_stats.dropped),
+            video_stats.frames ? static_cast<double>(video_stats.bytes) / video_stats.frames : 0);
+    }
+
+    std::printf("%-24s", "mean");
+
+    for (int core = 0; core < core_count; ++core)
+    {
+        std::printf("%14s%9.1f%%%9.1f%%", "", roms.empty() ? 0 : thread_overheads[core] / roms.size(),
+            roms.empty() ? 0 : overheads[core] / roms.size());
+    }
+
+    std::printf("\n%-24s", "worst");
+
+    for (int core = 0; core < core_count; ++core)
+    {
+        std::printf("%14s%9.1f%%%10s", worst_roms[core].c_str(), worst[core], "");
+    }
+
+    std::printf("\n");
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint64_t cycles = DEFAULT_CYCLES;
+    uint64_t repeat = DEFAULT_REPEAT;
+    uint64_t warmup = DEFAULT_WARMUP;
+    const char *json_path = NULL;
+    bool synthetic = false;
+    bool upscale = false;
+    bool batch = false;
+    bool snapshot = false;
+    bool rewind = false;
+    bool video = false;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "cycles", &value))
+        {
+            cycles = parse_u64(value, DEFAULT_CYCLES);
+        }
+        else if (parse_option(argv[i], "repeat", &value))
+        {
+            repeat = std::max<uint64_t>(parse_u64(value, DEFAULT_REPEAT), 1);
+        }
+        else if (parse_option(argv[i], "warmup", &value))
+        {
+            warmup = parse_u64(value, DEFAULT_WARMUP);
+        }
+        else if (parse_option(argv[i], "json", &value))
+        {
+            json_path = value ? value : "-";
+        }
+        else if (parse_option(argv[i], "synthetic", &value))
+        {
+            synthetic = true;
+        }
+        else if (parse_option(argv[i], "upscale", &value))
+        {
+            upscale = true;
+        }
+        else if (parse_option(argv[i], "batch", &value))
+        {
+            batch = true;
+        }
+        else if (parse_option(argv[i], "snapshot", &value))
+        {
+            snapshot = true;
+        }
+        else if (parse_option(argv[i], "rewind", &value))
+        {
+            rewind = true;
+        }
+        else if (parse_option(argv[i], "video", &value))
+        {
+            video = true;
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            add_roms(argv[i], roms);
+        }
+    }
+
+    if (roms.empty())
+    {
+        add_roms("roms", roms);
+        synthetic = true;
+    }
+
+    if (batch)
+    {
+        bench_batch(roms, cycles, repeat);
+        return 0;
+    }
+
+    if (rewind)
+    {
+        bench_rewind(roms);
+        return 0;
+    }
+
+    if (snapshot)
+    {
+        bench_snapshot(roms, repeat);
+        return 0;
+    }
+
+    if (video)
+    {
+        bench_video(roms, cycles, repeat, warmup);
+        return 0;
+    }
+
+    if (upscale)
+    {
+        if (!roms.empty())
+        {
+            bench_upscale(roms[0], repeat);
+        }
+
+        return 0;
+    }
+
+    // The synthetic ROMs only join the throughput runs
+    char synthetic_dir[] = "/tmp/chip8-bench-XXXXXX";
+    std::vector<std::string> synthetic_roms;
+
+    if (synthetic && (!mkdtemp(synthetic_dir) || !write_synthetic_roms(synthetic_dir, synthetic_roms)))
+    {
+        std::fprintf(stderr, "Can't write the synthetic ROMs to %s\n", synthetic_dir);
+    }
+
+    roms.insert(roms.end(), synthetic_roms.begin(), synthetic_roms.end());
+    bench_cores(roms, cycles, repeat, warmup, json_path);
+
+    for (const std::string &rom : synthetic_roms)
+    {
+        unlink(rom.c_str());
+    }
+
+    if (synthetic)
+    {
+        rmdir(synthetic_dir);
+    }
+
+    return 0;
+}
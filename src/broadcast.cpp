@@ -0,0 +1,513 @@
+#include "broadcast.h"
+#include "handoff.h"
+#include "movie.h"
+#include "recorder.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <thread>
+
+#if !defined(_WIN32)
+#include "posix.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+struct Broadcast {
+};
+
+Broadcast *
+broadcast_create(const char *address)
+{
+    return NULL;
+}
+
+void
+broadcast_destroy(Broadcast *broadcast)
+{
+}
+
+bool
+broadcast_frame(Broadcast *broadcast, const Chip8 &c)
+{
+    return true;
+}
+
+void
+broadcast_stop(Broadcast *broadcast)
+{
+}
+
+Broadcast_stats
+broadcast_stats(Broadcast *broadcast)
+{
+    Broadcast_stats stats = {};
+    return stats;
+}
+
+#else
+
+const long BROADCAST_PERIOD_NS = 1000000000 / 60;
+const int BROADCAST_EVENTS = 64;
+
+// Tags of the epoll events that aren't subscribers, those carry their slot
+const uint64_t LISTENER_EVENT = BROADCAST_MAX_SUBSCRIBERS;
+const uint64_t TIMER_EVENT = BROADCAST_MAX_SUBSCRIBERS + 1;
+const uint64_t STOP_EVENT = BROADCAST_MAX_SUBSCRIBERS + 2;
+
+struct Subscriber {
+    int fd;
+    bool synced; // had a keyframe, deltas apply from then on
+    bool writable_watched; // waiting for EPOLLOUT with bytes still queued
+    size_t queued_size;
+    uint8_t queued[BROADCAST_BACKLOG];
+};
+
+struct Broadcast {
+    int listener;
+    int epoll;
+    int timer;
+    int stop; // eventfd
+    char path[sizeof(sockaddr_un::sun_path)]; // the unix socket to remove, empty for TCP
+    bool stopped;
+    std::thread thread;
+
+    // The emulating thread publishes a frame once the server asked for one, so drawing ticks in between cost a
+    // load. The flag is set again after every period, at most one frame a period crosses over
+    Triple_buffer<Captured_frame> frames;
+    std::atomic<bool> wanted;
+
+    // Only touched by the server thread until it is joined
+    Subscriber *subscribers[BROADCAST_MAX_SUBSCRIBERS];
+    uint32_t periods; // since the last keyframe
+    bool have_frame;
+    uint64_t tick;
+    uint8_t format;
+    uint8_t current[FRAME_BYTES]; // the newest frame
+    uint8_t sent[FRAME_BYTES]; // what synced subscribers have
+    uint8_t blank[FRAME_BYTES];
+    uint8_t message[BROADCAST_MESSAGE_HEADER + MAX_FRAME_DELTA];
+    Broadcast_stats stats;
+
+    Broadcast() : wanted(true) {}
+};
+
+static void
+disconnect(Broadcast *broadcast, uint64_t slot)
+{
+    Subscriber *subscriber = broadcast->subscribers[slot];
+    epoll_ctl(broadcast->epoll, EPOLL_CTL_DEL, subscriber->fd, NULL);
+    close(subscriber->fd);
+    free(subscriber);
+    broadcast->subscribers[slot] = NULL;
+}
+
+static void
+watch_writable(Broadcast *broadcast, uint64_t slot, bool watch)
+{
+    Subscriber *subscriber = broadcast->subscribers[slot];
+
+    if (subscriber->writable_watched != watch)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN | (watch ? EPOLLOUT : 0);
+        event.data.u64 = slot;
+        epoll_ctl(broadcast->epoll, EPOLL_CTL_MOD, subscriber->fd, &event);
+        subscriber->writable_watched = watch;
+    }
+}
+
+// Writes as much as the socket takes, what's left waits for EPOLLOUT. False when the subscriber went away
+static bool
+flush(Broadcast *broadcast, uint64_t slot)
+{
+    Subscriber *subscriber = broadcast->subscribers[slot];
+    size_t written = 0;
+
+    while (written < subscriber->queued_size)
+    {
+        ssize_t sent = send(subscriber->fd, subscriber->queued + written, subscriber->queued_size - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent > 0)
+        {
+            written += static_cast<size_t>(sent);
+        }
+        else if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            disconnect(broadcast, slot);
+            return false;
+        }
+    }
+
+    broadcast->stats.bytes += written;
+    subscriber->queued_size -= written;
+    std::memmove(subscriber->queued, subscriber->queued + written, subscriber->queued_size);
+    watch_writable(broadcast, slot, subscriber->queued_size > 0);
+    return true;
+}
+
+// A subscriber that can't take the message is too far behind, it is dropped instead of queueing more
+static void
+queue_message(Broadcast *broadcast, uint64_t slot, const uint8_t *message, size_t size)
+{
+    Subscriber *subscriber = broadcast->subscribers[slot];
+
+    if (subscriber->queued_size + size > BROADCAST_BACKLOG)
+    {
+        ++broadcast->stats.disconnected;
+        disconnect(broadcast, slot);
+        return;
+    }
+
+    std::memcpy(subscriber->queued + subscriber->queued_size, message, size);
+    subscriber->queued_size += size;
+    flush(broadcast, slot);
+}
+
+static void
+accept_subscribers(Broadcast *broadcast)
+{
+    for (;;)
+    {
+        int fd = accept4(broadcast->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            return;
+        }
+
+        uint64_t slot = 0;
+
+        while (slot < BROADCAST_MAX_SUBSCRIBERS && broadcast->subscribers[slot])
+        {
+            ++slot;
+        }
+
+        if (slot == BROADCAST_MAX_SUBSCRIBERS)
+        {
+            close(fd);
+            continue;
+        }
+
+        Subscriber *subscriber = reinterpret_cast<Subscriber*>(malloc(sizeof(Subscriber)));
+        subscriber->fd = fd;
+        subscriber->synced = false;
+        subscriber->writable_watched = false;
+        subscriber->queued_size = 0;
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+
+        if (epoll_ctl(broadcast->epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(subscriber);
+            continue;
+        }
+
+        broadcast->subscribers[slot] = subscriber;
+        ++broadcast->stats.subscribers;
+
+        uint8_t header[BROADCAST_HEADER_SIZE];
+        put_le(header, BROADCAST_MAGIC, 4);
+        put_le(header + 4, BROADCAST_VERSION, 4);
+        queue_message(broadcast, slot, header, sizeof(header));
+    }
+}
+
+// Once a period: the newest frame as a delta against the last one sent when it changed, and a keyframe every
+// BROADCAST_KEYFRAME_PERIODS or when the format changed
+static void
+send_frame(Broadcast *broadcast)
+{
+    const Captured_frame *frame = broadcast->frames.acquire();
+    bool keyframe = ++broadcast->periods >= BROADCAST_KEYFRAME_PERIODS;
+
+    if (frame)
+    {
+        keyframe |= !broadcast->have_frame || frame->format != broadcast->format;
+        frame_bits(frame->words, frame->format, broadcast->current);
+        broadcast->tick = frame->tick;
+        broadcast->format = frame->format;
+        broadcast->have_frame = true;
+    }
+
+    broadcast->wanted.store(true, std::memory_order_release);
+    uint32_t size = frame_size(broadcast->format);
+
+    if (!broadcast->have_frame || (!keyframe && std::memcmp(broadcast->current, broadcast->sent, size) == 0))
+    {
+        return;
+    }
+
+    uint8_t *message = broadcast->message;
+    size_t delta_size = delta_encode(broadcast->current, keyframe ? broadcast->blank : broadcast->sent, size,
+        message + BROADCAST_MESSAGE_HEADER);
+    size_t message_size = BROADCAST_MESSAGE_HEADER + delta_size;
+    put_le(message, message_size - 4, 4);
+    put_le(message + 4, broadcast->tick, 8);
+    message[12] = broadcast->format | (keyframe ? BROADCAST_KEYFRAME : 0);
+    put_le(message + 13, hash_bytes(broadcast->current, size), 8);
+
+    std::memcpy(broadcast->sent, broadcast->current, size);
+    ++broadcast->stats.frames;
+
+    if (keyframe)
+    {
+        broadcast->periods = 0;
+        ++broadcast->stats.keyframes;
+    }
+
+    for (uint64_t slot = 0; slot < BROADCAST_MAX_SUBSCRIBERS; ++slot)
+    {
+        Subscriber *subscriber = broadcast->subscribers[slot];
+
+        if (subscriber && (subscriber->synced || keyframe))
+        {
+            subscriber->synced = true;
+            queue_message(broadcast, slot, message, message_size);
+        }
+    }
+}
+
+// Subscribers only listen, anything they send is thrown away and end of file means they left
+static void
+read_subscriber(Broadcast *broadcast, uint64_t slot)
+{
+    uint8_t discard[256];
+
+    for (;;)
+    {
+        ssize_t received = recv(broadcast->subscribers[slot]->fd, discard, sizeof(discard), MSG_DONTWAIT);
+
+        if (received > 0 || (received < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            disconnect(broadcast, slot);
+        }
+
+        return;
+    }
+}
+
+static void
+serve(Broadcast *broadcast)
+{
+    epoll_event events[BROADCAST_EVENTS];
+
+    for (;;)
+    {
+        int count = epoll_wait(broadcast->epoll, events, BROADCAST_EVENTS, -1);
+        bool accepting = false;
+
+        // New connections wait until the end of the batch, so a slot freed above isn't reused by a stale event
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t tag = events[i].data.u64;
+
+            if (tag == STOP_EVENT)
+            {
+                return;
+            }
+            else if (tag == LISTENER_EVENT)
+            {
+                accepting = true;
+            }
+            else if (tag == TIMER_EVENT)
+            {
+                uint64_t expirations;
+
+                if (read(broadcast->timer, &expirations, sizeof(expirations)) == sizeof(expirations))
+                {
+                    send_frame(broadcast);
+                }
+            }
+            else if (broadcast->subscribers[tag])
+            {
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    disconnect(broadcast, tag);
+                    continue;
+                }
+
+                if (events[i].events & EPOLLIN)
+                {
+                    read_subscriber(broadcast, tag);
+                }
+
+                if (broadcast->subscribers[tag] && (events[i].events & EPOLLOUT))
+                {
+                    flush(broadcast, tag);
+                }
+            }
+        }
+
+        if (accepting)
+        {
+            accept_subscribers(broadcast);
+        }
+    }
+}
+
+static bool
+watch(int epoll, int fd, uint64_t tag)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+Broadcast *
+broadcast_create(const char *address)
+{
+    Broadcast *broadcast = new Broadcast();
+    std::memset(broadcast->subscribers, 0, sizeof(broadcast->subscribers));
+    broadcast->stopped = false;
+    broadcast->path[0] = 0;
+    broadcast->listener = open_socket(address, true);
+    broadcast->epoll = epoll_create1(EPOLL_CLOEXEC);
+    broadcast->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    broadcast->stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (std::strncmp(address, "unix:", 5) == 0 && broadcast->listener >= 0)
+    {
+        std::strncpy(broadcast->path, address + 5, sizeof(broadcast->path) - 1);
+        broadcast->path[sizeof(broadcast->path) - 1] = 0;
+    }
+
+    itimerspec period = {};
+    period.it_interval.tv_nsec = BROADCAST_PERIOD_NS;
+    period.it_value.tv_nsec = BROADCAST_PERIOD_NS;
+
+    if (broadcast->listener < 0 || broadcast->epoll < 0 || broadcast->timer < 0 || broadcast->stop < 0 ||
+        fcntl(broadcast->listener, F_SETFL, fcntl(broadcast->listener, F_GETFL) | O_NONBLOCK) != 0 ||
+        !watch(broadcast->epoll, broadcast->listener, LISTENER_EVENT) || !watch(broadcast->epoll, broadcast->timer, TIMER_EVENT) ||
+        !watch(broadcast->epoll, broadcast->stop, STOP_EVENT) || timerfd_settime(broadcast->timer, 0, &period, NULL) != 0)
+    {
+        broadcast->stopped = true;
+        broadcast_destroy(broadcast);
+        return NULL;
+    }
+
+    broadcast->periods = 0;
+    broadcast->have_frame = false;
+    broadcast->tick = 0;
+    broadcast->format = 0;
+    std::memset(broadcast->current, 0, sizeof(broadcast->current));
+    std::memset(broadcast->sent, 0, sizeof(broadcast->sent));
+    std::memset(broadcast->blank, 0, sizeof(broadcast->blank));
+    broadcast->stats = Broadcast_stats();
+    broadcast->thread = std::thread(serve, broadcast);
+    return broadcast;
+}
+
+void
+broadcast_stop(Broadcast *broadcast)
+{
+    if (broadcast->stopped)
+    {
+        return;
+    }
+
+    broadcast->stopped = true;
+    uint64_t one = 1;
+
+    if (write(broadcast->stop, &one, sizeof(one)) != sizeof(one))
+    {
+        std::abort();
+    }
+
+    broadcast->thread.join();
+}
+
+void
+broadcast_destroy(Broadcast *broadcast)
+{
+    broadcast_stop(broadcast);
+
+    for (uint64_t slot = 0; slot < BROADCAST_MAX_SUBSCRIBERS; ++slot)
+    {
+        if (broadcast->subscribers[slot])
+        {
+            disconnect(broadcast, slot);
+        }
+    }
+
+    int fds[] = { broadcast->listener, broadcast->epoll, broadcast->timer, broadcast->stop };
+
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    if (broadcast->path[0])
+    {
+        unlink(broadcast->path);
+    }
+
+    delete broadcast;
+}
+
+// A frame the server hasn't asked for is left to the next tick, which then sends whatever is on screen
+bool
+broadcast_frame(Broadcast *broadcast, const Chip8 &c)
+{
+    if (!broadcast->wanted.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    broadcast->wanted.store(false, std::memory_order_relaxed);
+
+    frame_capture(c, broadcast->frames.write_slot());
+    broadcast->frames.publish();
+    return true;
+}
+
+Broadcast_stats
+broadcast_stats(Broadcast *broadcast)
+{
+    Broadcast_stats stats = {};
+
+    if (broadcast->stopped)
+    {
+        stats = broadcast->stats;
+    }
+
+    return stats;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include "chip8.h"
+#include "win32.h"
+
+// Spectator broadcast. After a tick that drew, cleared or scrolled, the emulating thread hands the display to a
+// server thread through a lock-free triple buffer, once per period the server asked for one, so it never touches a
+// socket. The server wakes at 60Hz, and when the newest frame changed it encodes one XOR delta against the last
+// frame it sent and appends it to every subscriber. It is the only writer of the sockets, all of them non-blocking under one epoll. A subscriber more
+// than BROADCAST_BACKLOG bytes behind is disconnected rather than buffered without bound.
+// Every BROADCAST_KEYFRAME_PERIODS it sends a keyframe, the whole frame against a blank one. New subscribers get
+// nothing before the first keyframe.
+// The stream starts with an 8 byte header (magic, version), then each message is a 32 bit length followed by
+// the 64 bit tick, the format byte with BROADCAST_KEYFRAME set on keyframes, the 64 bit FNV-1a hash of the
+// frame's bits and the delta, all little-endian. The frame bits and the delta are those of recorder.h
+// POSIX only, unix domain or loopback TCP
+struct Broadcast;
+
+const uint32_t BROADCAST_MAGIC = 0x43423843; // "C8BC" in a little-endian stream
+const uint32_t BROADCAST_VERSION = 1;
+const int BROADCAST_HEADER_SIZE = 8;
+const int BROADCAST_MESSAGE_HEADER = 4 + 8 + 1 + 8; // length, tick, format, hash
+const uint8_t BROADCAST_KEYFRAME = 0x80; // in the format byte, the delta is against a blank frame
+const uint32_t BROADCAST_KEYFRAME_PERIODS = 60; // one keyframe a second
+const size_t BROADCAST_BACKLOG = 64 * 1024; // bytes queued for one subscriber before it is dropped
+const int BROADCAST_MAX_SUBSCRIBERS = 256;
+
+// "unix:PATH" for a unix domain socket, otherwise a port on 127.0.0.1, "tcp:PORT" or just "PORT".
+// NULL when it can't listen there
+Broadcast *broadcast_create(const char *address);
+void broadcast_destroy(Broadcast *broadcast); // disconnects everyone and removes a unix socket
+bool broadcast_frame(Broadcast *broadcast, const Chip8 &c); // after a tick that changed video, false to try again
+void broadcast_stop(Broadcast *broadcast); // joins the server, the stats are final afterwards
+Broadcast_stats broadcast_stats(Broadcast *broadcast);
@@ -0,0 +1,281 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+struct Jit;
+struct Rewind;
+struct Movie;
+struct Profile;
+struct Aot;
+struct Audio;
+struct Recorder;
+struct Broadcast;
+
+enum CORES {
+    CORE_INTERPRETER,
+    CORE_THREADED,
+    CORE_JIT,
+    CORE_AOT
+};
+
+// Instruction sets, SUPER-CHIP and XO-CHIP decode the opcodes CHIP-8 leaves unassigned and run on the extended display
+enum MODES {
+    MODE_CHIP8,
+    MODE_SCHIP,
+    MODE_XOCHIP,
+    MODE_COUNT
+};
+
+// Behaviours ROMs disagree on, picked per ROM at startup. Legacy is what this emulator always did and stays the
+// default for ROMs the database doesn't know, so movies and hashes from before profiles still replay
+enum QUIRK_PROFILES {
+    QUIRKS_LEGACY, // shifts VX, FX55/FX65 leave I, BNNN, sprites spill past the right edge into the next row
+    QUIRKS_VIP, // COSMAC VIP: shifts VY, FX55/FX65 leave I past the last register, BNNN, clipped sprites, 8XY1-3 clear VF
+    QUIRKS_SCHIP, // SUPER-CHIP 1.1: shifts VX, FX55/FX65 leave I, BXNN, clipped sprites
+    QUIRKS_MODERN, // Octo and most test ROMs: shifts VY, FX55/FX65 leave I past the last register, BNNN, wrapped sprites
+    QUIRK_PROFILE_COUNT
+};
+
+// Where DXYN pixels past the right and bottom edges go
+enum SPRITE_EDGES {
+    SPRITES_SPILL, // right into the start of the next row, bottom dropped
+    SPRITES_CLIP, // dropped
+    SPRITES_WRAP // to the opposite edge
+};
+
+// A profile as a type, the cores are instantiated once per profile so every quirk check folds away at compile time
+template <bool SHIFT_VY, bool INCREMENT_I, bool JUMP_VX, uint8_t SPRITES, bool RESET_VF>
+struct Quirks {
+    static const bool shift_vy = SHIFT_VY; // 8XY6/8XYE shift VY into VX rather than VX in place
+    static const bool increment_i = INCREMENT_I; // FX55/FX65 add X + 1 to I
+    static const bool jump_vx = JUMP_VX; // BXNN jumps to VX + XNN rather than V0 + NNN
+    static const uint8_t sprites = SPRITES; // SPRITE_EDGES, the extended modes always clip
+    static const bool reset_vf = RESET_VF; // 8XY1/8XY2/8XY3 clear VF
+};
+
+typedef Quirks<false, false, false, SPRITES_SPILL, false> Legacy_quirks;
+typedef Quirks<true, true, false, SPRITES_CLIP, true> Vip_quirks;
+typedef Quirks<false, false, true, SPRITES_CLIP, false> Schip_quirks;
+typedef Quirks<true, true, false, SPRITES_WRAP, false> Modern_quirks;
+
+const uint16_t MEMORY_START_ADDRESS = 0x200;
+const int SCREEN_WIDTH = 64;
+const int SCREEN_HEIGHT = 32;
+const int TILE_WIDTH = 8; // columns per bit of Chip8::dirty
+const int HIRES_WIDTH = 128; // 00FF, each window tile and dirty row then covers 16x2 pixels
+const int HIRES_HEIGHT = 64;
+const int PLANE_COUNT = 2; // XO-CHIP bitplanes, CHIP-8 and SUPER-CHIP only draw in the first
+const int PLANE_WORDS = HIRES_HEIGHT * HIRES_WIDTH / 64; // low-res row r is word r, high-res row r words 2r and 2r + 1
+// Emulated time is counted in instructions, the delay/sound timers tick at TIMER_HZ of it
+const uint32_t DEFAULT_IPS = 480; // instructions per emulated second, 8 per timer tick
+const uint32_t MIN_IPS = 1;
+const uint32_t MAX_IPS = 100000000;
+const uint32_t TIMER_HZ = 60;
+
+const int FONT_SIZE = 80;
+extern const uint8_t font[FONT_SIZE]; // loaded at address zero
+const int BIG_FONT_SIZE = 160;
+const uint16_t BIG_FONT_ADDRESS = FONT_SIZE; // 10 byte digits for FX30, only loaded in the extended modes
+extern const uint8_t big_font[BIG_FONT_SIZE];
+
+const int MEMORY_SIZE = 4096; // code always runs from here, pc and every per-address cache wrap at this size
+const uint16_t MEMORY_MASK = MEMORY_SIZE - 1;
+const int XO_MEMORY_SIZE = 65536; // all 16 bits of the index register in XO-CHIP mode
+const uint8_t DEFAULT_PITCH = 64; // FX3A value the audio pattern plays at 4000 samples per second with
+
+const int MAX_QUEUED_KEYS = 64; // keypad changes waiting for their cycle, a full queue applies the oldest at once
+
+// A keypad change from queue_input, applied by the host's run of instructions that reaches its cycle
+struct Key_change {
+    uint64_t cycle;
+    uint8_t key;
+    bool down;
+};
+
+// Operands are extracted once when an address is first executed, op selects the case in Chip8::interpret
+struct Instruction {
+    uint8_t op;
+    uint8_t x;
+    uint8_t y;
+    uint8_t nn; // N is the low nibble
+    uint16_t nnn;
+};
+
+struct Chip8 {
+    uint8_t registers[16];
+    uint16_t index;
+    uint16_t stack[16];
+    uint8_t *memory; // base_memory, or in XO-CHIP mode 64KB of its own from init_application
+    uint16_t memory_mask; // data accesses wrap at 4KB, or 64KB in XO-CHIP mode
+    uint64_t video[PLANE_COUNT * PLANE_WORDS]; // packed rows per plane, column 0 in the top bit
+    uint8_t dirty[SCREEN_HEIGHT]; // window tiles changed since the last render, tile 0 in the top bit
+    uint32_t video_writes; // bumped by everything that may change video, so the recorder skips ticks without any
+    uint8_t mode; // MODES, fixed at startup
+    uint8_t quirks; // QUIRK_PROFILES, fixed at startup like the mode
+    bool hires; // 128x64 after 00FF
+    uint8_t planes; // bitmask of the planes DXYN, 00E0 and the scrolls act on
+    uint8_t flags[16]; // FX75/FX85 user flags
+    uint8_t pattern[16]; // F002 audio pattern buffer, 128 one-bit samples
+    uint8_t pitch; // FX3A, the pattern plays at 4000 * 2^((pitch - 64) / 48) Hz
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t delay_timer;
+    uint16_t sound_timer;
+    bool keypad[16];
+
+    uint8_t prev_key_press;
+    uint8_t latest_key_press;
+
+    bool running;
+    uint32_t rng; // xorshift state for CXNN, per instance so a run is reproducible from its seed
+
+    uint64_t cycles; // instructions executed since load
+    uint64_t ticks; // timer ticks since load
+    uint64_t captured_ticks; // ticks at the last capture_display
+    uint32_t recorded_writes; // video_writes when the recorder last took a frame
+    uint32_t broadcast_writes; // and when the spectator broadcast last did
+    uint32_t ips; // emulated instructions per second
+    double speed; // emulated seconds per host second in update_application
+    double cycle_budget; // fraction of an instruction carried over between host frames
+
+    Instruction decoded[MEMORY_SIZE]; // one entry per address so odd aligned code is cached as well
+    uint8_t base_memory[MEMORY_SIZE]; // memory in the modes without XO-CHIP's 64KB
+    uint8_t core; // CORES
+    uint8_t filter; // FILTERS
+    uint16_t scale; // window pixels per display pixel
+    Jit *jit; // only created for CORE_JIT
+    Aot *aot; // only created for CORE_AOT
+    Rewind *rewind; // frame history, only created with --rewind
+    bool rewinding; // the rewind key is held
+    Movie *movie; // input being recorded or played back, only with --record or --play
+    Profile *profile; // guest profile, only with --profile in a CHIP8_PROFILE build
+    Audio *audio; // sound timer output, only with --audio
+    Recorder *recorder; // frame stream, only with --video
+    Broadcast *broadcast; // spectators, only with --serve
+    bool skip_idle; // jump over idle loops in run, on unless --skip-idle=off
+    Key_change queued_keys[MAX_QUEUED_KEYS]; // in cycle order
+    uint32_t queued_key_count;
+
+    void load(const uint8_t *rom, uint64_t rom_size, uint32_t seed);
+    uint32_t run(uint64_t count);
+    uint32_t execute(uint32_t count);
+    uint32_t interpret(uint32_t count); // through the instantiation for quirks
+    uint32_t interpret_threaded(uint32_t count);
+    template <typename QUIRKS> uint32_t interpret_quirks(uint32_t count);
+    template <typename QUIRKS> uint32_t interpret_threaded_quirks(uint32_t count);
+    uint64_t idle(uint64_t count, uint32_t &ticked);
+    uint64_t repeat(uint64_t batch);
+    Instruction fetch(uint16_t address);
+    void tick_timers();
+    uint64_t tick_until(uint64_t cycle); // every tick due by instruction number cycle at once, returns how many
+    bool frame_waiting() const;
+    void offer_frame(); // the display to the recorder and spectators, if it was written since they took it
+    void write_memory(uint16_t address, uint8_t value);
+    bool any_key() const;
+    uint32_t rand();
+    uint16_t skip_length(uint16_t address) const;
+
+    // The extended display, in emulator.cpp so the interpreter loops stay small
+    uint8_t draw(uint8_t x, uint8_t y, uint8_t rows);
+    void clear_planes();
+    void scroll_down(int rows);
+    void scroll_up(int rows);
+    void scroll_right();
+    void scroll_left();
+    void set_hires(bool on);
+
+    template <typename QUIRKS, uint8_t OPERATION, uint8_t X, uint8_t Y, uint8_t NN, uint16_t NNN>
+    uint16_t aot_step(uint16_t address); // in aot.h
+};
+
+enum OPS {
+    OP_UNDECODED, // must be zero so a cleared cache decodes on first use
+    OP_CLS, OP_RET, OP_SYS, OP_JMP, OP_CALL,
+    OP_SE_VX_NN, OP_SNE_VX_NN, OP_SE_VX_VY, OP_LD_VX_NN, OP_ADD_VX_NN,
+    OP_LD_VX_VY, OP_OR, OP_AND, OP_XOR, OP_ADD_VX_VY, OP_SUB, OP_SHR, OP_SUBN, OP_SHL,
+    OP_SNE_VX_VY, OP_LD_I, OP_JMP_V0, OP_RND, OP_DRW, OP_SKP, OP_SKNP,
+    OP_LD_VX_DT, OP_LD_VX_K, OP_LD_DT, OP_LD_ST, OP_ADD_I, OP_LD_F, OP_LD_B, OP_LD_I_VX, OP_LD_VX_I,
+    OP_NOP, // unassigned sub-opcodes of the 0x8, 0xE and 0xF groups do nothing
+    // SUPER-CHIP and XO-CHIP, never decoded in CHIP-8 mode, bodies in ops_extended.inl
+    OP_SCD, OP_SCU, OP_SCR, OP_SCL, OP_EXIT, OP_LOW, OP_HIGH, OP_DRW_EXT, OP_CLS_EXT,
+    OP_LD_HF, OP_SAVE_FLAGS, OP_LOAD_FLAGS, OP_SAVE_RANGE, OP_LOAD_RANGE, OP_LD_I_LONG, OP_PLANE, OP_AUDIO, OP_PITCH,
+    OP_COUNT
+};
+
+Instruction decode(uint16_t opcode, uint8_t mode = MODE_CHIP8);
+void jit_invalidate(Jit *jit, uint16_t address);
+void aot_invalidate(Aot *aot, const uint8_t *memory, uint16_t address);
+
+// xorshift32, every core and the batch engine draw CXNN values from this so a seed means the same run everywhere
+inline uint32_t
+next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Starting state for one of many instances sharing a seed, never zero since xorshift can't leave it
+inline uint32_t
+random_seed(uint32_t seed, uint32_t stream)
+{
+    return (seed ^ (stream + 1) * 0x9E3779B9u) | 1;
+}
+
+// Instruction count at which timer tick number tick (from 1) is due, spread as evenly as whole instructions allow
+inline uint64_t
+tick_cycle(uint64_t tick, uint32_t ips)
+{
+    return (tick * ips + TIMER_HZ - 1) / TIMER_HZ;
+}
+
+inline uint32_t
+Chip8::rand()
+{
+    return next_random(rng);
+}
+
+// Checked eight keys at a time since FX0A spins on this for as long as the ROM waits
+inline bool
+Chip8::any_key() const
+{
+    uint64_t low, high;
+    std::memcpy(&low, keypad, sizeof(low));
+    std::memcpy(&high, keypad + 8, sizeof(high));
+    return (low | high) != 0;
+}
+
+// XO-CHIP skips step over all four bytes of F000 NNNN
+inline uint16_t
+Chip8::skip_length(uint16_t address) const
+{
+    return mode == MODE_XOCHIP && memory[address & MEMORY_MASK] == 0xF0 && memory[(address + 1) & MEMORY_MASK] == 0x00 ? 4 : 2;
+}
+
+// Every store into memory goes through here so the two decoded entries covering the byte are re-decoded,
+// XO-CHIP data above the first 4KB is never executed
+inline void
+Chip8::write_memory(uint16_t address, uint8_t value)
+{
+    address &= memory_mask;
+    memory[address] = value;
+
+    if (address >= MEMORY_SIZE)
+    {
+        return;
+    }
+
+    decoded[address].op = OP_UNDECODED;
+    decoded[(address - 1) & MEMORY_MASK].op = OP_UNDECODED;
+
+    if (jit)
+    {
+        jit_invalidate(jit, address);
+    }
+
+    if (aot)
+    {
+        aot_invalidate(aot, memory, address);
+    }
+}
@@ -0,0 +1,171 @@
+#include "codec.h"
+
+#include <cstring>
+
+void
+put_le(uint8_t *out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+uint64_t
+get_le(const uint8_t *in, int bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(in[i]) << (i * 8);
+    }
+
+    return value;
+}
+
+size_t
+put_count(uint8_t *out, uint64_t value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80)
+    {
+        out[length++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+
+    out[length++] = static_cast<uint8_t>(value);
+    return length;
+}
+
+bool
+read_count(FILE *file, uint64_t *value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = std::fgetc(file);
+
+        if (byte == EOF)
+        {
+            return false;
+        }
+
+        *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t
+delta_encode(const uint8_t *after, const uint8_t *before, size_t size, uint8_t *out)
+{
+    size_t length = 0;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t start = i;
+
+        // Most of a snapshot or frame is unchanged, skip it a word at a time
+        for (;;)
+        {
+            uint64_t a, b;
+
+            if (i + sizeof(a) > size)
+            {
+                break;
+            }
+
+            std::memcpy(&a, after + i, sizeof(a));
+            std::memcpy(&b, before + i, sizeof(b));
+
+            if (a != b)
+            {
+                break;
+            }
+
+            i += sizeof(a);
+        }
+
+        while (i < size && after[i] == before[i])
+        {
+            ++i;
+        }
+
+        if (i == size)
+        {
+            break;
+        }
+
+        size_t changed = i;
+
+        while (i < size && after[i] != before[i])
+        {
+            ++i;
+        }
+
+        length += put_count(out + length, changed - start);
+        length += put_count(out + length, i - changed);
+
+        for (size_t j = changed; j < i; ++j)
+        {
+            out[length++] = after[j] ^ before[j];
+        }
+    }
+
+    return length;
+}
+
+// Bounds checked, deltas also come from files and sockets
+bool
+delta_apply(const uint8_t *delta, size_t length, uint8_t *bits, size_t size)
+{
+    size_t position = 0;
+    size_t offset = 0;
+
+    while (position < length)
+    {
+        uint64_t counts[2] = {};
+
+        for (int k = 0; k < 2; ++k)
+        {
+            for (int shift = 0;; shift += 7)
+            {
+                if (position == length || shift > 28)
+                {
+                    return false;
+                }
+
+                uint8_t byte = delta[position++];
+                counts[k] |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+                if (!(byte & 0x80))
+                {
+                    break;
+                }
+            }
+        }
+
+        offset += counts[0];
+
+        if (offset + counts[1] > size || position + counts[1] > length)
+        {
+            return false;
+        }
+
+        for (uint64_t i = 0; i < counts[1]; ++i)
+        {
+            bits[offset++] ^= delta[position++];
+        }
+    }
+
+    return true;
+}
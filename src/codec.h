@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Byte formats shared by every file and stream: little-endian integers, LEB128 counts and the delta codec of
+// rewind, the frame stream and the spectator broadcast.
+// A delta is runs of (LEB128 unchanged bytes, LEB128 changed bytes, the changed bytes XORed) against a buffer of
+// the same size, trailing unchanged bytes are left implicit
+
+// Every other byte changed, one byte per run and count
+constexpr size_t
+max_delta(size_t size)
+{
+    return size * 3 / 2 + 8;
+}
+
+void put_le(uint8_t *out, uint64_t value, int bytes); // little-endian regardless of the host
+uint64_t get_le(const uint8_t *in, int bytes);
+size_t put_count(uint8_t *out, uint64_t value); // LEB128, returns the bytes written, at most 10
+bool read_count(FILE *file, uint64_t *value); // false at the end of the file or on a count past 64 bits
+size_t delta_encode(const uint8_t *after, const uint8_t *before, size_t size, uint8_t *out); // at most max_delta(size)
+bool delta_apply(const uint8_t *delta, size_t length, uint8_t *bits, size_t size); // false on a corrupt delta
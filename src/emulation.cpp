@@ -0,0 +1,481 @@
+#include "emulation.h"
+#include "handoff.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+const uint32_t INPUT_QUEUE_SIZE = 256; // key events, far more than anyone types between two emulator updates
+const double FRAME_TIME = 1000.0 / 60; // ms between the emulation thread's deadline wakeups, one timer tick
+const double INPUT_LATENCY_BUCKET = 0.25; // ms, input to photon latencies are kept as a histogram
+const int INPUT_LATENCY_BUCKETS = 2000; // the last one holds everything from 500ms
+
+struct Key_event {
+    uint8_t code; // Input_events::CODES
+    uint8_t state; // Input_events::STATE
+    double time; // ms on the steady clock when the host sent it
+};
+
+struct Display_frame {
+    Display display;
+    double capture_time; // ms on the steady clock
+    uint64_t presses; // key presses the emulator had been given when it was captured
+};
+
+struct Emulation {
+    void *app;
+    Pacer *pacer; // the emulation thread's
+    Pacer *host;
+    std::thread thread;
+    std::atomic<bool> stop;
+    std::atomic<bool> running;
+    Triple_buffer<Display_frame> frames;
+    Spsc_queue<Key_event, INPUT_QUEUE_SIZE> input;
+
+    // Only touched by the emulation thread until it is joined
+    uint64_t published;
+    uint64_t dropped;
+    uint64_t wakeups;
+    uint64_t deadlines; // wakeups on a deadline, the ones jitter is measured on
+    double total_jitter;
+    double max_jitter;
+    uint64_t presses_queued;
+
+    // Only touched by the host
+    Display shown; // what the host's pixels currently show
+    bool invalidated;
+    bool pending; // a rendered frame waits for emulation_presented
+    double pending_time; // its capture time
+    uint64_t presented;
+    uint64_t lost_inputs;
+    double total_latency;
+    double max_latency;
+    double press_times[INPUT_QUEUE_SIZE]; // when each of the last presses was sent, by press number
+    uint64_t presses_sent;
+    uint64_t presses_shown; // presses up to here are measured, or were lost without a frame to show them
+    uint64_t pending_presses; // given to the emulator before the rendered frame waiting for emulation_presented
+    uint32_t input_latency[INPUT_LATENCY_BUCKETS];
+    double max_input_latency;
+    double start_time;
+    double start_cpu;
+
+    Emulation() : stop(false), running(true) {}
+};
+
+static double
+steady_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bit t set when any pixel of tile t on display row `row` differs in either plane, tile 0 in the top bit like
+// Chip8::dirty. A tile is 8 columns of one row, or 16 columns of two rows in high resolution
+static uint8_t
+changed_tiles(const Display &before, const Display &after, int row)
+{
+    if (before.hires != after.hires)
+    {
+        return 0xFF;
+    }
+
+    uint8_t tiles = 0;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        const uint64_t *a = before.words + plane * DISPLAY_PLANE_WORDS;
+        const uint64_t *b = after.words + plane * DISPLAY_PLANE_WORDS;
+
+        if (!after.hires)
+        {
+            uint64_t changed = a[row] ^ b[row];
+
+            for (int t = 0; t < 8; ++t)
+            {
+                tiles |= ((changed >> (56 - t * 8)) & 0xFF) ? 0x80 >> t : 0;
+            }
+
+            continue;
+        }
+
+        uint64_t left = (a[4 * row] ^ b[4 * row]) | (a[4 * row + 2] ^ b[4 * row + 2]);
+        uint64_t right = (a[4 * row + 1] ^ b[4 * row + 1]) | (a[4 * row + 3] ^ b[4 * row + 3]);
+
+        for (int t = 0; t < 4; ++t)
+        {
+            tiles |= ((left >> (48 - t * 16)) & 0xFFFF) ? 0x80 >> t : 0;
+            tiles |= ((right >> (48 - t * 16)) & 0xFFFF) ? 0x08 >> t : 0;
+        }
+    }
+
+    return tiles;
+}
+
+static void
+emulate(Emulation *emulation)
+{
+    Input_events input_events = {};
+    double last_time = steady_ms();
+    double deadline = last_time + FRAME_TIME;
+
+    while (!emulation->stop.load(std::memory_order_relaxed))
+    {
+        // One event per call so a press and release queued together both reach the keypad, each at the point of
+        // the coming update that matches when it was sent
+        Key_event event;
+
+        while (emulation->input.pop(event))
+        {
+            input_events.event[event.code] = event.state;
+            queue_input(emulation->app, input_events, event.time - last_time);
+            emulation->presses_queued += (event.state & Input_events::STATE::DOWN) != 0;
+        }
+
+        double now = steady_ms();
+        bool running = update_application(emulation->app, now - last_time);
+        last_time = now;
+
+        Display_frame &frame = emulation->frames.write_slot();
+
+        if (capture_display(emulation->app, frame.display))
+        {
+            frame.capture_time = steady_ms();
+            frame.presses = emulation->presses_queued;
+            ++emulation->published;
+
+            if (emulation->frames.publish())
+            {
+                ++emulation->dropped;
+            }
+
+            pacer_wake(emulation->host);
+        }
+
+        if (!running)
+        {
+            break;
+        }
+
+        // Everything since the last wakeup runs as one batch, a key cuts the sleep short so it is seen at once
+        double timeout = deadline - steady_ms();
+
+        if (timeout > 0 && !pacer_wait(emulation->pacer, timeout))
+        {
+            double late = steady_ms() - deadline;
+            emulation->total_jitter += late;
+            emulation->max_jitter = std::max(emulation->max_jitter, late);
+            ++emulation->deadlines;
+        }
+
+        ++emulation->wakeups;
+        now = steady_ms();
+
+        if (now >= deadline)
+        {
+            // After a stall the next deadline restarts from now instead of firing back to back to catch up
+            deadline = std::max(deadline + FRAME_TIME, now + FRAME_TIME / 2);
+        }
+    }
+
+    emulation->running.store(false, std::memory_order_release);
+    pacer_wake(emulation->host);
+}
+
+// Upper edge of the bucket the fraction of measured presses falls into
+static double
+percentile(const Emulation *emulation, double fraction)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < INPUT_LATENCY_BUCKETS; ++i)
+    {
+        total += emulation->input_latency[i];
+    }
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * total));
+    uint64_t seen = 0;
+
+    for (int i = 0; i < INPUT_LATENCY_BUCKETS && total; ++i)
+    {
+        seen += emulation->input_latency[i];
+
+        if (seen >= rank)
+        {
+            return i == INPUT_LATENCY_BUCKETS - 1 ? emulation->max_input_latency : std::min((i + 1) * INPUT_LATENCY_BUCKET, emulation->max_input_latency);
+        }
+    }
+
+    return 0;
+}
+
+Emulation *
+emulation_start(void *app, Pacer *host)
+{
+    Pacer *pacer = pacer_create(false);
+
+    if (!pacer)
+    {
+        return NULL;
+    }
+
+    Emulation *emulation = new Emulation();
+    emulation->app = app;
+    emulation->pacer = pacer;
+    emulation->host = host;
+    emulation->published = 0;
+    emulation->dropped = 0;
+    emulation->wakeups = 0;
+    emulation->deadlines = 0;
+    emulation->total_jitter = 0;
+    emulation->max_jitter = 0;
+    emulation->presses_queued = 0;
+    std::memset(&emulation->shown, 0, sizeof(emulation->shown));
+    emulation->invalidated = true;
+    emulation->pending = false;
+    emulation->pending_time = 0;
+    emulation->presented = 0;
+    emulation->lost_inputs = 0;
+    emulation->total_latency = 0;
+    emulation->max_latency = 0;
+    emulation->presses_sent = 0;
+    emulation->presses_shown = 0;
+    emulation->pending_presses = 0;
+    std::memset(emulation->input_latency, 0, sizeof(emulation->input_latency));
+    emulation->max_input_latency = 0;
+    emulation->start_time = steady_ms();
+    emulation->start_cpu = process_cpu_ms();
+    emulation->thread = std::thread(emulate, emulation);
+    audio_pacer_application(app, pacer);
+
+    return emulation;
+}
+
+void
+emulation_stop(Emulation *emulation, Emulation_stats *stats)
+{
+    emulation->stop.store(true, std::memory_order_relaxed);
+    pacer_wake(emulation->pacer);
+    emulation->thread.join();
+    audio_pacer_application(emulation->app, NULL);
+
+    double elapsed = steady_ms() - emulation->start_time;
+
+    if (stats)
+    {
+        stats->published = emulation->published;
+        stats->dropped = emulation->dropped;
+        stats->presented = emulation->presented;
+        stats->lost_inputs = emulation->lost_inputs;
+        stats->mean_latency = emulation->presented ? emulation->total_latency / emulation->presented : 0;
+        stats->max_latency = emulation->max_latency;
+        stats->wakeups = emulation->wakeups;
+        stats->mean_jitter = emulation->deadlines ? emulation->total_jitter / emulation->deadlines : 0;
+        stats->max_jitter = emulation->max_jitter;
+        stats->cpu_usage = elapsed > 0 ? (process_cpu_ms() - emulation->start_cpu) * 100 / elapsed : 0;
+        stats->measured_presses = 0;
+        stats->input_p50 = percentile(emulation, 0.5);
+        stats->input_p90 = percentile(emulation, 0.9);
+        stats->input_p99 = percentile(emulation, 0.99);
+        stats->input_max = emulation->max_input_latency;
+
+        for (int i = 0; i < INPUT_LATENCY_BUCKETS; ++i)
+        {
+            stats->measured_presses += emulation->input_latency[i];
+        }
+    }
+
+    pacer_destroy(emulation->pacer);
+    delete emulation;
+}
+
+bool
+emulation_running(Emulation *emulation)
+{
+    return emulation->running.load(std::memory_order_acquire);
+}
+
+void
+emulation_send_input(Emulation *emulation, Input_events &input_events)
+{
+    bool sent = false;
+    double now = steady_ms();
+
+    for (int code = 0; code <= Input_events::CODES::ESC; ++code)
+    {
+        if (!input_events.event[code])
+        {
+            continue;
+        }
+
+        Key_event event = { static_cast<uint8_t>(code), input_events.event[code], now };
+        sent = true;
+
+        if (!emulation->input.push(event))
+        {
+            ++emulation->lost_inputs;
+        }
+        else if (event.state & Input_events::STATE::DOWN)
+        {
+            emulation->press_times[emulation->presses_sent++ % INPUT_QUEUE_SIZE] = now;
+        }
+    }
+
+    std::memset(input_events.event, 0, sizeof(input_events.event));
+
+    if (sent)
+    {
+        pacer_wake(emulation->pacer);
+    }
+}
+
+// Dirty tiles come from comparing against what the host already shows rather than from the emulator,
+// so frames dropped in between never leave stale tiles behind
+bool
+emulation_render(Emulation *emulation, uint32_t *pixels, int width, int height, Dirty_rects &dirty)
+{
+    const Display_frame *frame = emulation->frames.acquire();
+    uint8_t tiles[DISPLAY_ROWS];
+    uint8_t changed = 0;
+
+    dirty.count = 0;
+
+    if (!frame && !emulation->invalidated)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < DISPLAY_ROWS; ++i)
+    {
+        tiles[i] = frame ? changed_tiles(emulation->shown, frame->display, i) : 0;
+        changed |= tiles[i];
+    }
+
+    if (frame)
+    {
+        emulation->shown = frame->display;
+
+        // A frame that looks like the one on screen has nothing to present
+        if (changed)
+        {
+            emulation->pending = true;
+            emulation->pending_time = frame->capture_time;
+            emulation->pending_presses = frame->presses;
+        }
+    }
+
+    if (emulation->invalidated)
+    {
+        std::memset(tiles, 0xFF, sizeof(tiles));
+        emulation->invalidated = false;
+    }
+
+    return render_display(emulation->app, emulation->shown, tiles, pixels, width, height, dirty);
+}
+
+void
+emulation_presented(Emulation *emulation)
+{
+    if (!emulation->pending)
+    {
+        return;
+    }
+
+    double latency = steady_ms() - emulation->pending_time;
+    emulation->total_latency += latency;
+    emulation->max_latency = std::max(emulation->max_latency, latency);
+    ++emulation->presented;
+    emulation->pending = false;
+
+    // Input to photon: every press the emulator had before this frame was captured is on screen now, if it
+    // changed anything. Presses older than the ring were overwritten before a frame showed them
+    double now = steady_ms();
+    uint64_t first = std::max(emulation->presses_shown, emulation->presses_sent > INPUT_QUEUE_SIZE ? emulation->presses_sent - INPUT_QUEUE_SIZE : 0);
+
+    for (uint64_t press = first; press < emulation->pending_presses; ++press)
+    {
+        double input_latency = now - emulation->press_times[press % INPUT_QUEUE_SIZE];
+        int bucket = std::min(static_cast<int>(input_latency / INPUT_LATENCY_BUCKET), INPUT_LATENCY_BUCKETS - 1);
+        ++emulation->input_latency[bucket];
+        emulation->max_input_latency = std::max(emulation->max_input_latency, input_latency);
+    }
+
+    emulation->presses_shown = std::max(emulation->presses_shown, emulation->pending_presses);
+}
+
+void
+emulation_invalidate(Emulation *emulation)
+{
+    emulation->invalidated = true;
+}
+
+void
+print_emulation_stats(const Emulation_stats &stats)
+{
+    std::printf("frames published: %llu\n", static_cast<unsigned long long>(stats.published));
+    std::printf("frames dropped: %llu\n", static_cast<unsigned long long>(stats.dropped));
+    std::printf("frames presented: %llu\n", static_cast<unsigned long long>(stats.presented));
+    std::printf("inputs lost: %llu\n", static_cast<unsigned long long>(stats.lost_inputs));
+    std::printf("latency ms: %.2f mean, %.2f max\n", stats.mean_latency, stats.max_latency);
+    std::printf("emulation wakeups: %llu\n", static_cast<unsigned long long>(stats.wakeups));
+    std::printf("wakeup jitter ms: %.3f mean, %.3f max\n", stats.mean_jitter, stats.max_jitter);
+    std::printf("cpu: %.2f%% of a core\n", stats.cpu_usage);
+    std::printf("input to photon ms: %.2f p50, %.2f p90, %.2f p99, %.2f max over %llu presses\n", stats.input_p50,
+        stats.input_p90, stats.input_p99, stats.input_max, static_cast<unsigned long long>(stats.measured_presses));
+}
+
+static void
+print_audio_stats(const Audio_stats &stats)
+{
+    std::printf("audio samples: %llu\n", static_cast<unsigned long long>(stats.samples));
+    std::printf("audio underruns: %llu\n", static_cast<unsigned long long>(stats.underruns));
+    std::printf("audio overruns: %llu\n", static_cast<unsigned long long>(stats.overruns));
+    std::printf("audio latency ms: %.2f mean, %.2f max, %.0f target\n", stats.mean_latency, stats.max_latency, stats.target_latency);
+}
+
+static void
+print_recorder_stats(const Recorder_stats &stats)
+{
+    std::printf("video frames: %llu\n", static_cast<unsigned long long>(stats.frames));
+    std::printf("video frames dropped: %llu\n", static_cast<unsigned long long>(stats.dropped));
+    std::printf("video bytes: %llu, %.1f per frame\n", static_cast<unsigned long long>(stats.bytes),
+        stats.frames ? static_cast<double>(stats.bytes) / stats.frames : 0.0);
+}
+
+static void
+print_broadcast_stats(const Broadcast_stats &stats)
+{
+    std::printf("spectator frames: %llu, %llu keyframes\n", static_cast<unsigned long long>(stats.frames),
+        static_cast<unsigned long long>(stats.keyframes));
+    std::printf("spectators: %llu, %llu dropped for falling behind\n", static_cast<unsigned long long>(stats.subscribers),
+        static_cast<unsigned long long>(stats.disconnected));
+    std::printf("spectator bytes: %llu\n", static_cast<unsigned long long>(stats.bytes));
+}
+
+void
+print_application_stats(void *app)
+{
+    Audio_stats audio;
+
+    if (audio_stats_application(app, audio))
+    {
+        print_audio_stats(audio);
+    }
+
+    Recorder_stats video;
+
+    if (recorder_stats_application(app, video))
+    {
+        print_recorder_stats(video);
+    }
+
+    Broadcast_stats spectators;
+
+    if (broadcast_stats_application(app, spectators))
+    {
+        print_broadcast_stats(spectators);
+    }
+}
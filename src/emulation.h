@@ -0,0 +1,40 @@
+#pragma once
+#include "pacer.h"
+#include "win32.h"
+
+// Runs the emulator on its own thread for interactive hosts. Finished frames reach the host through a triple
+// buffer and key events reach the emulator through a bounded queue, both lock-free, so a slow present never
+// stalls emulation and emulation never stalls the window. The thread sleeps until the next 60Hz frame is due
+// or a key arrives and wakes the host's pacer for every frame it publishes, so neither side polls. Keys carry the
+// time they were sent and reach the ROM on the instruction that emulates that moment, not all at the start of
+// the next batch. All other calls belong to the host's thread
+struct Emulation;
+
+struct Emulation_stats {
+    uint64_t published; // frames handed over by the emulation thread
+    uint64_t dropped; // published frames replaced by a newer one before the host took them
+    uint64_t presented; // frames the host rendered and showed
+    uint64_t lost_inputs; // key events that found the queue full
+    double mean_latency; // ms from capture on the emulation thread to emulation_presented
+    double max_latency;
+    uint64_t wakeups; // times the emulation thread woke up, on a deadline or for input
+    double mean_jitter; // ms the deadline wakeups came late
+    double max_jitter;
+    double cpu_usage; // percent of one core used by the whole process while emulation ran
+    uint64_t measured_presses; // key presses followed by a presented frame that changed
+    double input_p50; // ms from a key press being sent to the first changed frame after it being presented
+    double input_p90;
+    double input_p99;
+    double input_max;
+};
+
+Emulation *emulation_start(void *app, Pacer *host); // host is woken for every published frame and on stop
+void emulation_stop(Emulation *emulation, Emulation_stats *stats); // joins the thread, stats may be NULL
+bool emulation_running(Emulation *emulation); // false once the ROM stopped, e.g. on escape
+void emulation_send_input(Emulation *emulation, Input_events &input_events); // queues every event and clears them
+// Draws the newest frame if there is one the host hasn't rendered yet, returns true when pixels changed
+bool emulation_render(Emulation *emulation, uint32_t *pixels, int width, int height, Dirty_rects &dirty);
+void emulation_presented(Emulation *emulation); // the last rendered frame is now on screen
+void emulation_invalidate(Emulation *emulation); // the next render redraws everything
+void print_emulation_stats(const Emulation_stats &stats);
+void print_application_stats(void *app); // audio, recorder and spectator stats of whichever are on, ending them
@@ -1,41 +1,29 @@
 #include "win32.h"
+#include "chip8.h"
+#include "jit.h"
+#include "aot.h"
+#include "upscale.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "movie.h"
+#include "profile.h"
+#include "audio.h"
+#include "recorder.h"
+#include "broadcast.h"
+#include "quirks.h"
 
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 #include <algorithm>
 
-const uint16_t MEMORY_START_ADDRESS = 0x200;
-const int SCREEN_WIDTH = 64;
-const int SCREEN_HEIGHT = 32;
-const int VIDEO_MEMORY_SIZE = SCREEN_WIDTH * SCREEN_HEIGHT;
-
-struct Chip8 {
-    uint8_t registers[16];
-    uint16_t index;
-    uint16_t stack[16];
-    uint8_t memory[4096];
-    uint32_t video[VIDEO_MEMORY_SIZE];
-    uint16_t pc;
-    uint16_t sp;
-    uint16_t delay_timer;
-    uint16_t sound_timer;
-    bool keypad[0xF];
-
-    uint8_t prev_key_press;
-    uint8_t latest_key_press;
-
-    bool video_updated;
-    bool running;
-
-    double clock_time;
-    double cpu_time;
-
-    void cycle();
-};
+static_assert(DISPLAY_ROWS == SCREEN_HEIGHT && DISPLAY_PLANES == PLANE_COUNT && DISPLAY_PLANE_WORDS == PLANE_WORDS,
+    "capture_display copies video as it is");
 
-const uint8_t font[80] =
+const uint8_t font[FONT_SIZE] =
 {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -55,535 +43,1818 @@ const uint8_t font[80] =
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-void 
-Chip8::cycle() 
+const uint8_t big_font[BIG_FONT_SIZE] =
 {
-    video_updated = false;
-
-    uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
-    uint16_t op_nible = (opcode & 0xF000) >> 12;
-
-    pc += 2;
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
 
-    uint8_t regX, regY;
-    uint16_t val;
+// What the extended modes make of an opcode, op is the CHIP-8 decoding
+static uint8_t
+extended_op(uint16_t opcode, uint8_t mode, uint8_t op)
+{
+    bool xo = mode == MODE_XOCHIP;
 
-    switch (op_nible) 
+    switch ((opcode & 0xF000) >> 12)
     {
         case 0x0:
-            switch (opcode) 
+            if ((opcode & 0xFFF0) == 0x00C0)
             {
-                case 0x00E0: // clear the screen
-                    std::memset(video, 0, sizeof(video));
-                    video_updated = true;
-                    break;
-                case 0x00EE: // return from routine
-                    pc = stack[--sp];
-                    break;
-                default: // call machine code routine, Not necessary for most ROMs
-                    pc = opcode & 0x0FFF;
+                return OP_SCD;
             }
-            break;
-        case 0x1: // jmp to address
-            pc = opcode & 0x0FFF;
-            break;
-        case 0x2: // call subroutine
-            stack[sp] = pc;
-            ++sp;
-            pc = opcode & 0x0FFF;
-            break;
-        case 0x3: // Vx == NN skip instruction
-            regX = (opcode & 0x0F00) >> 8;
-            val = opcode & 0x00FF;
 
-            if (registers[regX] == val)
+            if (xo && (opcode & 0xFFF0) == 0x00D0)
             {
-                pc += 2;
+                return OP_SCU;
             }
-            break;
-        case 0x4: // Vx != NN skip instruction
-            regX = (opcode & 0x0F00) >> 8;
-            val = opcode & 0x00FF;
 
-            if (registers[regX] != val)
+            switch (opcode)
             {
-                pc += 2;
+                case 0x00E0: return OP_CLS_EXT;
+                case 0x00FB: return OP_SCR;
+                case 0x00FC: return OP_SCL;
+                case 0x00FD: return OP_EXIT;
+                case 0x00FE: return OP_LOW;
+                case 0x00FF: return OP_HIGH;
             }
             break;
-        case 0x5: // Vx == Vy skip instruction
-            regX = (opcode & 0x0F00) >> 8;
-            regY = (opcode & 0x00F0) >> 4;
+        case 0x5:
+            if (xo && (opcode & 0x000F) == 0x2)
+            {
+                return OP_SAVE_RANGE;
+            }
 
-            if (registers[regX] == registers[regY])
+            if (xo && (opcode & 0x000F) == 0x3)
             {
-                pc += 2;
+                return OP_LOAD_RANGE;
             }
             break;
-        case 0x6: // Set Vx to NN
-            regX = (opcode & 0x0F00) >> 8;
-            val = opcode & 0x00FF;
-            registers[regX] = val;
-            break;
-        case 0x7: // Add NN to Vx
-            regX = (opcode & 0x0F00) >> 8;
-            val = opcode & 0x00FF;
-            registers[regX] += val;
-            break;
-        case 0x8: // Vx and Vy operations
-            val = opcode & 0x000F;
-            regX = (opcode & 0x0F00) >> 8;
-            regY = (opcode & 0x00F0) >> 4;
-
-            switch (val)
+        case 0xD:
+            return OP_DRW_EXT;
+        case 0xF:
+            if (xo && opcode == 0xF000)
             {
-                case 0x0: // Assign
-                    registers[regX] = registers[regY];
-                    break;
-                case 0x1: // Bit OR
-                    registers[regX] |= registers[regY];
-                    break;
-                case 0x2: // Bit AND
-                    registers[regX] &= registers[regY];
-                    break;
-                case 0x3: // Bit XOR
-                    registers[regX] ^= registers[regY];
-                    break;
-                case 0x4: // VX += VY - VF is set to 1 when there's an overflow, and to 0 when there is not
-                    val = registers[regX] + registers[regY];
-
-                    if (val >= 0xFF)
-                    {
-                        registers[0xF] = 1;
-                    }
-                    else
-                    {
-                        registers[0xF] = 0;
-                    }
-
-                    registers[regX] = val & 0xFF;
-                    break;
-                case 0x5: // VX -= Vy - VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not)
-                    if (registers[regX] >= registers[regY])
-                    {
-                        registers[0xF] = 1;
-                    }
-                    else
-                    {
-                        registers[0xF] = 0;
-                    }
-
-                    registers[regX] -= registers[regY];
-                    break;
-                case 0x6: // Store the least significant bit of VX in VF and then shifts VX to the right by 1
-                    registers[0xF] = registers[regX] & 0x1;
-                    registers[regX] >>= 1;
-                    break;
-                case 0x7: // VX = VY - VX - VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
-                    if (registers[regY] >= registers[regX])
-                    {
-                        registers[0xF] = 1;
-                    }
-                    else
-                    {
-                        registers[0xF] = 0;
-                    }
+                return OP_LD_I_LONG;
+            }
 
-                    registers[regX] = registers[regY] - registers[regX];
-                    break;
-                case 0xE: // Stores the most significant bit of VX in VF and then shifts VX to the left by 1
-                    registers[0xF] = (registers[regX] & 0x80) >> 7;
-                    registers[regX] <<= 1;
-                    break;
+            if (xo && opcode == 0xF002)
+            {
+                return OP_AUDIO;
             }
-            break;
-        case 0x9: // Vx != Vy skip instruction
-            regX = (opcode & 0x0F00) >> 8;
-            regY = (opcode & 0x00F0) >> 4;
 
-            if (registers[regX] != registers[regY])
+            switch (opcode & 0x00FF)
             {
-                pc += 2;
+                case 0x30: return OP_LD_HF;
+                case 0x75: return OP_SAVE_FLAGS;
+                case 0x85: return OP_LOAD_FLAGS;
+                case 0x01: return xo ? OP_PLANE : op;
+                case 0x3A: return xo ? OP_PITCH : op;
             }
             break;
-        case 0xA: // Set I to address NNN
-            index = opcode & 0x0FFF;
-            break;
-        case 0xB: // jmp to V0 + NNN
-            pc = registers[0] + (opcode & 0x0FFF);
-            break;
-        case 0xC: // Vx = rand() & NN
-            regX = (opcode & 0x0F00) >> 8;
-            val = opcode & 0x00FF;
-            registers[regX] = (rand() % 255) & val;
-            break;
-        case 0xD: // Draw
-        {
-            regX = (opcode & 0x0F00) >> 8;
-            regY = (opcode & 0x00F0) >> 4;
-            uint8_t height = opcode & 0x000F;
+    }
 
-            uint8_t pos_x = registers[regX] % SCREEN_WIDTH;
-            uint8_t pos_y = registers[regY] % SCREEN_HEIGHT;
+    return op;
+}
 
-            registers[0xF] = 0;
+Instruction
+decode(uint16_t opcode, uint8_t mode)
+{
+    Instruction instruction;
+    instruction.x = (opcode & 0x0F00) >> 8;
+    instruction.y = (opcode & 0x00F0) >> 4;
+    instruction.nn = opcode & 0x00FF;
+    instruction.nnn = opcode & 0x0FFF;
+    instruction.op = OP_NOP;
 
-            for (int i = 0; i < height; ++i)
+    switch ((opcode & 0xF000) >> 12) 
+    {
+        case 0x0:
+            switch (opcode) 
             {
-                uint8_t sprite = memory[index + i];
-
-                for (int j = 0; j < 8; ++j)
-                {
-                    if (sprite & (0x80 >> j))
-                    {
-                        uint16_t pixel = pos_x + j + SCREEN_WIDTH * (pos_y + i);
-
-                        if (video[pixel] == 0xFFFFFFFF)
-                        {
-                            registers[0xF] = 1;
-                        }
-
-                        video[pixel] ^= 0xFFFFFFFF;
-                    }
-                }
+                case 0x00E0: instruction.op = OP_CLS; break;
+                case 0x00EE: instruction.op = OP_RET; break;
+                default: instruction.op = OP_SYS;
             }
-
-            video_updated = true;
-        } break;
+            break;
+        case 0x1: instruction.op = OP_JMP; break;
+        case 0x2: instruction.op = OP_CALL; break;
+        case 0x3: instruction.op = OP_SE_VX_NN; break;
+        case 0x4: instruction.op = OP_SNE_VX_NN; break;
+        case 0x5: instruction.op = OP_SE_VX_VY; break;
+        case 0x6: instruction.op = OP_LD_VX_NN; break;
+        case 0x7: instruction.op = OP_ADD_VX_NN; break;
+        case 0x8:
+            switch (opcode & 0x000F)
+            {
+                case 0x0: instruction.op = OP_LD_VX_VY; break;
+                case 0x1: instruction.op = OP_OR; break;
+                case 0x2: instruction.op = OP_AND; break;
+                case 0x3: instruction.op = OP_XOR; break;
+                case 0x4: instruction.op = OP_ADD_VX_VY; break;
+                case 0x5: instruction.op = OP_SUB; break;
+                case 0x6: instruction.op = OP_SHR; break;
+                case 0x7: instruction.op = OP_SUBN; break;
+                case 0xE: instruction.op = OP_SHL; break;
+            }
+            break;
+        case 0x9: instruction.op = OP_SNE_VX_VY; break;
+        case 0xA: instruction.op = OP_LD_I; break;
+        case 0xB: instruction.op = OP_JMP_V0; break;
+        case 0xC: instruction.op = OP_RND; break;
+        case 0xD: instruction.op = OP_DRW; break;
         case 0xE:
-            val = opcode & 0x00FF;
-            regX = (opcode & 0x0F00) >> 8;
-
-            switch (val)
+            switch (opcode & 0x00FF)
             {
-                case 0x9E: // if (key() == Vx) skip instruction
-                    if (keypad[registers[regX]])
-                    {
-                        pc += 2;
-                    }
-                    break;
-                case 0xA1: // if (key() != Vx) skip instruction
-                    if (keypad[registers[regX]])
-                    {
-                        pc += 2;
-                    }
-                    break;
+                case 0x9E: instruction.op = OP_SKP; break;
+                case 0xA1: instruction.op = OP_SKNP; break;
             }
             break;
         case 0xF:
-            val = opcode & 0x00FF;
-            regX = (opcode & 0x0F00) >> 8;
-
-            switch(val)
+            switch (opcode & 0x00FF)
             {
-                case 0x07: // Set Vx to the value of the delay timer
-                    registers[regX] = delay_timer;
-                    break;
-                case 0x0A: // Key is pressed and stored in Vx, this is a blocking operation
-                    if (keypad[0x0])
-                    {
-                        registers[regX] = 0x0;
-                    }
-                    else if (keypad[0x1])
-                    {
-                        registers[regX] = 0x1;
-                    }
-                    else if (keypad[0x2])
-                    {
-                        registers[regX] = 0x2;
-                    }
-                    else if (keypad[0x3])
-                    {
-                        registers[regX] = 0x3;
-                    }
-                    else if (keypad[0x4])
-                    {
-                        registers[regX] = 0x4;
-                    }
-                    else if (keypad[0x5])
-                    {
-                        registers[regX] = 0x5;
-                    }
-                    else if (keypad[0x6])
-                    {
-                        registers[regX] = 0x6;
-                    }
-                    else if (keypad[0x7])
-                    {
-                        registers[regX] = 0x7;
-                    }
-                    else if (keypad[0x8])
-                    {
-                        registers[regX] = 0x8;
-                    }
-                    else if (keypad[0x9])
-                    {
-                        registers[regX] = 0x9;
-                    }
-                    else if (keypad[0xa])
-                    {
-                        registers[regX] = 0xa;
-                    }
-                    else if (keypad[0xb])
-                    {
-                        registers[regX] = 0xb;
-                    }
-                    else if (keypad[0xc])
-                    {
-                        registers[regX] = 0xc;
-                    }
-                    else if (keypad[0xd])
-                    {
-                        registers[regX] = 0xd;
-                    }
-                    else if (keypad[0xe])
-                    {
-                        registers[regX] = 0xe;
-                    }
-                    else if (keypad[0xf])
-                    {
-                        registers[regX] = 0xf;
-                    }
-                    else
-                    {
-                        pc -= 2;
-                    }
-                    break;
-                case 0x15: // Set delay timer to Vx
-                    delay_timer = registers[regX];
-                    break;
-                case 0x18: // Set sound timer to Vx
-                    sound_timer = registers[regX];
-                    break;
-                case 0x1E: // Add Vx to Index
-                    index += registers[regX];
-                    break;
-                case 0x29: // Set Index to the location of the sprite character in Vx
-                    index = 5 * registers[regX]; // font start address is zero therefore can ignore adding it
-                    break;
-                case 0x33: // Store binary-coded-decimal representation of Vx with the hundreds digit in memory at location in Index
-                    val = registers[regX];
-                    
-                    memory[index + 2] = val % 10;
-                    val /= 10;
-                    
-                    memory[index + 1] = val % 10;
-                    val /= 10;
-
-                    memory[index] = val % 10;
-                    break;
-                case 0x55: // Store V0 to Vx (inclusive) in memory starting at Index
-                    for (int i = 0; i <= regX; ++i)
-                    {
-                        memory[index + i] = registers[i];
-                    }
-                    break;
-                case 0x65: // Store values from 0 to X from memory in registers V0 - Vx
-                    for (int i = 0; i <= regX; ++i)
-                    {
-                        registers[i] = memory[index + i];
-                    }
-                    break;
+                case 0x07: instruction.op = OP_LD_VX_DT; break;
+                case 0x0A: instruction.op = OP_LD_VX_K; break;
+                case 0x15: instruction.op = OP_LD_DT; break;
+                case 0x18: instruction.op = OP_LD_ST; break;
+                case 0x1E: instruction.op = OP_ADD_I; break;
+                case 0x29: instruction.op = OP_LD_F; break;
+                case 0x33: instruction.op = OP_LD_B; break;
+                case 0x55: instruction.op = OP_LD_I_VX; break;
+                case 0x65: instruction.op = OP_LD_VX_I; break;
             }
             break;
-        default:
-            message_box("Error", "Unknown opcode");
-            running = false;
     }
 
-    if (clock_time >= 16)
+    if (mode != MODE_CHIP8)
     {
-        clock_time = 0;
+        instruction.op = extended_op(opcode, mode, instruction.op);
+    }
 
-        if (delay_timer > 0)
-        {
-            --delay_timer;
-        }
+    return instruction;
+}
 
-        if (sound_timer > 0)
-        {
-            --sound_timer;
-        }
+// Runs count instructions back to back on whichever core was selected at startup, timers are left to the caller
+uint32_t
+Chip8::execute(uint32_t count)
+{
+    switch (core)
+    {
+        case CORE_THREADED:
+            return interpret_threaded(count);
+        case CORE_JIT:
+            return jit_execute(*this, count);
+        case CORE_AOT:
+            return aot_execute(*this, count);
+        default:
+            return interpret(count);
     }
 }
 
-const int RESOLUTION_UPSCALE = 15;
-
-bool 
-init_application(int argc, char **argv, void **app, int *width, int *height, char **window_title) 
+// The profile picks the instantiation once per batch, inside it no instruction checks a quirk
+uint32_t
+Chip8::interpret(uint32_t count)
 {
-    Chip8 *emulator = reinterpret_cast<Chip8*>(malloc(sizeof(Chip8)));
+    switch (quirks)
+    {
+        case QUIRKS_VIP:
+            return interpret_quirks<Vip_quirks>(count);
+        case QUIRKS_SCHIP:
+            return interpret_quirks<Schip_quirks>(count);
+        case QUIRKS_MODERN:
+            return interpret_quirks<Modern_quirks>(count);
+        default:
+            return interpret_quirks<Legacy_quirks>(count);
+    }
+}
 
-    std::memset(emulator->registers, 0, sizeof(emulator->registers));
-    emulator->index = 0;
-    std::memset(emulator->stack, 0, sizeof(emulator->stack));
-    std::memset(emulator->memory, 0, sizeof(emulator->memory));
-    std::memset(emulator->video, 0, sizeof(emulator->video));
-    std::memset(emulator->keypad, false, sizeof(emulator->keypad));
-    emulator->pc = MEMORY_START_ADDRESS;
-    emulator->delay_timer = 0;
-    emulator->sound_timer = 0;
-    emulator->prev_key_press = 0;
-    emulator->latest_key_press = 0;
-    emulator->video_updated = false;
-    emulator->running = true;
-    emulator->cpu_time = 0;
-    emulator->clock_time = 0;
+uint32_t
+Chip8::interpret_threaded(uint32_t count)
+{
+    switch (quirks)
+    {
+        case QUIRKS_VIP:
+            return interpret_threaded_quirks<Vip_quirks>(count);
+        case QUIRKS_SCHIP:
+            return interpret_threaded_quirks<Schip_quirks>(count);
+        case QUIRKS_MODERN:
+            return interpret_threaded_quirks<Modern_quirks>(count);
+        default:
+            return interpret_threaded_quirks<Legacy_quirks>(count);
+    }
+}
 
-    *app = emulator;
+// Runs up to count instructions back to back from the decoded cache
+template <typename QUIRKS>
+uint32_t
+Chip8::interpret_quirks(uint32_t count)
+{
+    // pc lives in a local for the whole batch so it isn't reloaded after every store into memory
+    uint16_t address = pc;
+    uint32_t executed = 0;
 
-    srand(time(NULL));
+    while (executed < count)
+    {
+        address &= MEMORY_MASK;
+        Instruction &entry = decoded[address];
 
-    // wiki says between 0x0000 and 0x01FF is a common font storage location
-    std::copy(font, font + sizeof(font), emulator->memory);
+        if (entry.op == OP_UNDECODED)
+        {
+            entry = decode(memory[address] << 8 | memory[(address + 1) & MEMORY_MASK], mode);
+        }
 
-    *width = SCREEN_WIDTH * RESOLUTION_UPSCALE;
-    *height = SCREEN_HEIGHT * RESOLUTION_UPSCALE;
-    *window_title = "Chip-8 Emulator";
+        // Copied because the instruction may overwrite the memory it was decoded from
+        Instruction in = entry;
+        PROFILE_INSTRUCTION(address, in);
 
-    if (argc < 2) 
-    {
-        return false;
-    }
+        address += 2;
+        ++executed;
 
-    uint64_t file_size;
-    uint8_t *data = read_file(argv[1], &file_size);
-    
-    if (!data)
-    {
-        return false;
+        switch (in.op)
+        {
+#define OP(name) case name:
+#define NEXT break;
+#include "ops.inl"
+#include "ops_extended.inl"
+#undef OP
+#undef NEXT
+            default:
+                break;
+        }
     }
-    
-    std::copy(data, data + file_size, emulator->memory + MEMORY_START_ADDRESS);
 
-    return true;
+    pc = address;
+    return executed;
 }
 
-const double desired_frame_time = (1 / 60) * 1000;
+#if defined(__GNUC__)
 
-bool 
-update_application(void *app, double frame_time) 
+// Same semantics as interpret, but every op ends in its own indirect jump to the next op through a table of label
+// addresses, which gives the branch predictor one history per op instead of a single shared dispatch branch
+template <typename QUIRKS>
+uint32_t
+Chip8::interpret_threaded_quirks(uint32_t count)
 {
-    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
-    emulator->clock_time += frame_time;
-    emulator->cpu_time += frame_time;
-    
-    if (emulator->cpu_time >= 2)
+    static void *const labels[OP_COUNT] =
     {
-        emulator->cycle();
-        emulator->cpu_time = 0;
+        &&label_OP_UNDECODED,
+        &&label_OP_CLS, &&label_OP_RET, &&label_OP_SYS, &&label_OP_JMP, &&label_OP_CALL,
+        &&label_OP_SE_VX_NN, &&label_OP_SNE_VX_NN, &&label_OP_SE_VX_VY, &&label_OP_LD_VX_NN, &&label_OP_ADD_VX_NN,
+        &&label_OP_LD_VX_VY, &&label_OP_OR, &&label_OP_AND, &&label_OP_XOR, &&label_OP_ADD_VX_VY, &&label_OP_SUB,
+        &&label_OP_SHR, &&label_OP_SUBN, &&label_OP_SHL,
+        &&label_OP_SNE_VX_VY, &&label_OP_LD_I, &&label_OP_JMP_V0, &&label_OP_RND, &&label_OP_DRW, &&label_OP_SKP,
+        &&label_OP_SKNP,
+        &&label_OP_LD_VX_DT, &&label_OP_LD_VX_K, &&label_OP_LD_DT, &&label_OP_LD_ST, &&label_OP_ADD_I, &&label_OP_LD_F,
+        &&label_OP_LD_B, &&label_OP_LD_I_VX, &&label_OP_LD_VX_I,
+        &&label_OP_NOP,
+        &&label_OP_SCD, &&label_OP_SCU, &&label_OP_SCR, &&label_OP_SCL, &&label_OP_EXIT, &&label_OP_LOW, &&label_OP_HIGH,
+        &&label_OP_DRW_EXT, &&label_OP_CLS_EXT, &&label_OP_LD_HF, &&label_OP_SAVE_FLAGS, &&label_OP_LOAD_FLAGS,
+        &&label_OP_SAVE_RANGE, &&label_OP_LOAD_RANGE, &&label_OP_LD_I_LONG, &&label_OP_PLANE, &&label_OP_AUDIO,
+        &&label_OP_PITCH
+    };
+
+    uint16_t address = pc;
+    uint32_t executed = 0;
+    Instruction in;
+
+#define DISPATCH() \
+    { \
+        if (executed == count) \
+        { \
+            goto done; \
+        } \
+        address &= MEMORY_MASK; \
+        Instruction &entry = decoded[address]; \
+        if (entry.op == OP_UNDECODED) \
+        { \
+            entry = decode(memory[address] << 8 | memory[(address + 1) & MEMORY_MASK], mode); \
+        } \
+        in = entry; \
+        PROFILE_INSTRUCTION(address, in); \
+        address += 2; \
+        ++executed; \
+        goto *labels[in.op]; \
     }
-    
-    return emulator->running;
+
+    DISPATCH();
+
+#define OP(name) label_##name:
+#define NEXT DISPATCH();
+#include "ops.inl"
+#include "ops_extended.inl"
+#undef OP
+#undef NEXT
+#undef DISPATCH
+
+label_OP_UNDECODED: // never dispatched, entries are decoded before the jump
+done:
+    pc = address;
+    return executed;
 }
 
-void 
-handle_input(void *app, Input_events &input_events) 
+#else
+
+// Computed goto is a GNU extension, other compilers run the switch core
+template <typename QUIRKS>
+uint32_t
+Chip8::interpret_threaded_quirks(uint32_t count)
 {
-    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    return interpret_quirks<QUIRKS>(count);
+}
 
-    if (input_events.event[Input_events::CODES::ONE])
-    {
-        emulator->keypad[0x00] = input_events.event[Input_events::CODES::ONE] & Input_events::STATE::DOWN;
-    }
-    else if (input_events.event[Input_events::CODES::TWO])
-    {
-        emulator->keypad[0x01] = input_events.event[Input_events::CODES::TWO] & Input_events::STATE::DOWN;
-    }
-    else if (input_events.event[Input_events::CODES::THREE])
-    {
-        emulator->keypad[0x02] = input_events.event[Input_events::CODES::THREE] & Input_events::STATE::DOWN;
-    }
-    else if (input_events.event[Input_events::CODES::FOUR])
-    {
-        emulator->keypad[0x03] = input_events.event[Input_events::CODES::FOUR] & Input_events::STATE::DOWN;
-    }
-    else if (input_events.event[Input_events::CODES::Q])
+#endif
+
+// Back to the power on state with rom in memory, the core, mode, display settings and the JIT itself are kept
+void
+Chip8::load(const uint8_t *rom, uint64_t rom_size, uint32_t seed)
+{
+    if (mode != MODE_XOCHIP)
     {
-        emulator->keypad[0x04] = input_events.event[Input_events::CODES::Q] & Input_events::STATE::DOWN;
+        memory = base_memory;
     }
-    else if (input_events.event[Input_events::CODES::W])
+
+    memory_mask = mode == MODE_XOCHIP ? XO_MEMORY_SIZE - 1 : MEMORY_MASK;
+    std::memset(registers, 0, sizeof(registers));
+    index = 0;
+    std::memset(stack, 0, sizeof(stack));
+    std::memset(memory, 0, memory_mask + 1);
+    std::memset(video, 0, sizeof(video));
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+    std::memset(keypad, false, sizeof(keypad));
+    std::memset(decoded, 0, sizeof(decoded));
+    pc = MEMORY_START_ADDRESS;
+    sp = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+    prev_key_press = 0;
+    latest_key_press = 0;
+    running = true;
+    rewinding = false;
+    rng = random_seed(seed, 0);
+    cycles = 0;
+    ticks = 0;
+    captured_ticks = 0;
+    recorded_writes = video_writes - 1;
+    broadcast_writes = video_writes - 1;
+    cycle_budget = 0;
+    hires = false;
+    planes = 1;
+    std::memset(flags, 0, sizeof(flags));
+    std::memset(pattern, 0, sizeof(pattern));
+    pitch = DEFAULT_PITCH;
+
+    // wiki says between 0x0000 and 0x01FF is a common font storage location
+    std::copy(font, font + FONT_SIZE, memory);
+
+    if (mode != MODE_CHIP8)
     {
-        emulator->keypad[0x05] = input_events.event[Input_events::CODES::W] & Input_events::STATE::DOWN;
+        std::copy(big_font, big_font + BIG_FONT_SIZE, memory + BIG_FONT_ADDRESS);
     }
-    else if (input_events.event[Input_events::CODES::E])
+
+    if (rom)
     {
-        emulator->keypad[0x06] = input_events.event[Input_events::CODES::E] & Input_events::STATE::DOWN;
+        std::copy(rom, rom + std::min<uint64_t>(rom_size, memory_mask + 1 - MEMORY_START_ADDRESS), memory + MEMORY_START_ADDRESS);
     }
-    else if (input_events.event[Input_events::CODES::R])
+
+    if (jit)
     {
-        emulator->keypad[0x07] = input_events.event[Input_events::CODES::R] & Input_events::STATE::DOWN;
+        jit_reset(jit);
     }
-    else if (input_events.event[Input_events::CODES::A])
+
+    if (aot)
     {
-        emulator->keypad[0x08] = input_events.event[Input_events::CODES::A] & Input_events::STATE::DOWN;
+        aot_reset(aot, memory, quirks);
     }
-    else if (input_events.event[Input_events::CODES::S])
+
+    if (rewind)
     {
-        emulator->keypad[0x09] = input_events.event[Input_events::CODES::S] & Input_events::STATE::DOWN;
+        rewind_clear(rewind);
     }
-    else if (input_events.event[Input_events::CODES::D])
+}
+
+void
+Chip8::tick_timers()
+{
+    if (delay_timer > 0)
     {
-        emulator->keypad[0x0A] = input_events.event[Input_events::CODES::D] & Input_events::STATE::DOWN;
+        --delay_timer;
     }
-    else if (input_events.event[Input_events::CODES::F])
+
+    if (sound_timer > 0)
     {
-        emulator->keypad[0x0B] = input_events.event[Input_events::CODES::F] & Input_events::STATE::DOWN;
+        --sound_timer;
     }
-    else if (input_events.event[Input_events::CODES::Z])
+}
+
+// The timers as the instruction at cycle sees them, for a batch that runs across ticks without stopping on them
+uint64_t
+Chip8::tick_until(uint64_t cycle)
+{
+    uint64_t due = cycle * TIMER_HZ / ips;
+
+    if (due <= ticks)
     {
-        emulator->keypad[0x0C] = input_events.event[Input_events::CODES::Z] & Input_events::STATE::DOWN;
+        return 0;
     }
-    else if (input_events.event[Input_events::CODES::X])
+
+    due -= ticks;
+    delay_timer = static_cast<uint16_t>(delay_timer - std::min<uint64_t>(delay_timer, due));
+    sound_timer = static_cast<uint16_t>(sound_timer - std::min<uint64_t>(sound_timer, due));
+    ticks += due;
+    return due;
+}
+
+// Window tiles covering columns [first, last], tile 0 in the top bit
+static uint8_t
+tile_span(int first, int last, int tile_width)
+{
+    int last_tile = std::min(last / tile_width, SCREEN_WIDTH / TILE_WIDTH - 1);
+    return static_cast<uint8_t>((0xFF >> (first / tile_width)) & ~(0xFF >> (last_tile + 1)));
+}
+
+// DXYN in the extended modes, sprites are clipped at the edges and each selected plane takes the next rows of
+// sprite data. Returns whether a set pixel was turned off
+uint8_t
+Chip8::draw(uint8_t x, uint8_t y, uint8_t rows)
+{
+    bool wide = rows == 0; // DXY0, 16x16 from two bytes a row
+    int count = wide ? 16 : rows;
+    int width = hires ? HIRES_WIDTH : SCREEN_WIDTH;
+    int height = hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    int pos_x = x % width;
+    int pos_y = y % height;
+
+    ++video_writes;
+
+    // A dirty bit covers 8 columns of one row, or 16 columns of two rows in high resolution
+    uint8_t tiles = tile_span(pos_x, pos_x + (wide ? 15 : 7), hires ? 2 * TILE_WIDTH : TILE_WIDTH);
+    uint16_t address = index;
+    uint64_t collision = 0;
+
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        emulator->keypad[0x0D] = input_events.event[Input_events::CODES::X] & Input_events::STATE::DOWN;
+        if (!(planes & (1 << plane)))
+        {
+            continue;
+        }
+
+        uint64_t *words = video + plane * PLANE_WORDS;
+
+        for (int i = 0; i < count; ++i, address += wide ? 2 : 1)
+        {
+            int row = pos_y + i;
+            uint64_t sprite = static_cast<uint64_t>(memory[address & memory_mask]) << 56;
+
+            if (wide)
+            {
+                sprite |= static_cast<uint64_t>(memory[(address + 1) & memory_mask]) << 48;
+            }
+
+            if (!sprite || row >= height)
+            {
+                continue;
+            }
+
+            if (!hires)
+            {
+                uint64_t bits = sprite >> pos_x;
+                collision |= words[row] & bits;
+                words[row] ^= bits;
+                dirty[row] |= tiles;
+                continue;
+            }
+
+            // Columns 0-63 are in the first word of the row, 64-127 in the second
+            uint64_t left = pos_x < 64 ? sprite >> pos_x : 0;
+            uint64_t right = pos_x < 64 ? (pos_x ? sprite << (64 - pos_x) : 0) : sprite >> (pos_x - 64);
+
+            collision |= (words[2 * row] & left) | (words[2 * row + 1] & right);
+            words[2 * row] ^= left;
+            words[2 * row + 1] ^= right;
+            dirty[row / 2] |= tiles;
+        }
     }
-    else if (input_events.event[Input_events::CODES::C])
+
+    return collision != 0;
+}
+
+void
+Chip8::clear_planes()
+{
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        emulator->keypad[0x0E] = input_events.event[Input_events::CODES::C] & Input_events::STATE::DOWN;
+        if (planes & (1 << plane))
+        {
+            std::memset(video + plane * PLANE_WORDS, 0, PLANE_WORDS * sizeof(uint64_t));
+        }
     }
-    else if (input_events.event[Input_events::CODES::V])
+
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+}
+
+// Vertical scrolls move whole rows of words, n is in pixels of the current resolution
+void
+Chip8::scroll_down(int rows)
+{
+    int row_words = hires ? 2 : 1;
+    int height = hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        emulator->keypad[0x0F] = input_events.event[Input_events::CODES::V] & Input_events::STATE::DOWN;
+        if (planes & (1 << plane))
+        {
+            uint64_t *words = video + plane * PLANE_WORDS;
+            std::memmove(words + rows * row_words, words, (height - rows) * row_words * sizeof(uint64_t));
+            std::memset(words, 0, rows * row_words * sizeof(uint64_t));
+        }
     }
 
-    if (input_events.event[Input_events::CODES::ESC] & Input_events::STATE::UP)
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+}
+
+void
+Chip8::scroll_up(int rows)
+{
+    int row_words = hires ? 2 : 1;
+    int height = hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        emulator->running = false;
+        if (planes & (1 << plane))
+        {
+            uint64_t *words = video + plane * PLANE_WORDS;
+            std::memmove(words, words + rows * row_words, (height - rows) * row_words * sizeof(uint64_t));
+            std::memset(words + (height - rows) * row_words, 0, rows * row_words * sizeof(uint64_t));
+        }
     }
 
-    std::memset(input_events.event, 0, sizeof(input_events.event));
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
 }
 
-bool 
-render_application(void *app, uint32_t *pixels, int width, int height) 
+// Horizontal scrolls shift each row by 4 columns, carrying between the two words of a high resolution row
+void
+Chip8::scroll_right()
 {
-     
-    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
-   
-    if (emulator->video_updated) 
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        std::memset(pixels, 0, width * height * sizeof(uint32_t));
-        
-        for (int i = 0; i < SCREEN_HEIGHT; ++i)
+        if (!(planes & (1 << plane)))
         {
-            for (int j = 0; j < SCREEN_WIDTH; ++j)
-            {
-                uint32_t pixel_value = emulator->video[j + SCREEN_WIDTH * i];
+            continue;
+        }
 
-                if (pixel_value)
-                {
-                    int adjusted_j = j * RESOLUTION_UPSCALE;
+        uint64_t *words = video + plane * PLANE_WORDS;
 
-                    for (int k = 0; k < RESOLUTION_UPSCALE; ++k)
-                    {
-                        int adjusted_i = height - 1 - (i * RESOLUTION_UPSCALE) - k;
-                        int index = adjusted_j + width * adjusted_i;
-                        std::memset(pixels + index , 0x00FFFFFF, sizeof(uint32_t) * RESOLUTION_UPSCALE);
-                    }
-                }
+        for (int i = 0; i < (hires ? HIRES_HEIGHT : SCREEN_HEIGHT); ++i)
+        {
+            if (hires)
+            {
+                words[2 * i + 1] = words[2 * i + 1] >> 4 | words[2 * i] << 60;
+                words[2 * i] >>= 4;
+            }
+            else
+            {
+                words[i] >>= 4;
             }
         }
     }
 
-    return true;
-}
\ No newline at end of file
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+}
+
+void
+Chip8::scroll_left()
+{
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        if (!(planes & (1 << plane)))
+        {
+            continue;
+        }
+
+        uint64_t *words = video + plane * PLANE_WORDS;
+
+        for (int i = 0; i < (hires ? HIRES_HEIGHT : SCREEN_HEIGHT); ++i)
+        {
+            if (hires)
+            {
+                words[2 * i] = words[2 * i] << 4 | words[2 * i + 1] >> 60;
+                words[2 * i + 1] <<= 4;
+            }
+            else
+            {
+                words[i] <<= 4;
+            }
+        }
+    }
+
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+}
+
+// 00FE/00FF, the rows change shape so every plane is cleared
+void
+Chip8::set_hires(bool on)
+{
+    hires = on;
+    std::memset(video, 0, sizeof(video));
+    std::memset(dirty, 0xFF, sizeof(dirty));
+    ++video_writes;
+}
+
+Instruction
+Chip8::fetch(uint16_t address)
+{
+    Instruction &entry = decoded[address & MEMORY_MASK];
+
+    if (entry.op == OP_UNDECODED)
+    {
+        entry = decode(memory[address & MEMORY_MASK] << 8 | memory[(address + 1) & MEMORY_MASK], mode);
+    }
+
+    return entry;
+}
+
+const uint64_t IDLE_MIN_BATCH = 32; // below this the checks cost about what running the batch does
+const uint32_t IDLE_SEARCH_STEPS = 256; // single steps spent looking for a repeating loop, finds periods up to half of it
+const uint64_t IDLE_SEARCH_BATCH = 4 * IDLE_SEARCH_STEPS; // smaller batches are run rather than searched
+
+// Only reads and writes registers, I and pc, and reads memory, timers and keys that can't change during a batch
+static bool
+register_only(uint8_t op)
+{
+    switch (op)
+    {
+        case OP_SYS: case OP_JMP: case OP_JMP_V0:
+        case OP_SE_VX_NN: case OP_SNE_VX_NN: case OP_SE_VX_VY: case OP_SNE_VX_VY:
+        case OP_LD_VX_NN: case OP_ADD_VX_NN: case OP_LD_VX_VY: case OP_OR: case OP_AND: case OP_XOR:
+        case OP_ADD_VX_VY: case OP_SUB: case OP_SHR: case OP_SUBN: case OP_SHL:
+        case OP_LD_I: case OP_ADD_I: case OP_LD_F: case OP_LD_VX_I:
+        case OP_SKP: case OP_SKNP: case OP_LD_VX_DT: case OP_LD_VX_K: case OP_NOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// A loop that only computes on registers, like one scanning EX9E over every key, goes back to the same registers
+// after a few rounds while nothing outside changes. The period is found by stepping with Brent's cycle search,
+// whole periods are then skipped since they end where they started. The rest of the batch runs normally
+uint64_t
+Chip8::repeat(uint64_t batch)
+{
+    uint8_t saved[sizeof(registers)];
+    uint16_t saved_pc = pc & MEMORY_MASK;
+    uint16_t saved_index = index;
+    uint64_t steps = 0;
+    uint32_t power = 1;
+    uint32_t period = 0;
+
+    std::memcpy(saved, registers, sizeof(saved));
+
+    while (steps < IDLE_SEARCH_STEPS && register_only(fetch(pc).op))
+    {
+        steps += execute(1);
+        ++period;
+
+        if ((pc & MEMORY_MASK) == saved_pc && index == saved_index && std::memcmp(registers, saved, sizeof(saved)) == 0)
+        {
+            return steps + (batch - steps) / period * period;
+        }
+
+        if (period == power)
+        {
+            std::memcpy(saved, registers, sizeof(saved));
+            saved_pc = pc & MEMORY_MASK;
+            saved_index = index;
+            power *= 2;
+            period = 0;
+        }
+    }
+
+    return steps + execute(static_cast<uint32_t>(batch - steps));
+}
+
+// Loops that only wait repeat exactly until what they wait for changes, so they are applied in one step leaving
+// the state running them would have, but for cycles which the caller adds. Returns the instructions done, 0 when
+// the batch should just be run:
+// - 1NNN jumping to itself or FX0A with no key down only wait for the caller's next input, the timers run down
+//   through every tick left in count
+// - FX07, 3XNN, 1NNN back to the FX07 while the delay timer isn't NN, entered at any of the three, only waits for
+//   the next tick
+// - any other loop of register-only instructions is searched for a repeat in batches big enough to pay for it
+// Only the first kind is looked for in small batches, the default speed runs 8 instructions a tick
+uint64_t
+Chip8::idle(uint64_t count, uint32_t &ticked)
+{
+    uint16_t address = pc & MEMORY_MASK;
+    Instruction in = fetch(address);
+
+    if ((in.op == OP_JMP && in.nnn == address) || (in.op == OP_LD_VX_K && !any_key()))
+    {
+        // Every tick before the last instruction, run takes the one due on it like after any other batch
+        ticked += static_cast<uint32_t>(tick_until(cycles + count - 1));
+        return count;
+    }
+
+    uint64_t batch = std::min(count, tick_cycle(ticks + 1, ips) - cycles);
+
+    if (batch < IDLE_MIN_BATCH)
+    {
+        return 0;
+    }
+
+    int position = in.op == OP_LD_VX_DT ? 0 : in.op == OP_SE_VX_NN ? 1 : in.op == OP_JMP ? 2 : -1;
+
+    if (position >= 0)
+    {
+        uint16_t head = (address - 2 * position) & MEMORY_MASK;
+        Instruction load = fetch(head);
+        Instruction test = fetch(head + 2);
+        Instruction jump = fetch(head + 4);
+
+        if (load.op == OP_LD_VX_DT && test.op == OP_SE_VX_NN && test.x == load.x && jump.op == OP_JMP && jump.nnn == head &&
+            delay_timer != test.nn && (position != 1 || registers[load.x] != test.nn))
+        {
+            // The batch goes round past FX07, so Vx ends up holding the timer
+            registers[load.x] = static_cast<uint8_t>(delay_timer);
+            pc = static_cast<uint16_t>(head + 2 * ((position + batch) % 3));
+            return batch;
+        }
+    }
+
+    return batch >= IDLE_SEARCH_BATCH && register_only(in.op) ? repeat(batch) : 0;
+}
+
+// Video was written since the recorder or the spectators last took a frame
+bool
+Chip8::frame_waiting() const
+{
+    return (recorder && video_writes != recorded_writes) || (broadcast && video_writes != broadcast_writes);
+}
+
+// Called on a tick, a frame the recorder had no room for is offered again on the next one
+void
+Chip8::offer_frame()
+{
+    if (recorder && video_writes != recorded_writes && recorder_frame(recorder, *this))
+    {
+        recorded_writes = video_writes;
+    }
+
+    if (broadcast && video_writes != broadcast_writes && broadcast_frame(broadcast, *this))
+    {
+        broadcast_writes = video_writes;
+    }
+}
+
+// Runs count instructions, ticking the timers each time the instruction count passes a 60Hz boundary.
+// Instructions between ticks go to the core as one batch. The JIT brings the timers up to date itself before
+// any instruction that uses them and takes frames for video and spectators on the ticks after a draw, so without
+// audio, which has to see every tick, its batches run across them. Returns the number of ticks
+uint32_t
+Chip8::run(uint64_t count)
+{
+    uint32_t ticked = 0;
+    bool across_ticks = core == CORE_JIT && jit && !audio;
+
+    while (count)
+    {
+        uint64_t next_tick = tick_cycle(ticks + 1, ips);
+
+        if (cycles < next_tick)
+        {
+            uint64_t executed = skip_idle ? idle(count, ticked) : 0;
+
+            if (!executed)
+            {
+                uint64_t first_tick = ticks;
+                uint64_t batch = std::min(across_ticks ? count : next_tick - cycles, count);
+
+                executed = execute(static_cast<uint32_t>(std::min<uint64_t>(batch, UINT32_MAX)));
+                ticked += static_cast<uint32_t>(ticks - first_tick);
+            }
+
+            cycles += executed;
+            count -= executed;
+
+            if (audio)
+            {
+                audio_generate(audio, *this);
+            }
+        }
+
+        // Idle time and batches across ticks may have crossed ticks of their own
+        while (cycles >= tick_cycle(ticks + 1, ips))
+        {
+            tick_timers();
+            ++ticks;
+            ++ticked;
+            offer_frame();
+        }
+    }
+
+    return ticked;
+}
+
+const int DEFAULT_SCALE = 15;
+const double MAX_SPEED = 1000;
+const double MAX_FRAME_TIME = 250; // ms of host time one update_application call may catch up on
+const double MAX_REWIND_MB = 4096;
+
+// Returns the value of a --name=value argument, or NULL if it wasn't passed
+static char *
+find_option(int argc, char **argv, const char *name)
+{
+    size_t length = std::strlen(name);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--", 2) == 0 && std::strncmp(argv[i] + 2, name, length) == 0 && argv[i][2 + length] == '=')
+        {
+            return argv[i] + 3 + length;
+        }
+    }
+
+    return NULL;
+}
+
+// The ROM is the first argument that isn't a --option, options are left for the platform layer
+static char *
+find_rom_path(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            return argv[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool 
+init_application(int argc, char **argv, void **app, int *width, int *height, const char **window_title) 
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(malloc(sizeof(Chip8)));
+
+    // The seed only feeds CXNN, passing one makes a run repeatable
+    char *seed = find_option(argc, argv, "seed");
+    uint32_t seed_value = seed ? static_cast<uint32_t>(std::strtoul(seed, NULL, 0)) : static_cast<uint32_t>(time(NULL));
+
+    emulator->core = CORE_INTERPRETER;
+    emulator->jit = NULL;
+    emulator->aot = NULL;
+    emulator->rewind = NULL;
+    emulator->movie = NULL;
+    emulator->profile = NULL;
+    emulator->audio = NULL;
+    emulator->recorder = NULL;
+    emulator->broadcast = NULL;
+    emulator->video_writes = 0;
+    emulator->skip_idle = true;
+    emulator->queued_key_count = 0;
+    emulator->filter = FILTER_NONE;
+    emulator->scale = DEFAULT_SCALE;
+    emulator->ips = DEFAULT_IPS;
+    emulator->speed = 1;
+    emulator->mode = MODE_CHIP8;
+    emulator->quirks = QUIRKS_LEGACY;
+    emulator->load(NULL, 0, seed_value);
+
+    *app = emulator;
+
+    char *mode = find_option(argc, argv, "mode");
+
+    if (mode && std::strcmp(mode, "schip") == 0)
+    {
+        emulator->mode = MODE_SCHIP;
+    }
+    else if (mode && std::strcmp(mode, "xochip") == 0)
+    {
+        emulator->memory = reinterpret_cast<uint8_t*>(calloc(XO_MEMORY_SIZE, 1));
+
+        if (!emulator->memory)
+        {
+            message_box("Error", "Can't allocate XO-CHIP memory");
+            return false;
+        }
+
+        emulator->mode = MODE_XOCHIP;
+    }
+
+    // Without --quirks the ROM's hash picks the profile from the database, once the ROM is read
+    char *quirks = find_option(argc, argv, "quirks");
+
+    if (quirks && !parse_quirks(quirks, emulator->quirks))
+    {
+        message_box("Warning", "Unknown --quirks profile, the ROM's own or legacy quirks are used");
+        quirks = NULL;
+    }
+
+    char *core = find_option(argc, argv, "core");
+
+    if (core && std::strcmp(core, "threaded") == 0)
+    {
+        emulator->core = CORE_THREADED;
+    }
+    else if (core && std::strcmp(core, "jit") == 0)
+    {
+        emulator->jit = jit_create();
+
+        if (emulator->jit)
+        {
+            emulator->core = CORE_JIT;
+        }
+        else
+        {
+            message_box("Warning", "The JIT isn't supported on this platform, falling back to the interpreter");
+        }
+    }
+    else if (core && std::strcmp(core, "aot") == 0 && emulator->mode != MODE_CHIP8)
+    {
+        message_box("Warning", "Recompiled ROMs are CHIP-8 only, falling back to the interpreter");
+    }
+    else if (core && std::strcmp(core, "aot") == 0)
+    {
+        emulator->aot = aot_create();
+
+        if (emulator->aot)
+        {
+            emulator->core = CORE_AOT;
+        }
+        else
+        {
+            message_box("Warning", CHIP8_AOT ? "Out of memory for the recompiled ROM, falling back to the interpreter" :
+                "No recompiled ROM is linked in, rebuild with AOT=file.cpp ./build.sh");
+        }
+    }
+
+    // Generated code doesn't call the profiler's hook, so a profiled run interprets instead
+    char *profile = find_option(argc, argv, "profile");
+
+    if (profile && !CHIP8_PROFILE)
+    {
+        message_box("Warning", "Profiling isn't compiled in, rebuild with PROFILE=1 ./build.sh");
+    }
+    else if (profile)
+    {
+        emulator->profile = profile_create();
+        emulator->profile->path = profile;
+
+        if (emulator->jit)
+        {
+            jit_destroy(emulator->jit);
+            emulator->jit = NULL;
+        }
+
+        if (emulator->aot)
+        {
+            aot_destroy(emulator->aot);
+            emulator->aot = NULL;
+        }
+
+        emulator->core = CORE_INTERPRETER;
+    }
+
+    // Idle loops are skipped rather than run, a profile counts every instruction the ROM would have executed
+    char *skip_idle = find_option(argc, argv, "skip-idle");
+
+    if ((skip_idle && std::strcmp(skip_idle, "off") == 0) || emulator->profile)
+    {
+        emulator->skip_idle = false;
+    }
+
+    char *filter = find_option(argc, argv, "filter");
+
+    if (filter && std::strcmp(filter, "scale2x") == 0)
+    {
+        emulator->filter = FILTER_SCALE2X;
+    }
+    else if (filter && std::strcmp(filter, "scale3x") == 0)
+    {
+        emulator->filter = FILTER_SCALE3X;
+    }
+
+    if (emulator->filter != FILTER_NONE && emulator->mode != MODE_CHIP8)
+    {
+        message_box("Warning", "Filters only apply to CHIP-8, the extended modes draw without one");
+        emulator->filter = FILTER_NONE;
+    }
+
+    char *ips = find_option(argc, argv, "ips");
+
+    if (ips)
+    {
+        emulator->ips = static_cast<uint32_t>(std::min<unsigned long>(std::max<unsigned long>(std::strtoul(ips, NULL, 0), MIN_IPS), MAX_IPS));
+    }
+
+    // Fast-forward or slow motion, only the interactive loop runs at a set speed
+    char *speed = find_option(argc, argv, "speed");
+
+    if (speed && std::atof(speed) > 0)
+    {
+        emulator->speed = std::min(std::atof(speed), MAX_SPEED);
+    }
+
+    // Hold B to step back through the last frames, the budget is in MB
+    char *rewind = find_option(argc, argv, "rewind");
+
+    if (rewind && std::atof(rewind) > 0)
+    {
+        emulator->rewind = rewind_create(static_cast<uint64_t>(std::min(std::atof(rewind), MAX_REWIND_MB) * 1024 * 1024));
+
+        if (!emulator->rewind)
+        {
+            message_box("Warning", "Can't allocate the rewind buffer, rewinding is off");
+        }
+    }
+
+    // Sound to the Windows audio device or to a WAV or raw 16 bit file
+    char *audio = find_option(argc, argv, "audio");
+
+    if (audio)
+    {
+        emulator->audio = audio_create(audio);
+
+        if (!emulator->audio)
+        {
+            message_box("Warning", "Can't open the audio output, running without sound");
+        }
+    }
+
+    // Every frame that changed, into a stream ./bin/frames converts
+    char *video = find_option(argc, argv, "video");
+
+    if (video)
+    {
+        emulator->recorder = recorder_create(video);
+
+        if (!emulator->recorder)
+        {
+            message_box("Warning", "Can't open the video output, running without recording");
+        }
+    }
+
+    // Spectators watching over a socket, POSIX only
+    char *serve = find_option(argc, argv, "serve");
+
+    if (serve)
+    {
+        emulator->broadcast = broadcast_create(serve);
+
+        if (!emulator->broadcast)
+        {
+            message_box("Warning", "Can't serve spectators on that address, running without");
+        }
+    }
+
+    // Filters multiply the resolution first, so the scale is rounded up to a multiple of their factor.
+    // High resolution is drawn the same way at factor 2
+    char *scale = find_option(argc, argv, "scale");
+    int factor = emulator->mode != MODE_CHIP8 ? 2 : filter_factor(emulator->filter);
+
+    if (scale)
+    {
+        emulator->scale = static_cast<uint16_t>(std::min(std::max(atoi(scale), 1), MAX_SCALE));
+    }
+
+    emulator->scale = static_cast<uint16_t>((emulator->scale + factor - 1) / factor * factor);
+
+    *width = SCREEN_WIDTH * emulator->scale;
+    *height = SCREEN_HEIGHT * emulator->scale;
+    *window_title = "Chip-8 Emulator";
+
+    char *rom_path = find_rom_path(argc, argv);
+
+    if (!rom_path) 
+    {
+        return false;
+    }
+
+    uint64_t file_size;
+    uint8_t *data = read_file(rom_path, &file_size);
+    
+    if (!data)
+    {
+        return false;
+    }
+    
+    if (!quirks)
+    {
+        emulator->quirks = rom_quirks(hash_bytes(data, file_size));
+    }
+
+    // Movies start from power-on with the seed, speed and quirks they were recorded with
+    char *play = find_option(argc, argv, "play");
+    char *record = find_option(argc, argv, "record");
+
+    if (play)
+    {
+        emulator->movie = new Movie();
+
+        if (!movie_read(*emulator->movie, play) || emulator->movie->rom_hash != hash_bytes(data, file_size))
+        {
+            message_box("Error", "Can't play the movie, it is unreadable or was recorded on a different ROM");
+            free(data);
+            return false;
+        }
+
+        if (emulator->movie->mode != emulator->mode)
+        {
+            message_box("Error", "Can't play the movie, it was recorded in another --mode");
+            free(data);
+            return false;
+        }
+
+        seed_value = emulator->movie->seed;
+        emulator->ips = emulator->movie->ips;
+        emulator->quirks = emulator->movie->quirks;
+    }
+    else if (record)
+    {
+        emulator->movie = new Movie();
+        emulator->movie->playing = false;
+        emulator->movie->rom_hash = hash_bytes(data, file_size);
+        emulator->movie->seed = seed_value;
+        emulator->movie->ips = emulator->ips;
+        emulator->movie->mode = emulator->mode;
+        emulator->movie->quirks = emulator->quirks;
+        emulator->movie->path = record;
+    }
+
+    emulator->load(data, file_size, seed_value);
+    free(data);
+
+    // Code recompiled from another ROM or under other quirks never matches, all of it would interpret
+    if (emulator->aot && !aot_reset(emulator->aot, emulator->memory, emulator->quirks))
+    {
+        char message[256];
+        std::snprintf(message, sizeof(message),
+            "The linked in code was recompiled from %s or with other --quirks, this ROM is interpreted", aot_rom(emulator->aot));
+        message_box("Warning", message);
+    }
+
+    // A state saved from the same ROM picks up where it left off
+    char *state = find_option(argc, argv, "load-state");
+
+    if (state && emulator->movie)
+    {
+        message_box("Warning", "Movies start from power-on, the save state is ignored");
+    }
+    else if (state)
+    {
+        Snapshot snapshot;
+        bool read = snapshot_read(snapshot, state);
+
+        if (read && snapshot.mode == emulator->mode)
+        {
+            snapshot_restore(*emulator, snapshot);
+        }
+        else if (read)
+        {
+            message_box("Warning", "The save state was made in another --mode, starting the ROM from the beginning");
+        }
+        else
+        {
+            message_box("Warning", "Can't load the save state, starting the ROM from the beginning");
+        }
+    }
+
+    return true;
+}
+
+bool
+save_application(void *app, const char *path)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    Snapshot snapshot;
+
+    snapshot_save(*emulator, snapshot);
+    return snapshot_write(snapshot, path);
+}
+
+uint64_t
+hash_application(void *app)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    Snapshot snapshot;
+
+    // The fraction of an instruction left over from the host's frame times is not part of the emulated run
+    snapshot_save(*emulator, snapshot);
+    snapshot.cycle_budget = 0;
+    return hash_bytes(reinterpret_cast<const uint8_t*>(&snapshot), snapshot_size(snapshot));
+}
+
+// Applies the queued keypad changes that are due, all of them when every is set
+static void
+apply_queued_keys(Chip8 *emulator, bool every)
+{
+    uint32_t applied = 0;
+
+    while (applied < emulator->queued_key_count && (every || emulator->queued_keys[applied].cycle <= emulator->cycles))
+    {
+        emulator->keypad[emulator->queued_keys[applied].key] = emulator->queued_keys[applied].down;
+        ++applied;
+    }
+
+    emulator->queued_key_count -= applied;
+    std::memmove(emulator->queued_keys, emulator->queued_keys + applied, emulator->queued_key_count * sizeof(Key_change));
+}
+
+// Every instruction the host asks for goes through here, so queued keys land on their cycle and a movie sees
+// each run and splits it where keys change
+static uint32_t
+advance(Chip8 *emulator, uint64_t count)
+{
+    if (!emulator->movie && !emulator->queued_key_count)
+    {
+        return emulator->run(count);
+    }
+
+    uint32_t ticked = 0;
+
+    while (count)
+    {
+        apply_queued_keys(emulator, false);
+
+        if (emulator->movie)
+        {
+            movie_input(*emulator->movie, *emulator);
+        }
+
+        uint64_t step = emulator->movie ? std::min(count, movie_next_cycle(*emulator->movie) - emulator->cycles) : count;
+
+        if (emulator->queued_key_count)
+        {
+            step = std::min(step, emulator->queued_keys[0].cycle - emulator->cycles);
+        }
+
+        ticked += emulator->run(step);
+        count -= step;
+    }
+
+    return ticked;
+}
+
+// Goes back one frame for every frame the budget would have run forward. The keys the player holds now are kept,
+// not the ones from the frames rewound into
+static void
+rewind_frames(Chip8 *emulator)
+{
+    double tick_cycles = static_cast<double>(emulator->ips) / TIMER_HZ;
+    double budget = emulator->cycle_budget;
+    bool keypad[sizeof(emulator->keypad)];
+    std::memcpy(keypad, emulator->keypad, sizeof(keypad));
+
+    while (budget >= tick_cycles && rewind_step(emulator->rewind, *emulator))
+    {
+        budget -= tick_cycles;
+    }
+
+    // Out of history the time is dropped rather than banked
+    emulator->cycle_budget = std::min(budget, tick_cycles);
+    std::memcpy(emulator->keypad, keypad, sizeof(keypad));
+
+    if (emulator->movie)
+    {
+        movie_seek(*emulator->movie, emulator->cycles);
+    }
+}
+
+// Host time becomes an instruction budget at ips * speed, the part of an instruction left over is carried to the
+// next frame. Everything the ROM sees follows from the instruction count, so the host's frame times never change
+// the results, only how far a frame gets
+bool 
+update_application(void *app, double frame_time) 
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    // After a stall (a debugger, a dragged window) the lost time is dropped instead of run at full speed
+    frame_time = std::min(std::max(frame_time, 0.0), MAX_FRAME_TIME);
+
+    emulator->cycle_budget += frame_time / 1000 * emulator->ips * emulator->speed;
+
+    if (emulator->rewind && emulator->rewinding)
+    {
+        // Rewinding keeps the keys held now, including the ones still waiting for their cycle
+        apply_queued_keys(emulator, true);
+        rewind_frames(emulator);
+        return emulator->running;
+    }
+
+    uint64_t count = static_cast<uint64_t>(emulator->cycle_budget);
+    emulator->cycle_budget -= count;
+
+    if (!emulator->rewind)
+    {
+        advance(emulator, count);
+        return emulator->running;
+    }
+
+    // Recorded on every tick so rewinding goes back exactly one emulated frame at a time
+    while (count)
+    {
+        uint64_t step = std::min(std::max<uint64_t>(tick_cycle(emulator->ticks + 1, emulator->ips), emulator->cycles + 1) - emulator->cycles, count);
+
+        if (advance(emulator, step))
+        {
+            rewind_push(emulator->rewind, *emulator);
+        }
+
+        count -= step;
+    }
+
+    return emulator->running;
+}
+
+bool
+run_application(void *app, uint64_t max_cycles, uint64_t max_frames, Run_stats &stats)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    // Emulated time advances by exactly one instruction per cycle, there is no wall-clock throttling
+    while (emulator->running)
+    {
+        if ((max_cycles && stats.cycles >= max_cycles) || (max_frames && stats.frames >= max_frames))
+        {
+            return true;
+        }
+
+        // Up to the tick the frame limit stops on, or a second of emulated time without one, so a core that runs
+        // across ticks gets batches of more than one
+        uint64_t frames = max_frames ? max_frames - stats.frames : TIMER_HZ;
+        uint64_t count = std::max<uint64_t>(tick_cycle(emulator->ticks + frames, emulator->ips), emulator->cycles + 1) - emulator->cycles;
+
+        if (max_cycles)
+        {
+            count = std::min(count, max_cycles - stats.cycles);
+        }
+
+        // A movie played to its end is a limit like any other
+        if (emulator->movie && emulator->movie->playing)
+        {
+            if (emulator->cycles >= emulator->movie->end_cycle)
+            {
+                return true;
+            }
+
+            count = std::min(count, emulator->movie->end_cycle - emulator->cycles);
+        }
+
+        stats.frames += advance(emulator, count);
+        stats.cycles += count;
+    }
+
+    return false;
+}
+
+void
+destroy_application(void *app)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    if (emulator->jit)
+    {
+        jit_destroy(emulator->jit);
+    }
+
+    if (emulator->aot)
+    {
+        aot_destroy(emulator->aot);
+    }
+
+    if (emulator->rewind)
+    {
+        rewind_destroy(emulator->rewind);
+    }
+
+    if (emulator->audio)
+    {
+        audio_destroy(emulator->audio);
+    }
+
+    if (emulator->recorder)
+    {
+        recorder_stop(emulator->recorder, *emulator);
+        recorder_destroy(emulator->recorder);
+    }
+
+    if (emulator->broadcast)
+    {
+        broadcast_destroy(emulator->broadcast);
+    }
+
+    if (emulator->movie)
+    {
+        if (!emulator->movie->playing)
+        {
+            emulator->movie->end_cycle = emulator->cycles;
+
+            if (!movie_write(*emulator->movie, emulator->movie->path))
+            {
+                message_box("Error", "Can't write the movie");
+            }
+        }
+
+        delete emulator->movie;
+    }
+
+    if (emulator->profile)
+    {
+        if (!profile_write(*emulator->profile, *emulator, emulator->profile->path))
+        {
+            message_box("Error", "Can't write the profile");
+        }
+
+        profile_destroy(emulator->profile);
+    }
+
+    if (emulator->memory != emulator->base_memory)
+    {
+        free(emulator->memory);
+    }
+
+    free(emulator);
+}
+
+// Host keys for keypad 0 to F, the left four columns of a QWERTY keyboard
+const uint8_t KEYPAD_CODES[16] =
+{
+    Input_events::CODES::ONE, Input_events::CODES::TWO, Input_events::CODES::THREE, Input_events::CODES::FOUR,
+    Input_events::CODES::Q, Input_events::CODES::W, Input_events::CODES::E, Input_events::CODES::R,
+    Input_events::CODES::A, Input_events::CODES::S, Input_events::CODES::D, Input_events::CODES::F,
+    Input_events::CODES::Z, Input_events::CODES::X, Input_events::CODES::C, Input_events::CODES::V
+};
+
+// Rewinding and quitting act at once, they aren't something the ROM sees
+static void
+handle_host_keys(Chip8 *emulator, Input_events &input_events)
+{
+    if (input_events.event[Input_events::CODES::B])
+    {
+        emulator->rewinding = input_events.event[Input_events::CODES::B] & Input_events::STATE::DOWN;
+    }
+
+    if (input_events.event[Input_events::CODES::ESC] & Input_events::STATE::UP)
+    {
+        emulator->running = false;
+    }
+
+    std::memset(input_events.event, 0, sizeof(input_events.event));
+}
+
+void 
+handle_input(void *app, Input_events &input_events) 
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    for (int key = 0; key < 16; ++key)
+    {
+        if (input_events.event[KEYPAD_CODES[key]])
+        {
+            emulator->keypad[key] = input_events.event[KEYPAD_CODES[key]] & Input_events::STATE::DOWN;
+        }
+    }
+
+    handle_host_keys(emulator, input_events);
+}
+
+// The delay becomes instructions at the rate update_application turns host time into them, counted from where the
+// next update starts. Changes keep the order they were queued in whatever their delays
+void
+queue_input(void *app, Input_events &input_events, double delay)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    delay = std::min(std::max(delay, 0.0), MAX_FRAME_TIME);
+    uint64_t cycle = emulator->cycles + static_cast<uint64_t>(delay / 1000 * emulator->ips * emulator->speed);
+
+    if (emulator->queued_key_count)
+    {
+        cycle = std::max(cycle, emulator->queued_keys[emulator->queued_key_count - 1].cycle);
+    }
+
+    for (int key = 0; key < 16; ++key)
+    {
+        if (!input_events.event[KEYPAD_CODES[key]])
+        {
+            continue;
+        }
+
+        // Out of room the oldest change stops waiting
+        if (emulator->queued_key_count == MAX_QUEUED_KEYS)
+        {
+            emulator->keypad[emulator->queued_keys[0].key] = emulator->queued_keys[0].down;
+            --emulator->queued_key_count;
+            std::memmove(emulator->queued_keys, emulator->queued_keys + 1, emulator->queued_key_count * sizeof(Key_change));
+        }
+
+        Key_change &change = emulator->queued_keys[emulator->queued_key_count++];
+        change.cycle = cycle;
+        change.key = static_cast<uint8_t>(key);
+        change.down = input_events.event[KEYPAD_CODES[key]] & Input_events::STATE::DOWN;
+    }
+
+    handle_host_keys(emulator, input_events);
+}
+
+// Adds a run of dirty tiles on one row, growing the rectangle left by the row above when it spans the same tiles
+static void
+add_dirty_rect(Dirty_rects &dirty, int scale, int row, int first_tile, int last_tile)
+{
+    int x = first_tile * TILE_WIDTH * scale;
+    int y = row * scale;
+    int width = (last_tile - first_tile + 1) * TILE_WIDTH * scale;
+
+    for (int i = 0; i < dirty.count; ++i)
+    {
+        Rect &rect = dirty.rects[i];
+
+        if (rect.x == x && rect.width == width && rect.y + rect.height == y)
+        {
+            rect.height += scale;
+            return;
+        }
+    }
+
+    if (dirty.count == MAX_DIRTY_RECTS)
+    {
+        // Out of space, collapse everything into one bounding rectangle
+        Rect bounds = dirty.rects[0];
+
+        for (int i = 1; i < dirty.count; ++i)
+        {
+            int right = std::max(bounds.x + bounds.width, dirty.rects[i].x + dirty.rects[i].width);
+            bounds.x = std::min(bounds.x, dirty.rects[i].x);
+            bounds.width = right - bounds.x;
+        }
+
+        int right = std::max(bounds.x + bounds.width, x + width);
+        bounds.x = std::min(bounds.x, x);
+        bounds.width = right - bounds.x;
+        bounds.height = y + scale - bounds.y;
+
+        dirty.rects[0] = bounds;
+        dirty.count = 1;
+        return;
+    }
+
+    dirty.rects[dirty.count++] = { x, y, width, scale };
+}
+
+void
+invalidate_application(void *app)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    std::memset(emulator->dirty, 0xFF, sizeof(emulator->dirty));
+}
+
+bool
+audio_stats_application(void *app, Audio_stats &stats)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    if (!emulator->audio)
+    {
+        return false;
+    }
+
+    audio_stop(emulator->audio);
+    stats = audio_stats(emulator->audio);
+    return true;
+}
+
+void
+audio_pacer_application(void *app, Pacer *pacer)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    if (emulator->audio)
+    {
+        audio_set_pacer(emulator->audio, pacer);
+    }
+}
+
+bool
+recorder_stats_application(void *app, Recorder_stats &stats)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    if (!emulator->recorder)
+    {
+        return false;
+    }
+
+    recorder_stop(emulator->recorder, *emulator);
+    stats = recorder_stats(emulator->recorder);
+    return true;
+}
+
+bool
+broadcast_stats_application(void *app, Broadcast_stats &stats)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    if (!emulator->broadcast)
+    {
+        return false;
+    }
+
+    broadcast_stop(emulator->broadcast);
+    stats = broadcast_stats(emulator->broadcast);
+    return true;
+}
+
+// XO-CHIP colours by which planes are set, the first plane alone looks like CHIP-8 so rows without the second
+// plane are drawn as usual
+const uint32_t PLANE_COLORS[1 << PLANE_COUNT] = { PIXEL_OFF, PIXEL_ON, 0xFF808080, 0xFFC0C0C0 };
+
+// The factor lines of MSB first bits display row `row` of one plane is drawn from, high resolution rows are
+// two full pixel rows of 16 bytes like a factor 2 filter's output
+static void
+row_bits(const uint64_t *words, bool hires, int row, uint8_t filter, uint8_t *out)
+{
+    if (!hires)
+    {
+        filter_row(words, SCREEN_HEIGHT, row, filter, out);
+        return;
+    }
+
+    for (int k = 0; k < 2; ++k)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            out[k * 16 + i] = static_cast<uint8_t>(words[(2 * row + k) * 2 + i / 8] >> (56 - i % 8 * 8));
+        }
+    }
+}
+
+// Only reads the display settings fixed at init, so the presenting thread may call it while the emulator runs
+static bool
+render_words(Chip8 *emulator, const uint64_t *words, bool hires, const uint8_t *dirty_tiles, uint32_t *pixels, int width,
+    int height, Dirty_rects &dirty)
+{
+    const int tiles_per_row = SCREEN_WIDTH / TILE_WIDTH;
+    const int factor = hires ? 2 : filter_factor(emulator->filter); // same window pixels per tile either way
+    const int scale = emulator->scale / factor; // window pixels per filtered pixel
+    const int tile_pixels = TILE_WIDTH * emulator->scale;
+
+    uint8_t tiles[SCREEN_HEIGHT];
+    std::memcpy(tiles, dirty_tiles, sizeof(tiles));
+
+    // Filtered pixels depend on their neighbours, so the tiles around a change are redrawn too
+    if (emulator->filter != FILTER_NONE)
+    {
+        uint8_t grown[SCREEN_HEIGHT];
+
+        for (int i = 0; i < SCREEN_HEIGHT; ++i)
+        {
+            uint8_t row = (i > 0 ? tiles[i - 1] : 0) | tiles[i] | (i + 1 < SCREEN_HEIGHT ? tiles[i + 1] : 0);
+            grown[i] = static_cast<uint8_t>(row | (row << 1) | (row >> 1));
+        }
+
+        std::memcpy(tiles, grown, sizeof(tiles));
+    }
+
+    dirty.count = 0;
+    uint32_t line[SCREEN_WIDTH * MAX_SCALE + EXPAND_PADDING];
+    uint32_t second[SCREEN_WIDTH * MAX_SCALE + EXPAND_PADDING];
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        if (!tiles[i])
+        {
+            continue;
+        }
+
+        uint8_t bits[PLANE_COUNT][MAX_FILTER_FACTOR * MAX_FILTER_FACTOR * 8];
+        row_bits(words, hires, i, emulator->filter, bits[0]);
+        bool colored = false;
+
+        if (emulator->mode == MODE_XOCHIP)
+        {
+            row_bits(words + PLANE_WORDS, hires, i, emulator->filter, bits[1]);
+
+            for (int k = 0; k < factor * factor * TILE_WIDTH; ++k)
+            {
+                colored |= bits[1][k] != 0;
+            }
+        }
+
+        for (int j = 0; j < tiles_per_row; ++j)
+        {
+            if (!(tiles[i] & (0x80 >> j)))
+            {
+                continue;
+            }
+
+            int last = j;
+
+            while (last + 1 < tiles_per_row && (tiles[i] & (0x80 >> (last + 1))))
+            {
+                ++last;
+            }
+
+            // Expand each filtered line of the run once, then copy it into all the scanlines it covers
+            int cells = (last - j + 1) * factor * TILE_WIDTH;
+            size_t run_bytes = (last - j + 1) * tile_pixels * sizeof(uint32_t);
+
+            for (int k = 0; k < factor; ++k)
+            {
+                expand_line(bits[0] + k * factor * TILE_WIDTH, j * factor * TILE_WIDTH, cells, scale, line);
+
+                if (colored)
+                {
+                    expand_line(bits[1] + k * factor * TILE_WIDTH, j * factor * TILE_WIDTH, cells, scale, second);
+
+                    for (int p = 0; p < cells * scale; ++p)
+                    {
+                        uint32_t a = line[p];
+                        uint32_t b = second[p];
+                        line[p] = (a & ~b & PLANE_COLORS[1]) | (~a & b & PLANE_COLORS[2]) | (a & b & PLANE_COLORS[3]);
+                    }
+                }
+
+                for (int l = 0; l < scale; ++l)
+                {
+                    int adjusted_i = height - 1 - (i * emulator->scale) - k * scale - l;
+                    std::memcpy(pixels + j * tile_pixels + width * adjusted_i, line, run_bytes);
+                }
+            }
+
+            add_dirty_rect(dirty, emulator->scale, i, j, last);
+            j = last;
+        }
+    }
+
+    return dirty.count > 0;
+}
+
+bool
+render_display(void *app, const Display &display, const uint8_t *dirty_tiles, uint32_t *pixels, int width, int height,
+    Dirty_rects &dirty)
+{
+    return render_words(reinterpret_cast<Chip8*>(app), display.words, display.hires, dirty_tiles, pixels, width, height,
+        dirty);
+}
+
+// Redraws only the tiles DXYN and 00E0 touched since the last call, the frame buffer is bottom-up
+bool 
+render_application(void *app, uint32_t *pixels, int width, int height, Dirty_rects &dirty) 
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+
+    uint8_t tiles[SCREEN_HEIGHT];
+    std::memcpy(tiles, emulator->dirty, sizeof(tiles));
+    std::memset(emulator->dirty, 0, sizeof(emulator->dirty));
+
+    return render_words(emulator, emulator->video, emulator->hires, tiles, pixels, width, height, dirty);
+}
+
+// At most once per timer tick so a frame is never taken halfway through a ROM's redraw more often than
+// the ROM itself could show it
+bool
+capture_display(void *app, Display &display)
+{
+    Chip8 *emulator = reinterpret_cast<Chip8*>(app);
+    uint8_t changed = 0;
+
+    if (emulator->ticks == emulator->captured_ticks)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        changed |= emulator->dirty[i];
+    }
+
+    if (!changed)
+    {
+        return false;
+    }
+
+    std::memcpy(display.words, emulator->video, sizeof(emulator->video));
+    display.hires = emulator->hires;
+    std::memset(emulator->dirty, 0, sizeof(emulator->dirty));
+    emulator->captured_ticks = emulator->ticks;
+    return true;
+}
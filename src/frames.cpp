@@ -0,0 +1,491 @@
+#include "posix.h"
+#include "recorder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Converts a frame stream written with --video into an animated GIF and/or a PNG per frame, e.g.
+// ./bin/frames pong.c8f --gif=pong.gif --scale=8
+// The GIF keeps the emulated timing, each PNG is one frame that changed and is named by its index
+const int DEFAULT_SCALE = 8;
+const int MAX_SCALE = 32;
+const uint8_t PALETTE[4][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 128, 128, 128 }, { 192, 192, 192 } }; // as the emulator draws
+const uint32_t MIN_GIF_DELAY = 2; // centiseconds, viewers play anything shorter at 10
+const uint32_t LAST_GIF_DELAY = 100; // the last frame is held for a second before the loop starts again
+const int LZW_MAX_CODES = 4096;
+const size_t PNG_STORED_BLOCK = 65535;
+
+// Palette indices, one byte per output pixel
+struct Image {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+};
+
+// Low resolution pixels take scale output pixels, high resolution ones half of that, like the emulator's window
+static void
+draw_frame(const Recorded_frame &frame, int scale, Image &image)
+{
+    uint32_t width = frame_width(frame.format);
+    uint32_t plane_bytes = width * frame_height(frame.format) / 8;
+    uint32_t size = frame.format & FRAME_HIRES ? scale / 2 : scale;
+    bool two_planes = (frame.format & FRAME_TWO_PLANES) != 0;
+
+    for (uint32_t y = 0; y < image.height; ++y)
+    {
+        uint8_t *line = &image.pixels[y * image.width];
+
+        for (uint32_t x = 0; x < image.width; ++x)
+        {
+            uint32_t bit = y / size * width + x / size;
+            uint8_t first = (frame.bits[bit / 8] >> (7 - bit % 8)) & 1;
+            uint8_t second = two_planes ? (frame.bits[plane_bytes + bit / 8] >> (7 - bit % 8)) & 1 : 0;
+            line[x] = static_cast<uint8_t>(first | second << 1);
+        }
+    }
+}
+
+static void
+put_u16(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+// GIF LZW at 2 bits per pixel, codes packed LSB first into 255 byte sub-blocks. The dictionary is a trie with a
+// child per colour, and starts over with a clear code once all 4096 codes are taken
+static void
+gif_lzw(const std::vector<uint8_t> &pixels, std::vector<uint8_t> &out)
+{
+    const uint32_t clear = 4;
+    const uint32_t end = 5;
+    static uint16_t children[LZW_MAX_CODES][4];
+
+    std::vector<uint8_t> data;
+    uint32_t buffer = 0;
+    int bits = 0;
+    int code_size = 3;
+    uint32_t next_code = end + 1;
+
+    auto put = [&](uint32_t code)
+    {
+        buffer |= code << bits;
+        bits += code_size;
+
+        while (bits >= 8)
+        {
+            data.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            bits -= 8;
+        }
+    };
+
+    std::memset(children, 0, sizeof(children));
+    put(clear);
+    uint32_t prefix = pixels[0];
+
+    for (size_t i = 1; i < pixels.size(); ++i)
+    {
+        uint8_t pixel = pixels[i];
+
+        if (children[prefix][pixel])
+        {
+            prefix = children[prefix][pixel];
+            continue;
+        }
+
+        put(prefix);
+
+        if (next_code < LZW_MAX_CODES)
+        {
+            children[prefix][pixel] = static_cast<uint16_t>(next_code++);
+
+            // The decoder adds each code one step later, so it widens once the code after the next is taken
+            if (next_code - 1 == 1u << code_size && code_size < 12)
+            {
+                ++code_size;
+            }
+        }
+        else
+        {
+            put(clear);
+            std::memset(children, 0, sizeof(children));
+            next_code = end + 1;
+            code_size = 3;
+        }
+
+        prefix = pixel;
+    }
+
+    put(prefix);
+
+    // The decoder adds a code after the last one as well, which can widen the end code
+    if (next_code < LZW_MAX_CODES && ++next_code - 1 == 1u << code_size && code_size < 12)
+    {
+        ++code_size;
+    }
+
+    put(end);
+
+    if (bits)
+    {
+        data.push_back(static_cast<uint8_t>(buffer));
+    }
+
+    out.push_back(2); // minimum code size
+
+    for (size_t i = 0; i < data.size(); i += 255)
+    {
+        size_t length = std::min<size_t>(255, data.size() - i);
+        out.push_back(static_cast<uint8_t>(length));
+        out.insert(out.end(), data.begin() + i, data.begin() + i + length);
+    }
+
+    out.push_back(0);
+}
+
+static void
+gif_header(const Image &image, std::vector<uint8_t> &out)
+{
+    static const char NETSCAPE[] = "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00"; // loop forever
+
+    out.insert(out.end(), "GIF89a", "GIF89a" + 6);
+    put_u16(out, image.width);
+    put_u16(out, image.height);
+    out.push_back(0xF1); // global colour table of 4 entries
+    out.push_back(0);
+    out.push_back(0);
+
+    for (const uint8_t *colour : PALETTE)
+    {
+        out.insert(out.end(), colour, colour + 3);
+    }
+
+    out.insert(out.end(), NETSCAPE, NETSCAPE + sizeof(NETSCAPE) - 1);
+}
+
+// Only the rectangle that differs from what is on screen is stored, the rest stays from the frame before
+static void
+gif_frame(const Image &image, Image &shown, uint32_t delay, std::vector<uint8_t> &out)
+{
+    uint32_t left = image.width, top = image.height, right = 0, bottom = 0;
+
+    for (uint32_t y = 0; y < image.height; ++y)
+    {
+        for (uint32_t x = 0; x < image.width; ++x)
+        {
+            if (image.pixels[y * image.width + x] != shown.pixels[y * image.width + x])
+            {
+                left = std::min(left, x);
+                right = std::max(right, x + 1);
+                top = std::min(top, y);
+                bottom = std::max(bottom, y + 1);
+            }
+        }
+    }
+
+    if (left >= right)
+    {
+        left = top = 0;
+        right = bottom = 1;
+    }
+
+    std::vector<uint8_t> pixels;
+
+    for (uint32_t y = top; y < bottom; ++y)
+    {
+        pixels.insert(pixels.end(), image.pixels.begin() + y * image.width + left, image.pixels.begin() + y * image.width + right);
+    }
+
+    out.push_back(0x21); // graphic control: keep the frame underneath, delay
+    out.push_back(0xF9);
+    out.push_back(4);
+    out.push_back(1 << 2);
+    put_u16(out, std::min<uint32_t>(delay, 0xFFFF));
+    out.push_back(0);
+    out.push_back(0);
+
+    out.push_back(0x2C);
+    put_u16(out, left);
+    put_u16(out, top);
+    put_u16(out, right - left);
+    put_u16(out, bottom - top);
+    out.push_back(0);
+    gif_lzw(pixels, out);
+
+    shown.pixels = image.pixels;
+}
+
+static uint32_t
+crc32(const uint8_t *data, size_t size, uint32_t crc)
+{
+    static uint32_t table[256];
+
+    if (!table[1])
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t value = i;
+
+            for (int j = 0; j < 8; ++j)
+            {
+                value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            }
+
+            table[i] = value;
+        }
+    }
+
+    crc = ~crc;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void
+put_u32_be(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void
+png_chunk(const char *type, const std::vector<uint8_t> &data, std::vector<uint8_t> &out)
+{
+    put_u32_be(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32_be(out, crc32(&out[start], out.size() - start, 0));
+}
+
+// 2 bit palette rows in stored deflate blocks, the frames are small and this keeps the tool free of zlib
+static bool
+write_png(const char *path, const Image &image)
+{
+    uint32_t row_bytes = (image.width * 2 + 7) / 8;
+    std::vector<uint8_t> raw;
+
+    for (uint32_t y = 0; y < image.height; ++y)
+    {
+        raw.push_back(0); // no filter
+        size_t start = raw.size();
+        raw.resize(start + row_bytes, 0);
+
+        for (uint32_t x = 0; x < image.width; ++x)
+        {
+            raw[start + x / 4] |= static_cast<uint8_t>(image.pixels[y * image.width + x] << (6 - x % 4 * 2));
+        }
+    }
+
+    std::vector<uint8_t> header;
+    put_u32_be(header, image.width);
+    put_u32_be(header, image.height);
+    header.push_back(2); // bit depth
+    header.push_back(3); // palette
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    std::vector<uint8_t> palette;
+
+    for (const uint8_t *colour : PALETTE)
+    {
+        palette.insert(palette.end(), colour, colour + 3);
+    }
+
+    std::vector<uint8_t> deflate = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+
+    for (size_t i = 0; i < raw.size(); i += PNG_STORED_BLOCK)
+    {
+        uint16_t length = static_cast<uint16_t>(std::min(PNG_STORED_BLOCK, raw.size() - i));
+        deflate.push_back(i + length == raw.size() ? 1 : 0);
+        deflate.push_back(static_cast<uint8_t>(length));
+        deflate.push_back(static_cast<uint8_t>(length >> 8));
+        deflate.push_back(static_cast<uint8_t>(~length));
+        deflate.push_back(static_cast<uint8_t>(~length >> 8));
+        deflate.insert(deflate.end(), raw.begin() + i, raw.begin() + i + length);
+    }
+
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    put_u32_be(deflate, b << 16 | a);
+
+    static const uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> out(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+    png_chunk("IHDR", header, out);
+    png_chunk("PLTE", palette, out);
+    png_chunk("IDAT", deflate, out);
+    png_chunk("IEND", std::vector<uint8_t>(), out);
+
+    FILE *file = std::fopen(path, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Centiseconds since power-on of a tick, the GIF delays are differences of these so the rounding never adds up
+static uint64_t
+tick_centiseconds(uint64_t tick)
+{
+    return (tick * 100 + TIMER_HZ / 2) / TIMER_HZ;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *stream_path = NULL;
+    char *gif_path = NULL;
+    char *png_prefix = NULL;
+    int scale = DEFAULT_SCALE;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "gif", &value) && value)
+        {
+            gif_path = value;
+        }
+        else if (parse_option(argv[i], "png", &value) && value)
+        {
+            png_prefix = value;
+        }
+        else if (parse_option(argv[i], "scale", &value))
+        {
+            scale = static_cast<int>(std::min<uint64_t>(std::max<uint64_t>(parse_u64(value, DEFAULT_SCALE), 1), MAX_SCALE));
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            stream_path = argv[i];
+        }
+    }
+
+    if (!stream_path || (!gif_path && !png_prefix))
+    {
+        std::fprintf(stderr, "usage: ./bin/frames STREAM [--gif=FILE.gif] [--png=PREFIX] [--scale=N]\n");
+        return 1;
+    }
+
+    // A first pass finds out whether high resolution pixels need an even scale
+    Frames_file *frames = frames_open(stream_path);
+
+    if (!frames)
+    {
+        std::fprintf(stderr, "Can't read %s, it is missing or not a frame stream\n", stream_path);
+        return 1;
+    }
+
+    Recorded_frame *frame = reinterpret_cast<Recorded_frame*>(calloc(1, sizeof(Recorded_frame)));
+    uint64_t count = 0;
+    bool hires = false;
+
+    while (frames_read(frames, *frame))
+    {
+        hires |= (frame->format & FRAME_HIRES) != 0;
+        ++count;
+    }
+
+    frames_close(frames);
+    frames = frames_open(stream_path);
+    scale = hires ? (scale + 1) / 2 * 2 : scale;
+
+    Image image;
+    image.width = SCREEN_WIDTH * scale;
+    image.height = SCREEN_HEIGHT * scale;
+    image.pixels.assign(image.width * image.height, 0);
+
+    // The display is blank until the first frame, GIF frames shorter than MIN_GIF_DELAY give way to the next one
+    Image shown = image;
+    Image pending = image;
+    uint64_t pending_tick = 0;
+    uint64_t gif_frames = 0;
+    std::vector<uint8_t> gif;
+
+    if (gif_path)
+    {
+        gif_header(image, gif);
+    }
+
+    for (uint64_t i = 0; frames_read(frames, *frame); ++i)
+    {
+        draw_frame(*frame, scale, image);
+
+        if (png_prefix)
+        {
+            char path[4096];
+            std::snprintf(path, sizeof(path), "%s%06llu.png", png_prefix, static_cast<unsigned long long>(i));
+
+            if (!write_png(path, image))
+            {
+                std::fprintf(stderr, "Can't write %s\n", path);
+                return 1;
+            }
+        }
+
+        if (gif_path)
+        {
+            uint64_t delay = tick_centiseconds(frame->tick) - tick_centiseconds(pending_tick);
+
+            if (delay >= MIN_GIF_DELAY)
+            {
+                gif_frame(pending, shown, static_cast<uint32_t>(delay), gif);
+                pending_tick = frame->tick;
+                ++gif_frames;
+            }
+
+            std::swap(pending.pixels, image.pixels);
+        }
+    }
+
+    frames_close(frames);
+    free(frame);
+
+    if (gif_path)
+    {
+        gif_frame(pending, shown, LAST_GIF_DELAY, gif);
+        gif.push_back(0x3B);
+        ++gif_frames;
+
+        FILE *file = std::fopen(gif_path, "wb");
+        bool written = file && std::fwrite(gif.data(), 1, gif.size(), file) == gif.size();
+
+        if (!file || std::fclose(file) != 0 || !written)
+        {
+            std::fprintf(stderr, "Can't write %s\n", gif_path);
+            return 1;
+        }
+    }
+
+    std::printf("%llu frames", static_cast<unsigned long long>(count));
+
+    if (gif_path)
+    {
+        std::printf(", %llu in the GIF, %llu bytes", static_cast<unsigned long long>(gif_frames),
+            static_cast<unsigned long long>(gif.size()));
+    }
+
+    std::printf("\n");
+    return 0;
+}
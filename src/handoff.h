@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free handoffs between exactly one producer thread and one consumer thread, neither side ever waits
+
+// The writer fills its back slot and publishes it, the reader takes the newest published slot. A slot published
+// while the previous one was still unread replaces it, which counts as a dropped frame
+template <typename T>
+struct Triple_buffer {
+    static const uint8_t FRESH = 4; // set on middle while it holds a slot the reader hasn't taken
+
+    T slots[3];
+    std::atomic<uint8_t> middle;
+    uint8_t back; // only touched by the writer
+    uint8_t front; // only touched by the reader
+
+    Triple_buffer() : middle(1), back(0), front(2) {}
+
+    T &write_slot() { return slots[back]; }
+
+    // Returns true when the slot published before this one was never read
+    bool
+    publish()
+    {
+        uint8_t old = middle.exchange(static_cast<uint8_t>(back | FRESH), std::memory_order_acq_rel);
+        back = old & 3;
+        return (old & FRESH) != 0;
+    }
+
+    // The newest slot, or NULL when nothing was published since the last call
+    const T *
+    acquire()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return NULL;
+        }
+
+        uint8_t old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & 3;
+        return &slots[front];
+    }
+};
+
+// Bounded ring, SIZE must be a power of two. The indices run freely and wrap through the mask
+template <typename T, uint32_t SIZE>
+struct Spsc_queue {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    T items[SIZE];
+    alignas(64) std::atomic<uint32_t> head; // next item to pop, written by the consumer
+    alignas(64) std::atomic<uint32_t> tail; // next free item, written by the producer
+
+    Spsc_queue() : head(0), tail(0) {}
+
+    // False when full, the item is not queued
+    bool
+    push(const T &item)
+    {
+        uint32_t next = tail.load(std::memory_order_relaxed);
+
+        if (next - head.load(std::memory_order_acquire) == SIZE)
+        {
+            return false;
+        }
+
+        items[next & (SIZE - 1)] = item;
+        tail.store(next + 1, std::memory_order_release);
+        return true;
+    }
+
+    // For items too big to copy twice: fill the slot claim returns, then commit it. NULL when full
+    T *
+    claim()
+    {
+        uint32_t next = tail.load(std::memory_order_relaxed);
+        return next - head.load(std::memory_order_acquire) == SIZE ? NULL : &items[next & (SIZE - 1)];
+    }
+
+    void
+    commit()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool
+    pop(T &item)
+    {
+        uint32_t first = head.load(std::memory_order_relaxed);
+
+        if (first == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = items[first & (SIZE - 1)];
+        head.store(first + 1, std::memory_order_release);
+        return true;
+    }
+
+    // The oldest item without copying it out, NULL when empty. It stays queued until release
+    const T *
+    peek()
+    {
+        uint32_t first = head.load(std::memory_order_relaxed);
+        return first == tail.load(std::memory_order_acquire) ? NULL : &items[first & (SIZE - 1)];
+    }
+
+    void
+    release()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Items queued, the other side can only move it one way: down for the producer and up for the consumer
+    uint32_t
+    size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
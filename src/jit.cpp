@@ -0,0 +1,818 @@
+#include "chip8.h"
+#include "jit.h"
+#include "quirks.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED 1
+#endif
+
+const size_t CODE_CACHE_SIZE = 1 << 20;
+const int MAX_BLOCK_INSTRUCTIONS = 64;
+const size_t MAX_INSTRUCTION_CODE = 64; // longest sequence any single instruction emits, exits included
+const size_t MAX_BLOCK_CODE = MAX_BLOCK_INSTRUCTIONS * MAX_INSTRUCTION_CODE + 64;
+const size_t BLOCK_ALIGN = 32; // blocks start on their own fetch line, so a tight loop runs the same wherever it was translated
+const int MAX_LINKS = 16384;
+const uint32_t NO_LINK = 0xFFFFFFFF;
+
+struct Block {
+    uint8_t *code; // NULL when the address hasn't been translated
+    uint16_t end; // one past the last byte translated
+    uint16_t count; // instructions executed every time the block runs, skips only change where it exits
+};
+
+// A block exit whose target is known at translation time, it jumps to the stub until the target is patched in
+struct Link {
+    uint8_t *patch; // rel32 of the exit jump
+    uint8_t *stub; // returns to the dispatcher with the target pc
+    uint16_t target;
+};
+
+// Generated code is entered as enter(machine, block code, budget) and returns the pc to continue from
+typedef uint16_t (*Enter_code)(Chip8 *c, uint8_t *code, uint32_t budget);
+
+struct Jit {
+    uint8_t *code_cache;
+    size_t code_used;
+    Enter_code enter;
+    uint8_t *exit;
+    size_t runtime_size; // enter/exit routines at the start of the cache, kept across flushes
+
+    uint32_t budget; // instructions left when generated code returned
+    uint32_t last_link; // link taken to leave generated code, NO_LINK for dynamic exits
+    uint64_t end_cycle; // instruction count the batch ends on, less what's left is the instruction running
+    bool waiting; // video was written and no frame has been taken since, only with the recorder or spectators
+    uint64_t frame_cycle; // instruction count of the tick the waiting frame is due on
+
+    Block blocks[MEMORY_SIZE]; // keyed by the pc the block starts at
+    uint8_t coverage[MEMORY_SIZE]; // number of blocks translated from each byte
+    Link links[MAX_LINKS];
+    uint32_t link_count;
+};
+
+#if JIT_SUPPORTED
+
+// Register use inside generated code: rbx = Chip8 *, r12d = instructions left in the batch, eax/ecx/edx scratch
+enum REGS {
+    EAX = 0, ECX = 1, EDX = 2, EBX = 3
+};
+
+struct Emitter {
+    uint8_t *cursor;
+};
+
+static void
+emit8(Emitter &e, uint8_t value)
+{
+    *e.cursor++ = value;
+}
+
+static void
+emit16(Emitter &e, uint16_t value)
+{
+    std::memcpy(e.cursor, &value, sizeof(value));
+    e.cursor += sizeof(value);
+}
+
+static void
+emit32(Emitter &e, uint32_t value)
+{
+    std::memcpy(e.cursor, &value, sizeof(value));
+    e.cursor += sizeof(value);
+}
+
+static void
+emit64(Emitter &e, uint64_t value)
+{
+    std::memcpy(e.cursor, &value, sizeof(value));
+    e.cursor += sizeof(value);
+}
+
+static void
+patch_rel32(uint8_t *patch, uint8_t *target)
+{
+    int32_t rel = static_cast<int32_t>(target - (patch + 4));
+    std::memcpy(patch, &rel, sizeof(rel));
+}
+
+// Emits a jump or jcc with a rel32 to target and returns where the rel32 lives
+static uint8_t *
+emit_jump(Emitter &e, uint8_t *target, uint8_t condition = 0)
+{
+    if (condition)
+    {
+        emit8(e, 0x0F); emit8(e, condition);
+    }
+    else
+    {
+        emit8(e, 0xE9);
+    }
+
+    uint8_t *patch = e.cursor;
+    emit32(e, 0);
+
+    if (target)
+    {
+        patch_rel32(patch, target);
+    }
+
+    return patch;
+}
+
+// opcode followed by a [rbx + disp32] operand, the machine pointer always lives in rbx
+static void
+emit_mem(Emitter &e, uint8_t opcode, int reg, size_t disp)
+{
+    emit8(e, opcode);
+    emit8(e, 0x80 | (reg << 3) | EBX);
+    emit32(e, static_cast<uint32_t>(disp));
+}
+
+static size_t
+reg_disp(uint8_t reg)
+{
+    return offsetof(Chip8, registers) + reg;
+}
+
+static void emit_load_al(Emitter &e, uint8_t reg) { emit_mem(e, 0x8A, EAX, reg_disp(reg)); } // mov al, [Vreg]
+static void emit_store_al(Emitter &e, uint8_t reg) { emit_mem(e, 0x88, EAX, reg_disp(reg)); } // mov [Vreg], al
+
+static void
+emit_movzx(Emitter &e, int dst, uint8_t reg) // movzx dst, byte [Vreg]
+{
+    emit8(e, 0x0F);
+    emit_mem(e, 0xB6, dst, reg_disp(reg));
+}
+
+// Leaves generated code with eax = pc, ecx = link taken
+static void
+emit_dynamic_exit(Jit *jit, Emitter &e)
+{
+    emit8(e, 0xB9); emit32(e, NO_LINK); // mov ecx, NO_LINK
+    emit_jump(e, jit->exit);
+}
+
+static void
+emit_exit(Jit *jit, Emitter &e, uint16_t next)
+{
+    emit8(e, 0xB8); emit32(e, next); // mov eax, next
+    emit_dynamic_exit(jit, e);
+}
+
+// A jump that can later be patched straight into the target block
+static void
+emit_linked_exit(Jit *jit, Emitter &e, uint16_t target)
+{
+    uint8_t *patch = emit_jump(e, NULL);
+    uint8_t *stub = e.cursor;
+    patch_rel32(patch, stub);
+
+    Link &link = jit->links[jit->link_count];
+    link.patch = patch;
+    link.stub = stub;
+    link.target = target & MEMORY_MASK;
+
+    emit8(e, 0xB8); emit32(e, target); // mov eax, target
+    emit8(e, 0xB9); emit32(e, jit->link_count); // mov ecx, link
+    emit_jump(e, jit->exit);
+
+    ++jit->link_count;
+}
+
+// Flags are already set, condition is the jcc taken when the next instruction is skipped
+static void
+emit_skip_exits(Jit *jit, Emitter &e, uint16_t next, uint8_t condition)
+{
+    uint8_t *skip = emit_jump(e, NULL, condition);
+    emit_linked_exit(jit, e, next);
+    patch_rel32(skip, e.cursor);
+    emit_linked_exit(jit, e, next + 2);
+}
+
+// Anything not worth generating inline is run on the interpreter one instruction at a time
+static uint16_t
+interpret_one(Chip8 *c, uint32_t address)
+{
+    c->pc = address;
+    c->interpret(1);
+    return c->pc;
+}
+
+static void
+emit_interpret(Emitter &e, uint16_t address)
+{
+#if defined(_WIN32)
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xD9); // mov rcx, rbx
+    emit8(e, 0xBA); emit32(e, address); // mov edx, address
+#else
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF); // mov rdi, rbx
+    emit8(e, 0xBE); emit32(e, address); // mov esi, address
+#endif
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, reinterpret_cast<uint64_t>(&interpret_one)); // mov rax, interpret_one
+    emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+}
+
+// Until the next write the display is the one of every tick since the last, so the frame due on the tick after
+// a write is taken whenever the batch gets past that tick. One that finds no room is offered again on the next
+// tick, as run does
+static void
+take_frames(Chip8 &c, uint64_t cycle)
+{
+    Jit *jit = c.jit;
+
+    while (jit->waiting && cycle >= jit->frame_cycle)
+    {
+        c.tick_until(jit->frame_cycle);
+        c.offer_frame();
+        jit->waiting = c.frame_waiting();
+        jit->frame_cycle = tick_cycle(c.ticks + 1, c.ips);
+    }
+}
+
+// Batches may run across ticks, so the timers are brought up to date before an instruction uses them. left is
+// the budget still to run, this instruction included
+static void
+tick_until(Chip8 *c, uint32_t left)
+{
+    take_frames(*c, c->jit->end_cycle - left);
+    c->tick_until(c->jit->end_cycle - left);
+}
+
+// With the recorder or spectators, before an instruction that writes video. A frame still waiting once the batch
+// caught up with the ticks is due on the next one, which is also the one after this write
+static void
+video_write(Chip8 *c, uint32_t left)
+{
+    take_frames(*c, c->jit->end_cycle - left);
+
+    if (c->jit->waiting)
+    {
+        return;
+    }
+
+    c->tick_until(c->jit->end_cycle - left);
+    c->jit->waiting = true;
+    c->jit->frame_cycle = tick_cycle(c->ticks + 1, c->ips);
+}
+
+// Calls function(c, left). r12d is already down by the whole block, so what's left at this instruction is
+// r12d + count - index. The block's count isn't known yet, it's added to the returned displacement once it is
+static uint8_t *
+emit_left_call(Emitter &e, uint16_t index, void (*function)(Chip8 *, uint32_t))
+{
+#if defined(_WIN32)
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xD9); // mov rcx, rbx
+    emit8(e, 0x41); emit8(e, 0x8D); emit8(e, 0x94); emit8(e, 0x24); // lea edx, [r12 + disp32]
+#else
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF); // mov rdi, rbx
+    emit8(e, 0x41); emit8(e, 0x8D); emit8(e, 0xB4); emit8(e, 0x24); // lea esi, [r12 + disp32]
+#endif
+    uint8_t *patch = e.cursor;
+    emit32(e, static_cast<uint32_t>(-static_cast<int32_t>(index)));
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, reinterpret_cast<uint64_t>(function)); // mov rax, function
+    emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+    return patch;
+}
+
+// Control flow only the interpreter knows, the dispatcher continues from the pc it leaves
+static void
+emit_interpreted_exit(Jit *jit, Emitter &e, uint16_t address)
+{
+    emit_interpret(e, address);
+    emit_dynamic_exit(jit, e);
+}
+
+// enter saves the callee-saved registers it uses and jumps into the block, exit stores what's left of the budget
+static void
+emit_runtime(Jit *jit)
+{
+    Emitter e = { jit->code_cache };
+
+    jit->enter = reinterpret_cast<Enter_code>(e.cursor);
+    emit8(e, 0x53); // push rbx
+    emit8(e, 0x41); emit8(e, 0x54); // push r12
+    emit8(e, 0x41); emit8(e, 0x55); // push r13 - keeps rsp 16 byte aligned
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEC); emit8(e, 0x20); // sub rsp, 32 - Win64 shadow space for helper calls
+#if defined(_WIN32)
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xCB); // mov rbx, rcx
+    emit8(e, 0x45); emit8(e, 0x89); emit8(e, 0xC4); // mov r12d, r8d
+    emit8(e, 0xFF); emit8(e, 0xE2); // jmp rdx
+#else
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xFB); // mov rbx, rdi
+    emit8(e, 0x41); emit8(e, 0x89); emit8(e, 0xD4); // mov r12d, edx
+    emit8(e, 0xFF); emit8(e, 0xE6); // jmp rsi
+#endif
+
+    jit->exit = e.cursor;
+    emit8(e, 0x48); emit8(e, 0xBA); emit64(e, reinterpret_cast<uint64_t>(&jit->budget)); // mov rdx, &budget
+    emit8(e, 0x44); emit8(e, 0x89); emit8(e, 0x22); // mov [rdx], r12d
+    emit8(e, 0x89); emit8(e, 0x4A); emit8(e, 0x04); // mov [rdx + 4], ecx - last_link follows budget
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC4); emit8(e, 0x20); // add rsp, 32
+    emit8(e, 0x41); emit8(e, 0x5D); // pop r13
+    emit8(e, 0x41); emit8(e, 0x5C); // pop r12
+    emit8(e, 0x5B); // pop rbx
+    emit8(e, 0xC3); // ret
+
+    jit->runtime_size = (e.cursor - jit->code_cache + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+}
+
+static void
+flush(Jit *jit)
+{
+    jit->code_used = jit->runtime_size;
+    jit->link_count = 0;
+    jit->last_link = NO_LINK;
+    std::memset(jit->blocks, 0, sizeof(jit->blocks));
+    std::memset(jit->coverage, 0, sizeof(jit->coverage));
+}
+
+// Everything that bumps video_writes
+static bool
+writes_video(uint8_t op)
+{
+    switch (op)
+    {
+        case OP_CLS:
+        case OP_DRW:
+        case OP_SCD:
+        case OP_SCU:
+        case OP_SCR:
+        case OP_SCL:
+        case OP_LOW:
+        case OP_HIGH:
+        case OP_DRW_EXT:
+        case OP_CLS_EXT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Translates straight-line code from start until a jump, skip, draw or store into memory ends the block
+static Block *
+translate(Jit *jit, Chip8 &c, uint16_t start)
+{
+    if (jit->code_used + MAX_BLOCK_CODE > CODE_CACHE_SIZE || jit->link_count + MAX_BLOCK_INSTRUCTIONS * 2 > MAX_LINKS)
+    {
+        flush(jit);
+    }
+
+    uint8_t *code = jit->code_cache + jit->code_used;
+    Emitter e = { code };
+
+    // Every block checks it fits what's left of the batch, so a batch ends on exactly the same instruction as the interpreter's
+    emit8(e, 0x41); emit8(e, 0x81); emit8(e, 0xFC); // cmp r12d, count
+    uint8_t *count_check = e.cursor;
+    emit32(e, 0);
+    uint8_t *bail = emit_jump(e, NULL, 0x82); // jb bail
+    emit8(e, 0x41); emit8(e, 0x81); emit8(e, 0xEC); // sub r12d, count
+    uint8_t *count_sub = e.cursor;
+    emit32(e, 0);
+
+    uint16_t address = start;
+    uint16_t count = 0;
+    bool terminated = false;
+    uint8_t *left_patches[MAX_BLOCK_INSTRUCTIONS];
+    int left_patch_count = 0;
+    Quirk_settings quirks = quirk_settings(c.quirks); // fixed for the machine, so decided here instead of in the code
+    bool watched = c.recorder || c.broadcast;
+
+    while (!terminated && count < MAX_BLOCK_INSTRUCTIONS && address + 1 < MEMORY_SIZE)
+    {
+        Instruction in = decode(c.memory[address] << 8 | c.memory[address + 1], c.mode);
+        uint16_t next = address + 2;
+
+        if (watched && writes_video(in.op))
+        {
+            left_patches[left_patch_count++] = emit_left_call(e, count, &video_write);
+        }
+
+        switch (in.op)
+        {
+            case OP_JMP:
+            case OP_SYS:
+                emit_linked_exit(jit, e, in.nnn);
+                terminated = true;
+                break;
+            case OP_CALL:
+                emit8(e, 0x0F); emit_mem(e, 0xB7, EAX, offsetof(Chip8, sp)); // movzx eax, word [sp]
+                emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F); // and eax, 15
+                emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x84); emit8(e, 0x43); // mov word [rbx + rax * 2 + stack], next
+                emit32(e, offsetof(Chip8, stack)); emit16(e, next);
+                emit8(e, 0x66); emit_mem(e, 0x83, 0, offsetof(Chip8, sp)); emit8(e, 1); // add word [sp], 1
+                emit_linked_exit(jit, e, in.nnn);
+                terminated = true;
+                break;
+            case OP_RET:
+                emit8(e, 0x0F); emit_mem(e, 0xB7, EAX, offsetof(Chip8, sp)); // movzx eax, word [sp]
+                emit8(e, 0x66); emit8(e, 0x83); emit8(e, 0xE8); emit8(e, 0x01); // sub ax, 1
+                emit8(e, 0x66); emit_mem(e, 0x89, EAX, offsetof(Chip8, sp)); // mov [sp], ax
+                emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F); // and eax, 15
+                emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x84); emit8(e, 0x43); // movzx eax, word [rbx + rax * 2 + stack]
+                emit32(e, offsetof(Chip8, stack));
+                emit_dynamic_exit(jit, e);
+                terminated = true;
+                break;
+            case OP_JMP_V0:
+                emit_movzx(e, EAX, quirks.jump_vx ? in.x : 0);
+                emit8(e, 0x05); emit32(e, in.nnn); // add eax, nnn
+                emit_dynamic_exit(jit, e);
+                terminated = true;
+                break;
+            case OP_SE_VX_NN:
+            case OP_SNE_VX_NN:
+                if (c.mode == MODE_XOCHIP) // skips F000 NNNN whole
+                {
+                    emit_interpreted_exit(jit, e, address);
+                    terminated = true;
+                    break;
+                }
+
+                emit_mem(e, 0x80, 7, reg_disp(in.x)); emit8(e, in.nn); // cmp byte [Vx], nn
+                emit_skip_exits(jit, e, next, in.op == OP_SE_VX_NN ? 0x84 : 0x85); // je / jne
+                terminated = true;
+                break;
+            case OP_SE_VX_VY:
+            case OP_SNE_VX_VY:
+                if (c.mode == MODE_XOCHIP)
+                {
+                    emit_interpreted_exit(jit, e, address);
+                    terminated = true;
+                    break;
+                }
+
+                emit_load_al(e, in.x);
+                emit_mem(e, 0x3A, EAX, reg_disp(in.y)); // cmp al, [Vy]
+                emit_skip_exits(jit, e, next, in.op == OP_SE_VX_VY ? 0x84 : 0x85);
+                terminated = true;
+                break;
+            case OP_SKP:
+            case OP_SKNP: // both skip when the key is down, matching the interpreter
+                if (c.mode == MODE_XOCHIP)
+                {
+                    emit_interpreted_exit(jit, e, address);
+                    terminated = true;
+                    break;
+                }
+
+                emit_movzx(e, EAX, in.x);
+                emit8(e, 0x80); emit8(e, 0xBC); emit8(e, 0x03); // cmp byte [rbx + rax + keypad], 0
+                emit32(e, offsetof(Chip8, keypad)); emit8(e, 0);
+                emit_skip_exits(jit, e, next, 0x85); // jne
+                terminated = true;
+                break;
+            case OP_LD_VX_K:
+            {
+                // Spins on itself while no key is down, the interpreter picks the key otherwise
+                emit8(e, 0x48); emit_mem(e, 0x8B, EAX, offsetof(Chip8, keypad)); // mov rax, [keypad]
+                emit8(e, 0x48); emit_mem(e, 0x0B, EAX, offsetof(Chip8, keypad) + 8); // or rax, [keypad + 8]
+                uint8_t *pressed = emit_jump(e, NULL, 0x85); // jnz pressed
+                emit_linked_exit(jit, e, address);
+                patch_rel32(pressed, e.cursor);
+                emit_interpret(e, address);
+                emit_linked_exit(jit, e, next);
+                terminated = true;
+            } break;
+            case OP_LD_I_LONG:
+            case OP_EXIT:
+                emit_interpreted_exit(jit, e, address);
+                terminated = true;
+                break;
+            case OP_DRW:
+            case OP_DRW_EXT:
+                emit_interpret(e, address);
+                emit_linked_exit(jit, e, next);
+                terminated = true;
+                break;
+            case OP_LD_B:
+            case OP_LD_I_VX:
+            case OP_SAVE_RANGE:
+                // The store may rewrite translated code, including this block, so always go back through the dispatcher
+                emit_interpret(e, address);
+                emit_exit(jit, e, next);
+                terminated = true;
+                break;
+            case OP_LD_VX_NN:
+                emit_mem(e, 0xC6, 0, reg_disp(in.x)); emit8(e, in.nn); // mov byte [Vx], nn
+                break;
+            case OP_ADD_VX_NN:
+                emit_mem(e, 0x80, 0, reg_disp(in.x)); emit8(e, in.nn); // add byte [Vx], nn
+                break;
+            case OP_LD_VX_VY:
+                emit_load_al(e, in.y);
+                emit_store_al(e, in.x);
+                break;
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+                emit_load_al(e, in.y);
+                emit_mem(e, in.op == OP_OR ? 0x08 : in.op == OP_AND ? 0x20 : 0x30, EAX, reg_disp(in.x)); // op [Vx], al
+
+                if (quirks.reset_vf)
+                {
+                    emit_mem(e, 0xC6, 0, reg_disp(0xF)); emit8(e, 0); // mov byte [VF], 0
+                }
+                break;
+            case OP_ADD_VX_VY:
+                emit_movzx(e, EAX, in.x);
+                emit_movzx(e, ECX, in.y);
+                emit8(e, 0x01); emit8(e, 0xC8); // add eax, ecx
+                emit8(e, 0x3D); emit32(e, 0xFF); // cmp eax, 0xFF
+                emit8(e, 0x0F); emit8(e, 0x93); emit8(e, 0xC2); // setae dl
+                emit_mem(e, 0x88, EDX, reg_disp(0xF)); // mov [VF], dl
+                emit_store_al(e, in.x);
+                break;
+            case OP_SUB:
+            case OP_SUBN:
+            {
+                // Same statement order as the interpreter, VF is written first and the operands are re-read after
+                uint8_t lhs = in.op == OP_SUB ? in.x : in.y;
+                uint8_t rhs = in.op == OP_SUB ? in.y : in.x;
+
+                emit_movzx(e, EAX, lhs);
+                emit_movzx(e, ECX, rhs);
+                emit8(e, 0x39); emit8(e, 0xC8); // cmp eax, ecx
+                emit8(e, 0x0F); emit8(e, 0x93); emit8(e, 0xC0); // setae al
+                emit_store_al(e, 0xF);
+                emit_load_al(e, lhs);
+                emit_mem(e, 0x2A, EAX, reg_disp(rhs)); // sub al, [rhs]
+                emit_store_al(e, in.x);
+            } break;
+            case OP_SHR:
+            case OP_SHL:
+            {
+                // VF is written first and the source re-read after, as in ops.inl
+                uint8_t source = quirks.shift_vy ? in.y : in.x;
+
+                emit_load_al(e, source);
+
+                if (in.op == OP_SHR)
+                {
+                    emit8(e, 0x24); emit8(e, 0x01); // and al, 1
+                }
+                else
+                {
+                    emit8(e, 0xC0); emit8(e, 0xE8); emit8(e, 0x07); // shr al, 7
+                }
+
+                emit_store_al(e, 0xF);
+                emit_load_al(e, source);
+                emit8(e, 0xD0); emit8(e, in.op == OP_SHR ? 0xE8 : 0xE0); // shr al, 1 / shl al, 1
+                emit_store_al(e, in.x);
+            } break;
+            case OP_LD_I:
+                emit8(e, 0x66); emit_mem(e, 0xC7, 0, offsetof(Chip8, index)); emit16(e, in.nnn); // mov word [I], nnn
+                break;
+            case OP_ADD_I:
+                emit_movzx(e, EAX, in.x);
+                emit8(e, 0x66); emit_mem(e, 0x01, EAX, offsetof(Chip8, index)); // add word [I], ax
+                break;
+            case OP_LD_F:
+                emit_movzx(e, EAX, in.x);
+                emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x80); // lea eax, [rax + rax * 4]
+                emit8(e, 0x66); emit_mem(e, 0x89, EAX, offsetof(Chip8, index)); // mov word [I], ax
+                break;
+            case OP_LD_VX_DT:
+                left_patches[left_patch_count++] = emit_left_call(e, count, &tick_until);
+                emit8(e, 0x66); emit_mem(e, 0x8B, EAX, offsetof(Chip8, delay_timer)); // mov ax, [delay_timer]
+                emit_store_al(e, in.x);
+                break;
+            case OP_LD_DT:
+            case OP_LD_ST:
+                left_patches[left_patch_count++] = emit_left_call(e, count, &tick_until);
+                emit_movzx(e, EAX, in.x);
+                emit8(e, 0x66); emit_mem(e, 0x89, EAX, in.op == OP_LD_DT ? offsetof(Chip8, delay_timer) : offsetof(Chip8, sound_timer)); // mov [timer], ax
+                break;
+            case OP_NOP:
+                break;
+            default: // OP_CLS, OP_RND, OP_LD_VX_I and the extended ops that only touch the display or registers
+                emit_interpret(e, address);
+                break;
+        }
+
+        address = next;
+        ++count;
+    }
+
+    if (count == 0)
+    {
+        return NULL;
+    }
+
+    if (!terminated)
+    {
+        emit_linked_exit(jit, e, address);
+    }
+
+    // Not enough budget left, hand the block's first instruction back to the dispatcher untouched
+    patch_rel32(bail, e.cursor);
+    emit_exit(jit, e, start);
+
+    std::memcpy(count_check, &count, sizeof(uint16_t));
+    std::memcpy(count_sub, &count, sizeof(uint16_t));
+
+    for (int i = 0; i < left_patch_count; ++i)
+    {
+        uint32_t left;
+        std::memcpy(&left, left_patches[i], sizeof(left));
+        left += count;
+        std::memcpy(left_patches[i], &left, sizeof(left));
+    }
+
+    jit->code_used = (jit->code_used + (e.cursor - code) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+
+    Block *block = &jit->blocks[start];
+    block->code = code;
+    block->end = address;
+    block->count = count;
+
+    for (uint16_t i = start; i < address; ++i)
+    {
+        ++jit->coverage[i];
+    }
+
+    return block;
+}
+
+Jit *
+jit_create()
+{
+#if defined(_WIN32)
+    void *code_cache = VirtualAlloc(NULL, CODE_CACHE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    void *code_cache = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code_cache == MAP_FAILED)
+    {
+        code_cache = NULL;
+    }
+#endif
+
+    if (!code_cache)
+    {
+        return NULL;
+    }
+
+    Jit *jit = reinterpret_cast<Jit*>(malloc(sizeof(Jit)));
+    jit->code_cache = reinterpret_cast<uint8_t*>(code_cache);
+    emit_runtime(jit);
+    flush(jit);
+
+    return jit;
+}
+
+void
+jit_destroy(Jit *jit)
+{
+#if defined(_WIN32)
+    VirtualFree(jit->code_cache, 0, MEM_RELEASE);
+#else
+    munmap(jit->code_cache, CODE_CACHE_SIZE);
+#endif
+    free(jit);
+}
+
+void
+jit_reset(Jit *jit)
+{
+    flush(jit);
+}
+
+uint32_t
+jit_execute(Chip8 &c, uint32_t count)
+{
+    Jit *jit = c.jit;
+    uint32_t executed = 0;
+    jit->end_cycle = c.cycles + count;
+    jit->waiting = c.frame_waiting();
+    jit->frame_cycle = tick_cycle(c.ticks + 1, c.ips);
+
+    while (executed < count)
+    {
+        c.pc &= MEMORY_MASK;
+        Block *block = &jit->blocks[c.pc];
+
+        if (!block->code)
+        {
+            block = translate(jit, c, c.pc);
+        }
+
+        if (!block || block->count > count - executed)
+        {
+            if (c.recorder || c.broadcast)
+            {
+                Instruction in = decode(c.memory[c.pc] << 8 | c.memory[(c.pc + 1) & MEMORY_MASK], c.mode);
+
+                if (writes_video(in.op))
+                {
+                    video_write(&c, count - executed);
+                }
+            }
+
+            tick_until(&c, count - executed);
+            executed += c.interpret(1);
+            continue;
+        }
+
+        // Runs block to block through patched links until the budget runs out or an exit needs the dispatcher
+        uint32_t budget = count - executed;
+        c.pc = jit->enter(&c, block->code, budget);
+        executed += budget - jit->budget;
+
+        if (jit->last_link != NO_LINK)
+        {
+            Link link = jit->links[jit->last_link];
+            uint32_t link_count = jit->link_count;
+            Block *target = &jit->blocks[link.target];
+
+            if (!target->code)
+            {
+                target = translate(jit, c, link.target);
+            }
+
+            // A flush while translating drops every link, including the one being resolved
+            if (target && jit->link_count >= link_count)
+            {
+                patch_rel32(link.patch, target->code);
+            }
+        }
+    }
+
+    return executed;
+}
+
+// Drops every block translated from the written byte and unpatches the links into them, their code stays in the
+// cache until the next flush so a block that rewrote itself can still return
+void
+jit_invalidate(Jit *jit, uint16_t address)
+{
+    if (!jit->coverage[address])
+    {
+        return;
+    }
+
+    int first = address - MAX_BLOCK_INSTRUCTIONS * 2 + 1;
+
+    for (int start = first < 0 ? 0 : first; start <= address; ++start)
+    {
+        Block *block = &jit->blocks[start];
+
+        if (block->code && block->end > address)
+        {
+            for (uint16_t i = start; i < block->end; ++i)
+            {
+                --jit->coverage[i];
+            }
+
+            for (uint32_t i = 0; i < jit->link_count; ++i)
+            {
+                if (jit->links[i].target == start)
+                {
+                    patch_rel32(jit->links[i].patch, jit->links[i].stub);
+                }
+            }
+
+            block->code = NULL;
+        }
+    }
+}
+
+#else
+
+Jit *
+jit_create()
+{
+    return NULL;
+}
+
+void
+jit_destroy(Jit *jit)
+{
+}
+
+void
+jit_reset(Jit *jit)
+{
+}
+
+uint32_t
+jit_execute(Chip8 &c, uint32_t count)
+{
+    return c.interpret(count);
+}
+
+void
+jit_invalidate(Jit *jit, uint16_t address)
+{
+}
+
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+#include "chip8.h"
+
+// Basic-block recompiler to native x86-64, the interpreter stays as the fallback for anything it can't run
+Jit *jit_create(); // NULL when the host can't run generated code
+void jit_destroy(Jit *jit);
+void jit_reset(Jit *jit); // drops every translation, for when the whole of memory is replaced
+uint32_t jit_execute(Chip8 &c, uint32_t count);
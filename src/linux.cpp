@@ -0,0 +1,321 @@
+#include "win32.h"
+#include "posix.h"
+#include "emulation.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+const uint64_t DEFAULT_HEADLESS_FRAMES = 60 * 10;
+const double KEY_RELEASE_TIME = 250; // terminals only report presses, a key is released once it stops repeating
+const double PRESENT_TIME = 1000.0 / 60;
+const double HOST_IDLE_TIME = 1000; // keys, frames and deadlines end the wait, this only bounds it
+const int TERMINAL_COLUMNS = 64;
+const int TERMINAL_ROWS = 32; // two pixel rows are drawn per terminal line
+
+struct Terminal {
+    termios original;
+    double key_time[Input_events::CODES::ESC + 1];
+    bool key_held[Input_events::CODES::ESC + 1];
+};
+
+static void
+enter_raw_mode(Terminal &terminal)
+{
+    tcgetattr(STDIN_FILENO, &terminal.original);
+
+    termios raw = terminal.original;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+    std::fputs("\x1b[?25l", stdout); // hide cursor
+    clear_console();
+}
+
+static void
+leave_raw_mode(Terminal &terminal)
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &terminal.original);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) & ~O_NONBLOCK);
+
+    std::fputs("\x1b[?25h\n", stdout);
+    std::fflush(stdout);
+}
+
+static void
+poll_terminal_input(Terminal &terminal, Input_events &input_events, double now)
+{
+    char buffer[64];
+    ssize_t count;
+
+    while ((count = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < count; ++i)
+        {
+            char c = buffer[i];
+            int code = -1;
+
+            if (c == 0x1B)
+            {
+                // A lone escape is the escape key, anything longer is an escape sequence we don't map
+                if (i + 1 < count)
+                {
+                    i = count;
+                    continue;
+                }
+
+                code = Input_events::CODES::ESC;
+            }
+            else if (c >= '0' && c <= '9')
+            {
+                code = Input_events::CODES::ZERO + (c - '0');
+            }
+            else if (c >= 'a' && c <= 'z')
+            {
+                code = Input_events::CODES::A + (c - 'a');
+            }
+            else if (c >= 'A' && c <= 'Z')
+            {
+                code = Input_events::CODES::A + (c - 'A');
+            }
+
+            if (code < 0)
+            {
+                continue;
+            }
+
+            if (!terminal.key_held[code])
+            {
+                input_events.event[code] = Input_events::STATE::DOWN;
+            }
+
+            terminal.key_held[code] = true;
+            terminal.key_time[code] = now;
+        }
+    }
+
+    for (int code = 0; code <= Input_events::CODES::ESC; ++code)
+    {
+        if (terminal.key_held[code] && now - terminal.key_time[code] >= KEY_RELEASE_TIME)
+        {
+            terminal.key_held[code] = false;
+            input_events.event[code] = Input_events::STATE::UP;
+        }
+    }
+}
+
+// ms until the first held key is released, HOST_IDLE_TIME when none is
+static double
+next_key_release(Terminal &terminal, double now)
+{
+    double timeout = HOST_IDLE_TIME;
+
+    for (int code = 0; code <= Input_events::CODES::ESC; ++code)
+    {
+        if (terminal.key_held[code])
+        {
+            timeout = std::min(timeout, terminal.key_time[code] + KEY_RELEASE_TIME - now);
+        }
+    }
+
+    return timeout;
+}
+
+// Samples the upscaled bottom-up frame back down to the display resolution and draws it with half blocks
+static void
+present_terminal(uint32_t *pixels, int width, int height)
+{
+    static char output[TERMINAL_ROWS / 2 * (TERMINAL_COLUMNS * 3 + 1) + 16];
+    char *cursor = output;
+
+    cursor += std::sprintf(cursor, "\x1b[H");
+
+    for (int y = 0; y < TERMINAL_ROWS; y += 2)
+    {
+        int top_row = height - 1 - (y * height / TERMINAL_ROWS + height / (TERMINAL_ROWS * 2));
+        int bottom_row = height - 1 - ((y + 1) * height / TERMINAL_ROWS + height / (TERMINAL_ROWS * 2));
+
+        for (int x = 0; x < TERMINAL_COLUMNS; ++x)
+        {
+            int column = x * width / TERMINAL_COLUMNS + width / (TERMINAL_COLUMNS * 2);
+            bool top = pixels[column + width * top_row] != 0;
+            bool bottom = pixels[column + width * bottom_row] != 0;
+
+            const char *glyph = top ? (bottom ? "\xE2\x96\x88" : "\xE2\x96\x80") : (bottom ? "\xE2\x96\x84" : " ");
+            size_t length = std::strlen(glyph);
+            std::memcpy(cursor, glyph, length);
+            cursor += length;
+        }
+
+        *cursor++ = '\n';
+    }
+
+    std::fwrite(output, 1, cursor - output, stdout);
+    std::fflush(stdout);
+}
+
+// The emulator runs on its own thread, this one only reads keys and draws whatever frame is newest. In between
+// it sleeps until a key, a new frame, the next present or a key release is due
+static int
+run_interactive(void *application, int width, int height)
+{
+    Pacer *pacer = pacer_create(true);
+    Emulation *emulation = pacer ? emulation_start(application, pacer) : NULL;
+
+    if (!emulation)
+    {
+        std::fprintf(stderr, "Can't start the emulation thread\n");
+        return 1;
+    }
+
+    uint32_t *pixels = reinterpret_cast<uint32_t*>(calloc(width * height, sizeof(uint32_t)));
+    Input_events input_events = {};
+    Terminal terminal = {};
+
+    enter_raw_mode(terminal);
+
+    double last_present = time_ms();
+    bool pending_present = false;
+    Dirty_rects dirty_rects = {};
+
+    while (emulation_running(emulation))
+    {
+        double now = time_ms();
+
+        poll_terminal_input(terminal, input_events, now);
+        emulation_send_input(emulation, input_events);
+
+        // Changes are drawn into pixels straight away but only shown at the terminal refresh rate
+        pending_present |= emulation_render(emulation, pixels, width, height, dirty_rects);
+
+        if (pending_present && now - last_present >= PRESENT_TIME)
+        {
+            present_terminal(pixels, width, height);
+            emulation_presented(emulation);
+            last_present = now;
+            pending_present = false;
+        }
+
+        double timeout = next_key_release(terminal, now);
+
+        if (pending_present)
+        {
+            timeout = std::min(timeout, last_present + PRESENT_TIME - now);
+        }
+
+        pacer_wait(pacer, timeout);
+    }
+
+    Emulation_stats stats;
+    emulation_stop(emulation, &stats);
+    pacer_destroy(pacer);
+    leave_raw_mode(terminal);
+    free(pixels);
+
+    print_emulation_stats(stats);
+
+    print_application_stats(application);
+
+    return 0;
+}
+
+// A movie without limits plays to its end
+static int
+run_headless(void *application, char *rom_path, uint64_t max_cycles, uint64_t max_frames, char *state_path, bool playing)
+{
+    if (!max_cycles && !max_frames && !playing)
+    {
+        max_frames = DEFAULT_HEADLESS_FRAMES;
+    }
+
+    Run_stats stats = {};
+
+    double start_time = time_ms();
+    bool limit_reached = run_application(application, max_cycles, max_frames, stats);
+    double elapsed = (time_ms() - start_time) / 1000;
+
+    std::printf("rom: %s\n", rom_path ? rom_path : "");
+    std::printf("cycles: %llu\n", static_cast<unsigned long long>(stats.cycles));
+    std::printf("frames: %llu\n", static_cast<unsigned long long>(stats.frames));
+    std::printf("seconds: %.6f\n", elapsed);
+    std::printf("instructions/sec: %.0f\n", elapsed > 0 ? stats.cycles / elapsed : 0.0);
+    std::printf("exit: %s\n", limit_reached ? "limit" : "stopped");
+    std::printf("hash: %016llx\n", static_cast<unsigned long long>(hash_application(application)));
+
+    print_application_stats(application);
+
+    if (state_path && !save_application(application, state_path))
+    {
+        std::fprintf(stderr, "Can't write %s\n", state_path);
+        return 1;
+    }
+
+    return limit_reached ? 0 : 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    bool headless = false;
+    uint64_t max_cycles = 0;
+    uint64_t max_frames = 0;
+    char *rom_path = NULL;
+    char *state_path = NULL;
+    bool playing = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "headless", &value))
+        {
+            headless = true;
+        }
+        else if (parse_option(argv[i], "cycles", &value))
+        {
+            max_cycles = parse_u64(value, 0);
+        }
+        else if (parse_option(argv[i], "frames", &value))
+        {
+            max_frames = parse_u64(value, 0);
+        }
+        else if (parse_option(argv[i], "save-state", &value))
+        {
+            state_path = value;
+        }
+        else if (parse_option(argv[i], "play", &value))
+        {
+            playing = true;
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0 && !rom_path)
+        {
+            rom_path = argv[i];
+        }
+    }
+
+    void *application = NULL;
+    int width = 0;
+    int height = 0;
+    const char *window_title = "Window";
+
+    if (!init_application(argc, argv, &application, &width, &height, &window_title) || !application)
+    {
+        message_box("Error", "Failed to start application");
+        return -1;
+    }
+
+    int result = headless ? run_headless(application, rom_path, max_cycles, max_frames, state_path, playing) : run_interactive(application, width, height);
+    destroy_application(application);
+
+    return result;
+}
@@ -0,0 +1,188 @@
+#include "movie.h"
+#include "codec.h"
+
+#include <cstdio>
+#include <cstring>
+
+const int MOVIE_HEADER_SIZE = 48;
+
+uint64_t
+hash_bytes(const uint8_t *data, uint64_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+uint16_t
+keypad_keys(const bool *keypad)
+{
+    uint16_t keys = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        keys |= static_cast<uint16_t>(keypad[i] ? 1 << i : 0);
+    }
+
+    return keys;
+}
+
+void
+movie_input(Movie &movie, Chip8 &c)
+{
+    if (!movie.playing)
+    {
+        uint16_t keys = keypad_keys(c.keypad);
+
+        if (keys != movie.keys)
+        {
+            Movie_event event = { c.cycles, keys };
+            movie.events.push_back(event);
+            movie.keys = keys;
+            movie.next = movie.events.size();
+        }
+
+        return;
+    }
+
+    // Past the end the player gets the keypad back
+    if (movie.next == movie.events.size() && c.cycles >= movie.end_cycle)
+    {
+        return;
+    }
+
+    while (movie.next < movie.events.size() && movie.events[movie.next].cycle <= c.cycles)
+    {
+        movie.keys = movie.events[movie.next++].keys;
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+        c.keypad[i] = (movie.keys >> i) & 1;
+    }
+}
+
+uint64_t
+movie_next_cycle(const Movie &movie)
+{
+    return movie.playing && movie.next < movie.events.size() ? movie.events[movie.next].cycle : UINT64_MAX;
+}
+
+void
+movie_seek(Movie &movie, uint64_t cycle)
+{
+    size_t next = 0;
+
+    while (next < movie.events.size() && movie.events[next].cycle <= cycle)
+    {
+        ++next;
+    }
+
+    movie.next = next;
+    movie.keys = next ? movie.events[next - 1].keys : 0;
+
+    // A recording continues from here, the changes after it belong to the future that was rewound
+    if (!movie.playing)
+    {
+        movie.events.resize(next);
+    }
+}
+
+bool
+movie_write(const Movie &movie, const char *path)
+{
+    FILE *file = std::fopen(path, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE] = {};
+    put_le(header, MOVIE_MAGIC, 4);
+    put_le(header + 4, MOVIE_VERSION, 4);
+    put_le(header + 8, movie.rom_hash, 8);
+    put_le(header + 16, movie.seed, 4);
+    put_le(header + 20, movie.ips, 4);
+    put_le(header + 24, movie.end_cycle, 8);
+    put_le(header + 32, movie.events.size(), 8);
+    put_le(header + 40, movie.mode, 1);
+    put_le(header + 41, movie.quirks, 1);
+
+    bool written = std::fwrite(header, sizeof(header), 1, file) == 1;
+    uint64_t previous = 0;
+
+    for (const Movie_event &event : movie.events)
+    {
+        uint8_t record[12];
+        size_t length = put_count(record, event.cycle - previous);
+        previous = event.cycle;
+        put_le(record + length, event.keys, 2);
+        written = written && std::fwrite(record, length + 2, 1, file) == 1;
+    }
+
+    return std::fclose(file) == 0 && written;
+}
+
+bool
+movie_read(Movie &movie, const char *path)
+{
+    FILE *file = std::fopen(path, "rb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE];
+    bool valid = std::fread(header, sizeof(header), 1, file) == 1 && get_le(header, 4) == MOVIE_MAGIC;
+    uint64_t version = valid ? get_le(header + 4, 4) : 0;
+
+    if (version < 2 || version > MOVIE_VERSION)
+    {
+        std::fclose(file);
+        return false;
+    }
+
+    movie.playing = true;
+    movie.rom_hash = get_le(header + 8, 8);
+    movie.seed = static_cast<uint32_t>(get_le(header + 16, 4));
+    movie.ips = static_cast<uint32_t>(get_le(header + 20, 4));
+    movie.end_cycle = get_le(header + 24, 8);
+    movie.mode = static_cast<uint8_t>(get_le(header + 40, 1));
+    movie.quirks = static_cast<uint8_t>(get_le(header + 41, 1)); // zero in version 2, the mode was 8 bytes
+    movie.events.clear();
+    movie.next = 0;
+
+    // Settings the emulator couldn't have recorded with
+    if (movie.ips < MIN_IPS || movie.ips > MAX_IPS || movie.mode >= MODE_COUNT || movie.quirks >= QUIRK_PROFILE_COUNT)
+    {
+        std::fclose(file);
+        return false;
+    }
+
+    movie.keys = 0;
+
+    uint64_t count = get_le(header + 32, 8);
+    uint64_t cycle = 0;
+    bool complete = true;
+
+    for (uint64_t i = 0; i < count && complete; ++i)
+    {
+        uint64_t delta;
+        uint8_t keys[2];
+        complete = read_count(file, &delta) && std::fread(keys, sizeof(keys), 1, file) == 1;
+        cycle += delta;
+
+        Movie_event event = { cycle, static_cast<uint16_t>(get_le(keys, 2)) };
+        movie.events.push_back(event);
+    }
+
+    std::fclose(file);
+    return complete;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "chip8.h"
+
+#include <vector>
+
+// Input movies: every keypad change stamped with the instruction count it happened at, plus what the run
+// depends on besides input (ROM, CXNN seed, instructions per second, instruction set, quirks). Played back from power-on they reproduce
+// the recorded run bit for bit on any core and at any host speed.
+// The file is a fixed header followed by one (LEB128 cycles since the previous change, 16 bit keypad) per change
+const uint32_t MOVIE_MAGIC = 0x564D3843; // "C8MV" in a little-endian file
+const uint32_t MOVIE_VERSION = 3; // 2 added the mode, 3 the quirk profile
+
+struct Movie_event {
+    uint64_t cycle;
+    uint16_t keys; // bit k set while key k is held
+};
+
+struct Movie {
+    bool playing; // false while recording
+    uint64_t rom_hash;
+    uint32_t seed;
+    uint32_t ips;
+    uint8_t mode; // MODES
+    uint8_t quirks; // QUIRK_PROFILES
+    uint64_t end_cycle; // where the recording was stopped
+    std::vector<Movie_event> events;
+    size_t next; // first event not yet applied or, while recording, the number kept
+    uint16_t keys; // keypad as of the last event
+    const char *path; // a recording is written here when the emulator shuts down
+};
+
+uint64_t hash_bytes(const uint8_t *data, uint64_t size); // FNV-1a, identifies ROMs and compares final states
+uint16_t keypad_keys(const bool *keypad);
+
+// Called before every run of instructions: records a change of keypad, or applies every event that is due and
+// holds the movie's keys so the host's input can't leak into playback
+void movie_input(Movie &movie, Chip8 &c);
+uint64_t movie_next_cycle(const Movie &movie); // cycle of the next event to play, UINT64_MAX when none
+void movie_seek(Movie &movie, uint64_t cycle); // after rewinding, recording continues or playback resumes from cycle
+bool movie_write(const Movie &movie, const char *path);
+// False on a missing file, wrong magic or version, settings out of range, or a truncated one. Version 2 movies play with legacy quirks
+bool movie_read(Movie &movie, const char *path);
@@ -0,0 +1,288 @@
+// Instruction semantics shared by the interpreter cores, each core defines OP(name) to start an op and NEXT to finish it.
+// Bodies run inside a Chip8 member with the decoded instruction in `in` and the pc of the next instruction in `address`.
+// QUIRKS is the core's profile type (chip8.h), its members are constants so the branches on them compile away.
+// The batch engine runs them on a view of one lane that provides the same members, CHIP-8 mode only, so the
+// SUPER-CHIP and XO-CHIP ops live in ops_extended.inl
+
+OP(OP_CLS) // clear the screen
+    ++video_writes;
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        for (int j = 0; j < SCREEN_WIDTH / TILE_WIDTH; ++j)
+        {
+            if ((video[i] << (j * TILE_WIDTH)) >> (SCREEN_WIDTH - TILE_WIDTH))
+            {
+                dirty[i] |= 0x80 >> j;
+            }
+        }
+
+        video[i] = 0;
+    }
+NEXT
+
+OP(OP_RET) // return from routine, the stack wraps like the batch engine's so a runaway ROM stays inside it
+    address = stack[--sp & 0xF];
+NEXT
+
+OP(OP_SYS) // call machine code routine, Not necessary for most ROMs
+    address = in.nnn;
+NEXT
+
+OP(OP_JMP) // jmp to address
+    address = in.nnn;
+NEXT
+
+OP(OP_CALL) // call subroutine
+    stack[sp & 0xF] = address;
+    ++sp;
+    address = in.nnn;
+NEXT
+
+OP(OP_SE_VX_NN) // Vx == NN skip instruction
+    if (registers[in.x] == in.nn)
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_SNE_VX_NN) // Vx != NN skip instruction
+    if (registers[in.x] != in.nn)
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_SE_VX_VY) // Vx == Vy skip instruction
+    if (registers[in.x] == registers[in.y])
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_LD_VX_NN) // Set Vx to NN
+    registers[in.x] = in.nn;
+NEXT
+
+OP(OP_ADD_VX_NN) // Add NN to Vx
+    registers[in.x] += in.nn;
+NEXT
+
+OP(OP_LD_VX_VY) // Assign
+    registers[in.x] = registers[in.y];
+NEXT
+
+OP(OP_OR) // Bit OR
+    registers[in.x] |= registers[in.y];
+
+    if (QUIRKS::reset_vf)
+    {
+        registers[0xF] = 0;
+    }
+NEXT
+
+OP(OP_AND) // Bit AND
+    registers[in.x] &= registers[in.y];
+
+    if (QUIRKS::reset_vf)
+    {
+        registers[0xF] = 0;
+    }
+NEXT
+
+OP(OP_XOR) // Bit XOR
+    registers[in.x] ^= registers[in.y];
+
+    if (QUIRKS::reset_vf)
+    {
+        registers[0xF] = 0;
+    }
+NEXT
+
+OP(OP_ADD_VX_VY) // VX += VY - VF is set to 1 when there's an overflow, and to 0 when there is not
+{
+    uint16_t val = registers[in.x] + registers[in.y];
+    registers[0xF] = val >= 0xFF ? 1 : 0;
+    registers[in.x] = val & 0xFF;
+}
+NEXT
+
+OP(OP_SUB) // VX -= Vy - VF is set to 1 if VX >= VY and 0 if not
+    registers[0xF] = registers[in.x] >= registers[in.y] ? 1 : 0;
+    registers[in.x] -= registers[in.y];
+NEXT
+
+OP(OP_SHR) // Store the least significant bit of VX (or VY) in VF and then shift it into VX to the right by 1
+    registers[0xF] = registers[QUIRKS::shift_vy ? in.y : in.x] & 0x1;
+    registers[in.x] = registers[QUIRKS::shift_vy ? in.y : in.x] >> 1;
+NEXT
+
+OP(OP_SUBN) // VX = VY - VX - VF set to 1 if VY >= VX
+    registers[0xF] = registers[in.y] >= registers[in.x] ? 1 : 0;
+    registers[in.x] = registers[in.y] - registers[in.x];
+NEXT
+
+OP(OP_SHL) // Stores the most significant bit of VX (or VY) in VF and then shifts it into VX to the left by 1
+    registers[0xF] = (registers[QUIRKS::shift_vy ? in.y : in.x] & 0x80) >> 7;
+    registers[in.x] = registers[QUIRKS::shift_vy ? in.y : in.x] << 1;
+NEXT
+
+OP(OP_SNE_VX_VY) // Vx != Vy skip instruction
+    if (registers[in.x] != registers[in.y])
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_LD_I) // Set I to address NNN
+    index = in.nnn;
+NEXT
+
+OP(OP_JMP_V0) // jmp to V0 + NNN, or to VX + XNN on SUPER-CHIP
+    address = registers[QUIRKS::jump_vx ? in.x : 0] + in.nnn;
+NEXT
+
+OP(OP_RND) // Vx = rand() & NN, rand() is the instance's own generator
+    registers[in.x] = (rand() % 255) & in.nn;
+NEXT
+
+OP(OP_DRW) // Draw, what happens at the right and bottom edges depends on QUIRKS::sprites
+{
+    uint8_t height = in.nn & 0x000F;
+
+    uint8_t pos_x = registers[in.x] % SCREEN_WIDTH;
+    uint8_t pos_y = registers[in.y] % SCREEN_HEIGHT;
+    ++video_writes;
+    bool wraps = QUIRKS::sprites == SPRITES_WRAP && pos_x > SCREEN_WIDTH - 8;
+
+    // A sprite byte covers at most two tiles, the second is shifted out at the right edge unless it wraps to the first
+    uint8_t tiles = (0x80 >> (pos_x / TILE_WIDTH)) | (0x80 >> ((pos_x + 7) / TILE_WIDTH)) | (wraps ? 0x80 : 0);
+    uint64_t collision = 0;
+
+    for (int i = 0; i < height && (QUIRKS::sprites == SPRITES_WRAP || pos_y + i < SCREEN_HEIGHT); ++i)
+    {
+        uint64_t sprite = memory[(index + i) & memory_mask];
+        uint64_t bits = (sprite << 56) >> pos_x;
+        int row = (pos_y + i) % SCREEN_HEIGHT;
+
+        if (!sprite)
+        {
+            continue;
+        }
+
+        if (wraps)
+        {
+            bits |= sprite << (SCREEN_WIDTH + 56 - pos_x);
+        }
+
+        collision |= video[row] & bits;
+        video[row] ^= bits;
+        dirty[row] |= tiles;
+
+        // Columns past the right edge spill into the start of the next row
+        if (QUIRKS::sprites == SPRITES_SPILL && pos_x > SCREEN_WIDTH - 8 && row + 1 < SCREEN_HEIGHT)
+        {
+            uint64_t spill = sprite << (SCREEN_WIDTH + 56 - pos_x);
+
+            collision |= video[row + 1] & spill;
+            video[row + 1] ^= spill;
+            dirty[row + 1] |= 0x80;
+        }
+    }
+
+    registers[0xF] = collision != 0;
+}
+NEXT
+
+OP(OP_SKP) // if (key() == Vx) skip instruction
+    if (keypad[registers[in.x]])
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_SKNP) // if (key() != Vx) skip instruction
+    if (keypad[registers[in.x]])
+    {
+        address += skip_length(address);
+    }
+NEXT
+
+OP(OP_LD_VX_DT) // Set Vx to the value of the delay timer
+    registers[in.x] = delay_timer;
+NEXT
+
+OP(OP_LD_VX_K) // Key is pressed and stored in Vx, this is a blocking operation
+    if (any_key())
+    {
+        int key = 0;
+
+        while (!keypad[key])
+        {
+            ++key;
+        }
+
+        registers[in.x] = key;
+    }
+    else
+    {
+        address -= 2;
+    }
+NEXT
+
+OP(OP_LD_DT) // Set delay timer to Vx
+    delay_timer = registers[in.x];
+NEXT
+
+OP(OP_LD_ST) // Set sound timer to Vx
+    sound_timer = registers[in.x];
+NEXT
+
+OP(OP_ADD_I) // Add Vx to Index
+    index += registers[in.x];
+NEXT
+
+OP(OP_LD_F) // Set Index to the location of the sprite character in Vx
+    index = 5 * registers[in.x]; // font start address is zero therefore can ignore adding it
+NEXT
+
+OP(OP_LD_B) // Store binary-coded-decimal representation of Vx with the hundreds digit in memory at location in Index
+{
+    uint8_t val = registers[in.x];
+
+    write_memory(index + 2, val % 10);
+    val /= 10;
+
+    write_memory(index + 1, val % 10);
+    val /= 10;
+
+    write_memory(index, val % 10);
+}
+NEXT
+
+OP(OP_LD_I_VX) // Store V0 to Vx (inclusive) in memory starting at Index
+    for (int i = 0; i <= in.x; ++i)
+    {
+        write_memory(index + i, registers[i]);
+    }
+
+    if (QUIRKS::increment_i)
+    {
+        index += in.x + 1;
+    }
+NEXT
+
+OP(OP_LD_VX_I) // Store values from 0 to X from memory in registers V0 - Vx
+    for (int i = 0; i <= in.x; ++i)
+    {
+        registers[i] = memory[(index + i) & memory_mask];
+    }
+
+    if (QUIRKS::increment_i)
+    {
+        index += in.x + 1;
+    }
+NEXT
+
+OP(OP_NOP) // unassigned sub-opcodes
+NEXT
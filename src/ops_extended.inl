@@ -0,0 +1,101 @@
+// SUPER-CHIP and XO-CHIP instructions, included after ops.inl by the single machine cores in the same way.
+// Anything touching the display calls out to Chip8 members in emulator.cpp
+
+OP(OP_SCD) // 00CN scroll the selected planes down N rows
+    scroll_down(in.nn & 0xF);
+NEXT
+
+OP(OP_SCU) // 00DN scroll the selected planes up N rows, XO-CHIP only
+    scroll_up(in.nn & 0xF);
+NEXT
+
+OP(OP_SCR) // 00FB scroll the selected planes right 4 columns
+    scroll_right();
+NEXT
+
+OP(OP_SCL) // 00FC scroll the selected planes left 4 columns
+    scroll_left();
+NEXT
+
+OP(OP_EXIT) // 00FD stop the machine where it is
+    running = false;
+    address -= 2;
+NEXT
+
+OP(OP_LOW) // 00FE 64x32
+    set_hires(false);
+NEXT
+
+OP(OP_HIGH) // 00FF 128x64
+    set_hires(true);
+NEXT
+
+OP(OP_DRW_EXT) // DXYN clipped at the edges into every selected plane, DXY0 draws 16x16
+    registers[0xF] = draw(registers[in.x], registers[in.y], in.nn & 0xF);
+NEXT
+
+OP(OP_CLS_EXT) // 00E0 clear the selected planes
+    clear_planes();
+NEXT
+
+OP(OP_LD_HF) // FX30 Set Index to the big font digit in Vx
+    index = BIG_FONT_ADDRESS + 10 * (registers[in.x] & 0xF);
+NEXT
+
+OP(OP_SAVE_FLAGS) // FX75 Store V0 to Vx in the user flags
+    for (int i = 0; i <= in.x; ++i)
+    {
+        flags[i] = registers[i];
+    }
+NEXT
+
+OP(OP_LOAD_FLAGS) // FX85 Load V0 to Vx from the user flags
+    for (int i = 0; i <= in.x; ++i)
+    {
+        registers[i] = flags[i];
+    }
+NEXT
+
+OP(OP_SAVE_RANGE) // 5XY2 Store Vx to Vy, in either direction, in memory starting at Index
+    for (int i = 0, r = in.x; ; ++i, r += in.x <= in.y ? 1 : -1)
+    {
+        write_memory(index + i, registers[r]);
+
+        if (r == in.y)
+        {
+            break;
+        }
+    }
+NEXT
+
+OP(OP_LOAD_RANGE) // 5XY3 Load Vx to Vy, in either direction, from memory starting at Index
+    for (int i = 0, r = in.x; ; ++i, r += in.x <= in.y ? 1 : -1)
+    {
+        registers[r] = memory[(index + i) & memory_mask];
+
+        if (r == in.y)
+        {
+            break;
+        }
+    }
+NEXT
+
+OP(OP_LD_I_LONG) // F000 NNNN Set Index to the 16 bit address in the next two bytes
+    index = static_cast<uint16_t>(memory[address & MEMORY_MASK] << 8 | memory[(address + 1) & MEMORY_MASK]);
+    address += 2;
+NEXT
+
+OP(OP_PLANE) // FN01 Select the planes in N for drawing, clearing and scrolling
+    planes = in.x & ((1 << PLANE_COUNT) - 1);
+NEXT
+
+OP(OP_AUDIO) // F002 Load the 16 byte audio pattern from memory at Index
+    for (int i = 0; i < 16; ++i)
+    {
+        pattern[i] = memory[(index + i) & memory_mask];
+    }
+NEXT
+
+OP(OP_PITCH) // FX3A Set the audio pattern's playback pitch to Vx
+    pitch = registers[in.x];
+NEXT
@@ -0,0 +1,232 @@
+#include "pacer.h"
+
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+#if !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+struct Pacer {
+    HANDLE timer;
+    HANDLE wake; // auto-reset
+    bool watch_input;
+};
+
+Pacer *
+pacer_create(bool watch_input)
+{
+    Pacer *pacer = reinterpret_cast<Pacer*>(calloc(1, sizeof(Pacer)));
+
+    // High resolution timers need Windows 10 1803, older versions get the default 1ms-15ms one
+    pacer->timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+    if (!pacer->timer)
+    {
+        pacer->timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    }
+
+    pacer->wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+    pacer->watch_input = watch_input;
+
+    if (!pacer->timer || !pacer->wake)
+    {
+        pacer_destroy(pacer);
+        return NULL;
+    }
+
+    return pacer;
+}
+
+void
+pacer_destroy(Pacer *pacer)
+{
+    if (pacer->timer)
+    {
+        CloseHandle(pacer->timer);
+    }
+
+    if (pacer->wake)
+    {
+        CloseHandle(pacer->wake);
+    }
+
+    free(pacer);
+}
+
+bool
+pacer_wait(Pacer *pacer, double timeout_ms)
+{
+    if (timeout_ms <= 0)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER due;
+    due.QuadPart = -static_cast<LONGLONG>(timeout_ms * 10000); // negative is relative, in 100ns units
+    SetWaitableTimer(pacer->timer, &due, 0, NULL, NULL, FALSE);
+
+    HANDLE handles[2] = { pacer->wake, pacer->timer };
+    DWORD result = pacer->watch_input ? MsgWaitForMultipleObjectsEx(2, handles, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE) :
+        WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+
+    CancelWaitableTimer(pacer->timer);
+    return result != WAIT_OBJECT_0 + 1;
+}
+
+void
+pacer_wake(Pacer *pacer)
+{
+    SetEvent(pacer->wake);
+}
+
+double
+process_cpu_ms()
+{
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+
+    return (k.QuadPart + u.QuadPart) / 10000.0;
+}
+
+#else
+
+struct Pacer {
+    int epoll;
+    int timer;
+    int wake;
+};
+
+Pacer *
+pacer_create(bool watch_input)
+{
+    Pacer *pacer = reinterpret_cast<Pacer*>(malloc(sizeof(Pacer)));
+
+    pacer->epoll = epoll_create1(EPOLL_CLOEXEC);
+    pacer->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    pacer->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Only a terminal, a pipe or file at its end stays readable and would end every wait at once
+    int fds[3] = { pacer->timer, pacer->wake, STDIN_FILENO };
+    int count = watch_input && isatty(STDIN_FILENO) ? 3 : 2;
+    bool added = pacer->epoll >= 0 && pacer->timer >= 0 && pacer->wake >= 0;
+
+    for (int i = 0; i < count && added; ++i)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fds[i];
+        added = epoll_ctl(pacer->epoll, EPOLL_CTL_ADD, fds[i], &event) == 0;
+    }
+
+    if (!added)
+    {
+        pacer_destroy(pacer);
+        return NULL;
+    }
+
+    return pacer;
+}
+
+void
+pacer_destroy(Pacer *pacer)
+{
+    int fds[3] = { pacer->epoll, pacer->timer, pacer->wake };
+
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    free(pacer);
+}
+
+bool
+pacer_wait(Pacer *pacer, double timeout_ms)
+{
+    if (timeout_ms <= 0)
+    {
+        return false;
+    }
+
+    // Disarmed by a zero it_value, so a timeout that rounds to nothing is bumped to a nanosecond
+    long long ns = static_cast<long long>(timeout_ms * 1000000);
+    itimerspec spec = {};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns > 0 ? ns % 1000000000 : 1;
+    timerfd_settime(pacer->timer, 0, &spec, NULL);
+
+    epoll_event events[3];
+    bool woken = false;
+    bool expired = false;
+
+    while (!woken && !expired)
+    {
+        int count = epoll_wait(pacer->epoll, events, 3, -1);
+
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t value;
+
+            if (events[i].data.fd == pacer->timer)
+            {
+                expired = read(pacer->timer, &value, sizeof(value)) == sizeof(value);
+            }
+            else if (events[i].data.fd == pacer->wake)
+            {
+                woken = read(pacer->wake, &value, sizeof(value)) == sizeof(value) || woken;
+            }
+            else
+            {
+                // Input is left for the host to read, it only ends the wait
+                woken = true;
+            }
+        }
+    }
+
+    itimerspec disarm = {};
+    timerfd_settime(pacer->timer, 0, &disarm, NULL);
+    return woken;
+}
+
+void
+pacer_wake(Pacer *pacer)
+{
+    uint64_t one = 1;
+
+    if (write(pacer->wake, &one, sizeof(one)) < 0)
+    {
+        // Only fails when the counter is saturated, which still wakes the waiter
+    }
+}
+
+double
+process_cpu_ms()
+{
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+#endif
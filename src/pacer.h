@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// Sleeps a thread until a deadline, another thread's wake or, when watched, the host's input. A timerfd, an
+// eventfd and epoll on Linux, a high resolution waitable timer and an event on Windows, so an idle host costs
+// nothing between frames and a sleep ends within the OS timer's precision rather than the scheduler tick's
+struct Pacer;
+
+Pacer *pacer_create(bool watch_input); // watch_input: stdin on Linux when it is a terminal, the calling thread's messages on Windows
+void pacer_destroy(Pacer *pacer);
+bool pacer_wait(Pacer *pacer, double timeout_ms); // true when woken or input arrived before the timeout
+void pacer_wake(Pacer *pacer); // from any thread, a wake while nobody waits ends the next wait
+double process_cpu_ms(); // CPU time used by every thread of the process so far
@@ -0,0 +1,160 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A worker's remaining jobs. Each share sits on its own cache line so workers taking from their own front
+// don't slow each other down
+struct alignas(64) Share {
+    std::mutex lock;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct Pool {
+    std::vector<Share> shares;
+    Pool_job job;
+    void *context;
+    Pool_stats *stats;
+
+    explicit Pool(uint32_t threads) : shares(threads) {}
+};
+
+static bool
+take(Share &share, uint64_t *job)
+{
+    std::lock_guard<std::mutex> guard(share.lock);
+
+    if (share.begin == share.end)
+    {
+        return false;
+    }
+
+    *job = share.begin++;
+    return true;
+}
+
+// Moves the back half of the biggest other share into the worker's own, which is empty at this point.
+// Only one lock is held at a time, the stolen range belongs to nobody else once it is cut off
+static bool
+steal(Pool &pool, uint32_t worker)
+{
+    uint32_t threads = static_cast<uint32_t>(pool.shares.size());
+
+    for (;;)
+    {
+        uint32_t victim = worker;
+        uint64_t most = 0;
+
+        for (uint32_t i = 1; i < threads; ++i)
+        {
+            uint32_t other = (worker + i) % threads;
+            Share &share = pool.shares[other];
+            std::lock_guard<std::mutex> guard(share.lock);
+
+            if (share.end - share.begin > most)
+            {
+                most = share.end - share.begin;
+                victim = other;
+            }
+        }
+
+        if (most == 0)
+        {
+            return false;
+        }
+
+        uint64_t begin, end;
+        {
+            Share &share = pool.shares[victim];
+            std::lock_guard<std::mutex> guard(share.lock);
+
+            // Someone may have got there first, look again
+            if (share.begin == share.end)
+            {
+                continue;
+            }
+
+            end = share.end;
+            begin = share.begin + (share.end - share.begin) / 2;
+            share.end = begin;
+        }
+
+        Share &own = pool.shares[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+}
+
+static void
+work(Pool *pool, uint32_t worker)
+{
+    Pool_stats stats = {};
+    uint64_t job;
+
+    for (;;)
+    {
+        while (take(pool->shares[worker], &job))
+        {
+            auto start_time = std::chrono::steady_clock::now();
+            pool->job(pool->context, worker, job);
+            stats.busy_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+            ++stats.jobs;
+        }
+
+        if (!steal(*pool, worker))
+        {
+            break;
+        }
+
+        ++stats.steals;
+    }
+
+    if (pool->stats)
+    {
+        pool->stats[worker] = stats;
+    }
+}
+
+uint32_t
+pool_default_threads()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void
+pool_run(uint32_t threads, uint64_t count, Pool_job job, void *context, Pool_stats *stats)
+{
+    threads = std::max(threads, 1u);
+
+    Pool pool(threads);
+    pool.job = job;
+    pool.context = context;
+    pool.stats = stats;
+
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        pool.shares[i].begin = count * i / threads;
+        pool.shares[i].end = count * (i + 1) / threads;
+    }
+
+    // The calling thread is worker 0
+    std::vector<std::thread> workers;
+
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(work, &pool, i);
+    }
+
+    work(&pool, 0);
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
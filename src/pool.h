@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+// Work-stealing thread pool for large runs of independent jobs, e.g. many instances of many ROMs.
+// Every worker starts with an even share of the job indices and runs them front to back, a worker that
+// runs out steals the back half of the biggest share left
+
+typedef void (*Pool_job)(void *context, uint32_t worker, uint64_t job);
+
+struct Pool_stats {
+    uint64_t jobs; // run by this worker
+    uint64_t steals; // shares taken from other workers
+    double busy_ms; // time spent inside jobs
+};
+
+uint32_t pool_default_threads(); // hardware threads, at least 1
+
+// Calls job(context, worker, i) exactly once for every i in [0, count) and returns when all are done.
+// worker is in [0, threads) and stays the same for everything a thread runs, stats needs threads entries or NULL
+void pool_run(uint32_t threads, uint64_t count, Pool_job job, void *context, Pool_stats *stats);
@@ -0,0 +1,252 @@
+#include "win32.h"
+#include "posix.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+double
+time_ms()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+double
+thread_cpu_ms()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// Matches "--name" and "--name=value", value is NULL when there is no '='
+bool
+parse_option(char *arg, const char *name, char **value)
+{
+    size_t length = std::strlen(name);
+
+    if (std::strncmp(arg, "--", 2) != 0 || std::strncmp(arg + 2, name, length) != 0)
+    {
+        return false;
+    }
+
+    char *rest = arg + 2 + length;
+
+    if (rest[0] == 0)
+    {
+        *value = NULL;
+        return true;
+    }
+
+    if (rest[0] == '=')
+    {
+        *value = rest + 1;
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t
+parse_u64(const char *value, uint64_t fallback)
+{
+    if (!value || !value[0])
+    {
+        return fallback;
+    }
+
+    return std::strtoull(value, NULL, 0);
+}
+
+// Linux reports the high-water mark of resident memory in KB
+uint64_t
+peak_rss_kb()
+{
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+int
+open_socket(const char *address, bool listening)
+{
+    sockaddr_un local = {};
+    sockaddr_in loopback = {};
+    sockaddr *name;
+    socklen_t length;
+    int family;
+
+    if (std::strncmp(address, "unix:", 5) == 0)
+    {
+        if (std::strlen(address + 5) >= sizeof(local.sun_path))
+        {
+            return -1;
+        }
+
+        local.sun_family = AF_UNIX;
+        std::strcpy(local.sun_path, address + 5);
+        name = reinterpret_cast<sockaddr*>(&local);
+        length = sizeof(local);
+        family = AF_UNIX;
+    }
+    else
+    {
+        const char *port = std::strncmp(address, "tcp:", 4) == 0 ? address + 4 : address;
+        char *end;
+        unsigned long number = std::strtoul(port, &end, 10);
+
+        if (!port[0] || *end || number == 0 || number > 65535)
+        {
+            return -1;
+        }
+
+        loopback.sin_family = AF_INET;
+        loopback.sin_port = htons(static_cast<uint16_t>(number));
+        loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        name = reinterpret_cast<sockaddr*>(&loopback);
+        length = sizeof(loopback);
+        family = AF_INET;
+    }
+
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    bool opened;
+
+    if (listening)
+    {
+        int reuse = 1;
+
+        if (family == AF_UNIX)
+        {
+            unlink(local.sun_path);
+        }
+        else
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+
+        opened = bind(fd, name, length) == 0 && listen(fd, SOMAXCONN) == 0;
+    }
+    else
+    {
+        opened = connect(fd, name, length) == 0;
+    }
+
+    if (!opened)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// A directory adds every regular file in it in name order, anything else is added as a ROM itself
+void
+add_roms(const char *path, std::vector<std::string> &roms)
+{
+    struct stat info;
+
+    if (stat(path, &info) != 0)
+    {
+        std::fprintf(stderr, "Can't open %s\n", path);
+        return;
+    }
+
+    if (!S_ISDIR(info.st_mode))
+    {
+        roms.push_back(path);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    std::vector<std::string> found;
+
+    while (dirent *entry = readdir(dir))
+    {
+        std::string file = std::string(path) + "/" + entry->d_name;
+
+        if (entry->d_name[0] != '.' && stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+        {
+            found.push_back(file);
+        }
+    }
+
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    roms.insert(roms.end(), found.begin(), found.end());
+}
+
+uint8_t *
+read_file(char *filename, uint64_t *file_size)
+{
+    FILE *file = std::fopen(filename, "rb");
+
+    if (!file)
+    {
+        return NULL;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    if (size <= 0)
+    {
+        std::fclose(file);
+        return NULL;
+    }
+
+    *file_size = size;
+
+    uint8_t *data = reinterpret_cast<uint8_t*>(malloc(*file_size));
+
+    if (std::fread(data, 1, *file_size, file) != *file_size)
+    {
+        std::fclose(file);
+        free(data);
+        return NULL;
+    }
+
+    std::fclose(file);
+    return data;
+}
+
+void
+message_box(const char *title, const char *msg)
+{
+    std::fprintf(stderr, "%s: %s\n", title, msg);
+}
+
+void
+clear_console()
+{
+    std::fputs("\x1b[2J\x1b[H", stdout);
+    std::fflush(stdout);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+// POSIX-only platform helpers shared by the Linux host and tools, the emulator itself only relies on win32.h
+double time_ms();
+double thread_cpu_ms(); // CPU time of the calling thread
+bool parse_option(char *arg, const char *name, char **value);
+uint64_t parse_u64(const char *value, uint64_t fallback);
+void add_roms(const char *path, std::vector<std::string> &roms);
+uint64_t peak_rss_kb(); // of this process so far
+// "unix:PATH" for a unix domain socket, otherwise a port on 127.0.0.1, "tcp:PORT" or just "PORT". Listens on
+// it, replacing a stale unix socket file, or connects to it. -1 on failure
+int open_socket(const char *address, bool listening);
@@ -0,0 +1,257 @@
+#include "profile.h"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include <algorithm>
+
+const int TOP_ADDRESSES = 32;
+const int HEATMAP_WIDTH = 64; // addresses per heatmap line
+const char HEATMAP_LEVELS[] = " .:-=+*#%@";
+
+// Indexed by OPS, the pattern first so the report reads like the opcode table
+static const char *const OP_NAMES[OP_COUNT] =
+{
+    "undecoded",
+    "00E0 CLS", "00EE RET", "0NNN SYS", "1NNN JP", "2NNN CALL",
+    "3XNN SE", "4XNN SNE", "5XY0 SE", "6XNN LD", "7XNN ADD",
+    "8XY0 LD", "8XY1 OR", "8XY2 AND", "8XY3 XOR", "8XY4 ADD", "8XY5 SUB", "8XY6 SHR", "8XY7 SUBN", "8XYE SHL",
+    "9XY0 SNE", "ANNN LD I", "BNNN JP V0", "CXNN RND", "DXYN DRW", "EX9E SKP", "EXA1 SKNP",
+    "FX07 LD DT", "FX0A LD K", "FX15 LD DT", "FX18 LD ST", "FX1E ADD I", "FX29 LD F", "FX33 LD B", "FX55 LD [I]",
+    "FX65 LD [I]",
+    "unassigned",
+    "00CN SCD", "00DN SCU", "00FB SCR", "00FC SCL", "00FD EXIT", "00FE LOW", "00FF HIGH", "DXYN DRW", "00E0 CLS",
+    "FX30 LD HF", "FX75 LD R", "FX85 LD R", "5XY2 SAVE", "5XY3 LOAD", "F000 LD I", "FN01 PLANE", "F002 AUDIO",
+    "FX3A PITCH"
+};
+
+Profile *
+profile_create()
+{
+    Profile *profile = new Profile();
+
+    Profile_node root = { 0, MEMORY_START_ADDRESS, 0, 0 };
+    profile->nodes.push_back(root);
+    return profile;
+}
+
+void
+profile_destroy(Profile *profile)
+{
+    delete profile;
+}
+
+void
+profile_call(Profile &profile, uint16_t routine)
+{
+    ++profile.calls[static_cast<uint32_t>(profile.nodes[profile.node].routine) << 16 | routine];
+
+    // Below a call that got no node the chain can't be followed, so the calls under it get none either
+    if (profile.unplaced)
+    {
+        ++profile.unplaced;
+        return;
+    }
+
+    uint64_t key = static_cast<uint64_t>(profile.node) << 16 | routine;
+    auto child = profile.children.find(key);
+
+    if (child != profile.children.end())
+    {
+        profile.node = child->second;
+    }
+    else if (profile.nodes.size() < MAX_PROFILE_NODES)
+    {
+        Profile_node node = { profile.node, routine, 0, 0 };
+        profile.node = static_cast<uint32_t>(profile.nodes.size());
+        profile.children[key] = profile.node;
+        profile.nodes.push_back(node);
+    }
+    else
+    {
+        ++profile.unplaced;
+    }
+}
+
+// Runs before 00EE, so sp still counts the frame being returned from. Back at the bottom of the guest's stack the
+// chain starts over from the root, which keeps it in step after a rewind or a ROM that unwinds by jumping. A call
+// that got no node returns to the chain it was charged to
+void
+profile_return(Profile &profile, const Chip8 &c)
+{
+    if (c.sp <= 1)
+    {
+        profile.node = 0;
+        profile.unplaced = 0;
+    }
+    else if (profile.unplaced)
+    {
+        --profile.unplaced;
+    }
+    else
+    {
+        profile.node = profile.nodes[profile.node].parent;
+    }
+}
+
+static double
+share(uint64_t count, uint64_t total)
+{
+    return total ? 100.0 * count / total : 0;
+}
+
+static std::string
+chain_name(const Profile &profile, uint32_t node)
+{
+    std::string name;
+
+    for (;;)
+    {
+        char frame[16] = "main";
+
+        if (node)
+        {
+            std::snprintf(frame, sizeof(frame), "sub_%03X", profile.nodes[node].routine);
+        }
+
+        name = name.empty() ? frame : frame + (";" + name);
+
+        if (!node)
+        {
+            return name;
+        }
+
+        node = profile.nodes[node].parent;
+    }
+}
+
+static void
+write_report(const Profile &profile, const Chip8 &c, FILE *file)
+{
+    std::fprintf(file, "%llu instructions, %.1f emulated seconds at %u per second\n",
+        static_cast<unsigned long long>(profile.instructions), static_cast<double>(profile.instructions) / c.ips, c.ips);
+    std::fprintf(file, "FX0A waiting for a key: %llu instructions, %.1f%%\n",
+        static_cast<unsigned long long>(profile.waiting), share(profile.waiting, profile.instructions));
+
+    int ops[OP_COUNT];
+
+    for (int i = 0; i < OP_COUNT; ++i)
+    {
+        ops[i] = i;
+    }
+
+    std::stable_sort(ops, ops + OP_COUNT, [&](int a, int b) { return profile.ops[a] > profile.ops[b]; });
+    std::fprintf(file, "\n%-14s%16s%9s\n", "op", "count", "share");
+
+    for (int i = 0; i < OP_COUNT && profile.ops[ops[i]]; ++i)
+    {
+        std::fprintf(file, "%-14s%16llu%8.2f%%\n", OP_NAMES[ops[i]], static_cast<unsigned long long>(profile.ops[ops[i]]),
+            share(profile.ops[ops[i]], profile.instructions));
+    }
+
+    std::vector<int> addresses;
+
+    for (int i = 0; i < MEMORY_SIZE; ++i)
+    {
+        if (profile.pcs[i])
+        {
+            addresses.push_back(i);
+        }
+    }
+
+    std::stable_sort(addresses.begin(), addresses.end(), [&](int a, int b) { return profile.pcs[a] > profile.pcs[b]; });
+    addresses.resize(std::min<size_t>(addresses.size(), TOP_ADDRESSES));
+    std::fprintf(file, "\n%-9s%-8s%16s%9s\n", "address", "opcode", "count", "share");
+
+    // The opcode is read from memory at exit, self-modifying code may have run something else there
+    for (int address : addresses)
+    {
+        std::fprintf(file, "0x%03X    %02X%02X    %16llu%8.2f%%\n", address, c.memory[address], c.memory[(address + 1) & MEMORY_MASK],
+            static_cast<unsigned long long>(profile.pcs[address]), share(profile.pcs[address], profile.instructions));
+    }
+
+    std::vector<std::pair<uint32_t, uint64_t>> calls(profile.calls.begin(), profile.calls.end());
+    std::sort(calls.begin(), calls.end(), [](const std::pair<uint32_t, uint64_t> &a, const std::pair<uint32_t, uint64_t> &b)
+    {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    std::fprintf(file, "\n%-9s%-9s%16s\n", "caller", "callee", "calls");
+
+    for (const std::pair<uint32_t, uint64_t> &call : calls)
+    {
+        std::fprintf(file, "0x%03X    0x%03X    %16llu\n", call.first >> 16, call.first & 0xFFFF, static_cast<unsigned long long>(call.second));
+    }
+
+    // Log scale so a loop executed millions of times doesn't hide code that ran a few hundred
+    uint64_t hottest = *std::max_element(profile.pcs, profile.pcs + MEMORY_SIZE);
+    double top = std::log2(static_cast<double>(hottest) + 1);
+    const int levels = sizeof(HEATMAP_LEVELS) - 2;
+
+    std::fprintf(file, "\nHeatmap, %d addresses per line, '%s' from not executed to the hottest\n", HEATMAP_WIDTH, HEATMAP_LEVELS);
+
+    for (int i = 0; i < MEMORY_SIZE; i += HEATMAP_WIDTH)
+    {
+        char line[HEATMAP_WIDTH + 1];
+
+        for (int j = 0; j < HEATMAP_WIDTH; ++j)
+        {
+            uint64_t hits = profile.pcs[i + j];
+            int level = hits ? 1 + static_cast<int>(std::log2(static_cast<double>(hits) + 1) / top * (levels - 1)) : 0;
+            line[j] = HEATMAP_LEVELS[std::min(level, levels)];
+        }
+
+        line[HEATMAP_WIDTH] = 0;
+        std::fprintf(file, "0x%03X |%s|\n", i, line);
+    }
+}
+
+bool
+profile_write(const Profile &profile, const Chip8 &c, const char *path)
+{
+    FILE *file = std::fopen(path, "w");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    write_report(profile, c, file);
+    bool written = !std::ferror(file);
+    written = std::fclose(file) == 0 && written;
+
+    std::string folded_path = std::string(path) + ".folded";
+    FILE *folded = std::fopen(folded_path.c_str(), "w");
+
+    if (!folded)
+    {
+        return false;
+    }
+
+    // One line per call chain and count, FX0A spinning as a frame of its own so waiting stands out
+    for (uint32_t i = 0; i < profile.nodes.size(); ++i)
+    {
+        const Profile_node &node = profile.nodes[i];
+
+        if (!node.instructions)
+        {
+            continue;
+        }
+
+        std::string name = chain_name(profile, i);
+
+        if (node.instructions > node.waiting)
+        {
+            std::fprintf(folded, "%s %llu\n", name.c_str(), static_cast<unsigned long long>(node.instructions - node.waiting));
+        }
+
+        if (node.waiting)
+        {
+            std::fprintf(folded, "%s;key_wait %llu\n", name.c_str(), static_cast<unsigned long long>(node.waiting));
+        }
+    }
+
+    written = !std::ferror(folded) && written;
+    return std::fclose(folded) == 0 && written;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "chip8.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Guest profiler: what the ROM spends its emulated cycles on. Counts every op, every pc, every 2NNN edge and the
+// instructions FX0A spins waiting for a key, and attributes each instruction to its chain of subroutines so the
+// run can be drawn as a flame graph.
+// The hook is only compiled in with CHIP8_PROFILE (PROFILE=1 ./build.sh), otherwise the cores are untouched
+#if !defined(CHIP8_PROFILE)
+#define CHIP8_PROFILE 0
+#endif
+
+const uint32_t MAX_PROFILE_NODES = 1 << 16; // distinct call stacks, deeper or newer ones are charged to their caller
+
+// One distinct chain of calls from the ROM's entry, children are found through Profile::children
+struct Profile_node {
+    uint32_t parent;
+    uint16_t routine; // address the chain's last 2NNN jumped to, MEMORY_START_ADDRESS for the root
+    uint64_t instructions; // executed while this chain was the current one
+    uint64_t waiting; // of those, FX0A spinning with no key down
+};
+
+struct Profile {
+    uint64_t instructions;
+    uint64_t waiting;
+    uint64_t ops[OP_COUNT];
+    uint64_t pcs[MEMORY_SIZE];
+    std::unordered_map<uint32_t, uint64_t> calls; // caller routine << 16 | callee
+    std::unordered_map<uint64_t, uint32_t> children; // node << 16 | routine
+    std::vector<Profile_node> nodes;
+    uint32_t node; // current call chain
+    uint32_t unplaced; // calls made with no node left, each charged to node and popped again without leaving it
+    const char *path; // the report is written here when the emulator shuts down
+};
+
+Profile *profile_create();
+void profile_destroy(Profile *profile);
+void profile_call(Profile &profile, uint16_t routine);
+void profile_return(Profile &profile, const Chip8 &c);
+// A text report at path and the call chains in the folded format flamegraph.pl and speedscope read at
+// path.folded, false if either can't be written
+bool profile_write(const Profile &profile, const Chip8 &c, const char *path);
+
+// Called by the interpreter cores before an instruction runs, address is its pc
+inline void
+profile_instruction(Profile &profile, const Chip8 &c, uint16_t address, const Instruction &in)
+{
+    Profile_node &node = profile.nodes[profile.node];
+
+    ++profile.instructions;
+    ++profile.ops[in.op];
+    ++profile.pcs[address];
+    ++node.instructions;
+
+    switch (in.op)
+    {
+        case OP_CALL:
+            profile_call(profile, in.nnn);
+            break;
+        case OP_RET:
+            profile_return(profile, c);
+            break;
+        case OP_LD_VX_K:
+            if (!c.any_key())
+            {
+                ++profile.waiting;
+                ++node.waiting;
+            }
+            break;
+    }
+}
+
+#if CHIP8_PROFILE
+#define PROFILE_INSTRUCTION(address, in) \
+    if (profile) \
+    { \
+        profile_instruction(*profile, *this, address, in); \
+    }
+#else
+#define PROFILE_INSTRUCTION(address, in)
+#endif
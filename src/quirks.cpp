@@ -0,0 +1,79 @@
+#include "quirks.h"
+
+#include <cstring>
+
+const char *const QUIRK_NAMES[QUIRK_PROFILE_COUNT] = { "legacy", "vip", "schip", "modern" };
+const char *const QUIRK_TYPES[QUIRK_PROFILE_COUNT] = { "Legacy_quirks", "Vip_quirks", "Schip_quirks", "Modern_quirks" };
+
+// The bundled ROMs by where they were written: the COSMAC VIP originals, and the CHIP-48 and SUPER-CHIP era games that
+// shift VX in place and leave I alone in FX55/FX65
+const Quirk_rom QUIRK_ROMS[] =
+{
+    { 0xE59FD57FA44ECB40ULL, QUIRKS_VIP, "15PUZZLE" },
+    { 0xA8E9391EBB18DF6FULL, QUIRKS_VIP, "KALEID" },
+    { 0x3E2C2D43B296B74CULL, QUIRKS_VIP, "TANK" },
+    { 0x8D8A02FA3A2ED293ULL, QUIRKS_VIP, "UFO" },
+    { 0xB7E1D74B387BEDE6ULL, QUIRKS_VIP, "WIPEOFF" },
+    { 0x0FD332D0BC68C9F2ULL, QUIRKS_SCHIP, "BLINKY" },
+    { 0xC86E8FF63FCE668CULL, QUIRKS_SCHIP, "BRIX" },
+    { 0xADF99268DB3C3BC9ULL, QUIRKS_SCHIP, "CONNECT4" },
+    { 0x3F58EB4FA83DCD98ULL, QUIRKS_SCHIP, "HIDDEN" },
+    { 0x8E547EBB12C026B4ULL, QUIRKS_SCHIP, "INVADERS" },
+    { 0xEC7CA0DE3E110327ULL, QUIRKS_SCHIP, "SYZYGY" },
+    { 0x04EB2109DC29B1ABULL, QUIRKS_SCHIP, "TETRIS" },
+    { 0x56049E83866B207DULL, QUIRKS_SCHIP, "TICTAC" },
+    { 0xCDAA32787DEAA913ULL, QUIRKS_SCHIP, "VBRIX" }
+};
+
+uint8_t
+rom_quirks(uint64_t rom_hash)
+{
+    for (const Quirk_rom &rom : QUIRK_ROMS)
+    {
+        if (rom.hash == rom_hash)
+        {
+            return rom.quirks;
+        }
+    }
+
+    return QUIRKS_LEGACY;
+}
+
+bool
+parse_quirks(const char *name, uint8_t &quirks)
+{
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; ++i)
+    {
+        if (std::strcmp(name, QUIRK_NAMES[i]) == 0)
+        {
+            quirks = static_cast<uint8_t>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <typename QUIRKS>
+static Quirk_settings
+settings()
+{
+    Quirk_settings settings = { QUIRKS::shift_vy, QUIRKS::increment_i, QUIRKS::jump_vx, QUIRKS::sprites, QUIRKS::reset_vf };
+    return settings;
+}
+
+Quirk_settings
+quirk_settings(uint8_t quirks)
+{
+    switch (quirks)
+    {
+        case QUIRKS_VIP:
+            return settings<Vip_quirks>();
+        case QUIRKS_SCHIP:
+            return settings<Schip_quirks>();
+        case QUIRKS_MODERN:
+            return settings<Modern_quirks>();
+        default:
+            return settings<Legacy_quirks>();
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "chip8.h"
+
+// Quirk profiles by name and by ROM. The database holds the ROMs whose original interpreter is known, keyed by the
+// FNV-1a hash of the ROM file (hash_bytes in movie.h), everything else runs legacy unless --quirks says otherwise
+
+struct Quirk_rom {
+    uint64_t hash;
+    uint8_t quirks; // QUIRK_PROFILES
+    const char *name; // the file in roms
+};
+
+// A profile's constants as values, for code that decides on quirks once while translating rather than per run
+struct Quirk_settings {
+    bool shift_vy;
+    bool increment_i;
+    bool jump_vx;
+    uint8_t sprites; // SPRITE_EDGES
+    bool reset_vf;
+};
+
+extern const char *const QUIRK_NAMES[QUIRK_PROFILE_COUNT]; // as --quirks takes them
+extern const char *const QUIRK_TYPES[QUIRK_PROFILE_COUNT]; // the Quirks typedef of each profile, for generated code
+
+uint8_t rom_quirks(uint64_t rom_hash); // QUIRKS_LEGACY for ROMs the database doesn't know
+bool parse_quirks(const char *name, uint8_t &quirks); // false for an unknown name, quirks is left alone
+Quirk_settings quirk_settings(uint8_t quirks);
@@ -0,0 +1,394 @@
+#include "win32.h"
+#include "posix.h"
+#include "chip8.h"
+#include "aot.h"
+#include "movie.h"
+#include "quirks.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+// Recompiles a ROM ahead of time into a C++ file for the aot core, e.g.
+// ./bin/recompile roms/BRIX --out=build/brix.cpp && AOT=build/brix.cpp ./build.sh
+// Code is found by following every jump, call, skip and return address from 0x200. BNNN is followed into the table
+// of 1NNN jumps most ROMs index with it, any other target it takes at run time is left to the interpreter
+const int MAX_JUMP_TABLE = 128; // entries V0 can reach with even offsets
+
+static const char *QUIRK_IDENTIFIERS[QUIRK_PROFILE_COUNT] = { "QUIRKS_LEGACY", "QUIRKS_VIP", "QUIRKS_SCHIP", "QUIRKS_MODERN" };
+
+static const char *OP_IDENTIFIERS[OP_COUNT] = {
+    "OP_UNDECODED",
+    "OP_CLS", "OP_RET", "OP_SYS", "OP_JMP", "OP_CALL",
+    "OP_SE_VX_NN", "OP_SNE_VX_NN", "OP_SE_VX_VY", "OP_LD_VX_NN", "OP_ADD_VX_NN",
+    "OP_LD_VX_VY", "OP_OR", "OP_AND", "OP_XOR", "OP_ADD_VX_VY", "OP_SUB", "OP_SHR", "OP_SUBN", "OP_SHL",
+    "OP_SNE_VX_VY", "OP_LD_I", "OP_JMP_V0", "OP_RND", "OP_DRW", "OP_SKP", "OP_SKNP",
+    "OP_LD_VX_DT", "OP_LD_VX_K", "OP_LD_DT", "OP_LD_ST", "OP_ADD_I", "OP_LD_F", "OP_LD_B", "OP_LD_I_VX", "OP_LD_VX_I",
+    "OP_NOP",
+    "OP_SCD", "OP_SCU", "OP_SCR", "OP_SCL", "OP_EXIT", "OP_LOW", "OP_HIGH", "OP_DRW_EXT", "OP_CLS_EXT",
+    "OP_LD_HF", "OP_SAVE_FLAGS", "OP_LOAD_FLAGS", "OP_SAVE_RANGE", "OP_LOAD_RANGE", "OP_LD_I_LONG", "OP_PLANE",
+    "OP_AUDIO", "OP_PITCH"
+};
+
+struct Block {
+    uint16_t start;
+    uint16_t end;
+    uint16_t count;
+};
+
+static uint16_t
+opcode_at(const uint8_t *memory, uint16_t address)
+{
+    return memory[address] << 8 | memory[address + 1];
+}
+
+// Ops after which the pc isn't simply the next instruction, and stores that may rewrite the code that follows
+static bool
+ends_block(uint8_t op)
+{
+    switch (op)
+    {
+        case OP_JMP: case OP_SYS: case OP_CALL: case OP_RET: case OP_JMP_V0:
+        case OP_SE_VX_NN: case OP_SNE_VX_NN: case OP_SE_VX_VY: case OP_SNE_VX_VY: case OP_SKP: case OP_SKNP:
+        case OP_LD_VX_K: case OP_LD_B: case OP_LD_I_VX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Marks every address reached from 0x200 and the ones a block has to start at
+static void
+discover(const uint8_t *memory, bool *reached, bool *leader, uint32_t &tables)
+{
+    std::vector<uint16_t> work(1, MEMORY_START_ADDRESS);
+
+    while (!work.empty())
+    {
+        uint16_t start = work.back();
+        work.pop_back();
+
+        // The interpreter runs code that wraps around the end of memory
+        if (start + 1 >= MEMORY_SIZE || (reached[start] && leader[start]))
+        {
+            continue;
+        }
+
+        leader[start] = true;
+
+        for (uint16_t address = start; address + 1 < MEMORY_SIZE; address += 2)
+        {
+            // Falling into code walked before, it gets a block of its own instead of a copy in this one
+            if (reached[address])
+            {
+                leader[address] = true;
+                break;
+            }
+
+            reached[address] = true;
+            Instruction in = decode(opcode_at(memory, address));
+            uint16_t next = address + 2;
+
+            switch (in.op)
+            {
+                case OP_JMP:
+                case OP_SYS:
+                    work.push_back(in.nnn);
+                    break;
+                case OP_CALL:
+                    work.push_back(next);
+                    work.push_back(in.nnn);
+                    break;
+                case OP_JMP_V0:
+                    work.push_back(in.nnn);
+                    ++tables;
+
+                    for (int i = 0; i < MAX_JUMP_TABLE && in.nnn + i * 2 + 1 < MEMORY_SIZE; ++i)
+                    {
+                        if (decode(opcode_at(memory, in.nnn + i * 2)).op != OP_JMP)
+                        {
+                            break;
+                        }
+
+                        work.push_back(in.nnn + i * 2);
+                    }
+                    break;
+                case OP_SE_VX_NN: case OP_SNE_VX_NN: case OP_SE_VX_VY: case OP_SNE_VX_VY: case OP_SKP: case OP_SKNP:
+                    work.push_back(next + 2);
+                    work.push_back(next);
+                    break;
+                case OP_LD_VX_K: // spins on its own address until a key is down
+                    leader[address] = true;
+                    work.push_back(next);
+                    break;
+                case OP_LD_B:
+                case OP_LD_I_VX:
+                    work.push_back(next);
+                    break;
+            }
+
+            if (ends_block(in.op))
+            {
+                break;
+            }
+        }
+    }
+}
+
+// Straight-line code from each leader up to the next exit, leader or MAX_AOT_BLOCK_INSTRUCTIONS
+static std::vector<Block>
+form_blocks(const uint8_t *memory, bool *leader)
+{
+    std::vector<Block> blocks;
+
+    for (int start = 0; start < MEMORY_SIZE; ++start)
+    {
+        if (!leader[start])
+        {
+            continue;
+        }
+
+        Block block = { static_cast<uint16_t>(start), static_cast<uint16_t>(start), 0 };
+
+        while (block.end + 1 < MEMORY_SIZE)
+        {
+            Instruction in = decode(opcode_at(memory, block.end));
+            block.end += 2;
+            ++block.count;
+
+            if (ends_block(in.op) || block.end + 1 >= MEMORY_SIZE || leader[block.end])
+            {
+                break;
+            }
+
+            if (block.count == MAX_AOT_BLOCK_INSTRUCTIONS)
+            {
+                leader[block.end] = true;
+                break;
+            }
+        }
+
+        blocks.push_back(block);
+    }
+
+    return blocks;
+}
+
+// Where generated code goes after a block that ends at pc, straight to the next block when one starts there
+static void
+write_exit(FILE *out, const std::vector<int32_t> &index, uint32_t pc)
+{
+    if (pc < MEMORY_SIZE && index[pc] >= 0)
+    {
+        std::fprintf(out, "    goto at_%03X;\n", pc);
+    }
+    else
+    {
+        std::fprintf(out, "    goto dispatch;\n");
+    }
+}
+
+// One function per block, and a run function that chains them with direct jumps wherever the next pc is known at
+// recompile time. Only returns and BNNN go through the switch on the pc
+static void
+write_program(FILE *out, const char *rom_path, const uint8_t *memory, const std::vector<Block> &blocks, uint8_t quirks)
+{
+    uint16_t image_size = 0;
+    std::vector<int32_t> index(MEMORY_SIZE, -1);
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        image_size = std::max(image_size, blocks[i].end);
+        index[blocks[i].start] = static_cast<int32_t>(i);
+    }
+
+    std::fprintf(out, "// Recompiled from %s by ./bin/recompile, link it in with AOT=<this file> ./build.sh\n", rom_path);
+    std::fprintf(out, "#include \"aot.h\"\n\n");
+    std::fprintf(out, "static const uint8_t IMAGE[%u] = {", image_size);
+
+    for (uint16_t i = 0; i < image_size; ++i)
+    {
+        std::fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n    ", memory[i]);
+    }
+
+    std::fprintf(out, "\n};\n");
+
+    for (const Block &block : blocks)
+    {
+        std::fprintf(out, "\nstatic uint16_t\nblock_%03X(Chip8 &c)\n{\n", block.start);
+
+        for (uint16_t address = block.start; address < block.end; address += 2)
+        {
+            uint16_t opcode = opcode_at(memory, address);
+            Instruction in = decode(opcode);
+
+            std::fprintf(out, "    %sc.aot_step<%s, %s, 0x%X, 0x%X, 0x%02X, 0x%03X>(0x%03X); // %03X: %04X\n",
+                address + 2 == block.end ? "return " : "", QUIRK_TYPES[quirks], OP_IDENTIFIERS[in.op], in.x, in.y, in.nn,
+                in.nnn, address + 2, address, opcode);
+        }
+
+        std::fprintf(out, "}\n");
+    }
+
+    std::fprintf(out, "\nstatic uint32_t\nrun(Chip8 &c, const bool *live, uint32_t budget)\n{\n");
+    std::fprintf(out, "    uint32_t left = budget;\n    uint16_t pc = c.pc;\n\ndispatch:\n");
+    std::fprintf(out, "    switch (pc & MEMORY_MASK)\n    {\n");
+
+    for (const Block &block : blocks)
+    {
+        std::fprintf(out, "        case 0x%03X: goto at_%03X;\n", block.start, block.start);
+    }
+
+    std::fprintf(out, "        default:\n            c.pc = pc & MEMORY_MASK;\n            return budget - left;\n    }\n");
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        const Block &block = blocks[i];
+        uint16_t last = block.end - 2;
+        Instruction in = decode(opcode_at(memory, last));
+
+        std::fprintf(out, "\nat_%03X:\n    if (left < %u || !live[%u])\n    {\n", block.start, block.count,
+            static_cast<unsigned>(i));
+        std::fprintf(out, "        c.pc = 0x%03X;\n        return budget - left;\n    }\n\n", block.start);
+        std::fprintf(out, "    left -= %u;\n    pc = block_%03X(c);\n", block.count, block.start);
+
+        switch (in.op)
+        {
+            case OP_JMP:
+            case OP_SYS:
+            case OP_CALL:
+                write_exit(out, index, in.nnn);
+                break;
+            case OP_RET:
+            case OP_JMP_V0:
+                std::fprintf(out, "    goto dispatch;\n");
+                break;
+            case OP_SE_VX_NN: case OP_SNE_VX_NN: case OP_SE_VX_VY: case OP_SNE_VX_VY: case OP_SKP: case OP_SKNP:
+                std::fprintf(out, "    if (pc == 0x%03X)\n    {\n    ", block.end);
+                write_exit(out, index, block.end);
+                std::fprintf(out, "    }\n");
+                write_exit(out, index, block.end + 2);
+                break;
+            case OP_LD_VX_K:
+                std::fprintf(out, "    if (pc == 0x%03X)\n    {\n    ", last);
+                write_exit(out, index, last);
+                std::fprintf(out, "    }\n");
+                write_exit(out, index, block.end);
+                break;
+            default:
+                write_exit(out, index, block.end);
+                break;
+        }
+    }
+
+    std::fprintf(out, "}\n\nstatic const Aot_block BLOCKS[%u] = {\n", static_cast<unsigned>(blocks.size()));
+
+    for (const Block &block : blocks)
+    {
+        std::fprintf(out, "    { 0x%03X, 0x%03X, %u },\n", block.start, block.end, block.count);
+    }
+
+    std::fprintf(out, "};\n\nextern const Aot_program AOT_PROGRAM = { \"");
+
+    for (const char *c = rom_path; *c; ++c)
+    {
+        std::fprintf(out, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+    }
+
+    std::fprintf(out, "\", IMAGE, sizeof(IMAGE), BLOCKS, sizeof(BLOCKS) / sizeof(BLOCKS[0]), run, %s };\n",
+        QUIRK_IDENTIFIERS[quirks]);
+}
+
+int
+main(int argc, char **argv)
+{
+    char *rom_path = NULL;
+    char *out_path = NULL;
+    char *quirks_name = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "out", &value))
+        {
+            out_path = value;
+        }
+        else if (parse_option(argv[i], "quirks", &value) && value)
+        {
+            quirks_name = value;
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            rom_path = argv[i];
+        }
+    }
+
+    if (!rom_path)
+    {
+        std::fprintf(stderr, "usage: ./bin/recompile ROM [--out=FILE.cpp] [--quirks=legacy|vip|schip|modern]\n");
+        return 1;
+    }
+
+    uint64_t rom_size;
+    uint8_t *rom = read_file(rom_path, &rom_size);
+
+    if (!rom)
+    {
+        std::fprintf(stderr, "Can't read %s\n", rom_path);
+        return 1;
+    }
+
+    // The profile is compiled in, the emulator picks the same one for this ROM unless told otherwise
+    uint8_t quirks = rom_quirks(hash_bytes(rom, rom_size));
+
+    if (quirks_name && !parse_quirks(quirks_name, quirks))
+    {
+        std::fprintf(stderr, "Unknown quirk profile %s\n", quirks_name);
+        free(rom);
+        return 1;
+    }
+
+    // The same memory Chip8::load sets up
+    static uint8_t memory[MEMORY_SIZE];
+    std::copy(font, font + FONT_SIZE, memory);
+    std::copy(rom, rom + std::min<uint64_t>(rom_size, MEMORY_SIZE - MEMORY_START_ADDRESS), memory + MEMORY_START_ADDRESS);
+    free(rom);
+
+    static bool reached[MEMORY_SIZE];
+    static bool leader[MEMORY_SIZE];
+    uint32_t tables = 0;
+    discover(memory, reached, leader, tables);
+    std::vector<Block> blocks = form_blocks(memory, leader);
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+
+    if (!out)
+    {
+        std::fprintf(stderr, "Can't write %s\n", out_path);
+        return 1;
+    }
+
+    write_program(out, rom_path, memory, blocks, quirks);
+
+    if (out != stdout && std::fclose(out) != 0)
+    {
+        std::fprintf(stderr, "Can't write %s\n", out_path);
+        return 1;
+    }
+
+    uint32_t instructions = 0;
+
+    for (const Block &block : blocks)
+    {
+        instructions += block.count;
+    }
+
+    std::fprintf(stderr, "%s: %u blocks, %u instructions, %u BNNN jumps\n", rom_path, static_cast<unsigned>(blocks.size()),
+        instructions, tables);
+
+    return 0;
+}
@@ -0,0 +1,369 @@
+#include "recorder.h"
+#include "codec.h"
+#include "handoff.h"
+#include "pacer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <thread>
+
+const int FRAMES_HEADER_SIZE = 16;
+const uint32_t RECORDER_WAKE = RECORDER_QUEUE_SIZE / 2; // queued frames that wake the encoder early
+const double RECORDER_WAIT_MS = 10;
+const size_t RECORDER_BUFFER = 64 * 1024;
+
+struct Recorder {
+    FILE *file;
+    Spsc_queue<Captured_frame, RECORDER_QUEUE_SIZE> queue;
+    std::atomic<uint64_t> dropped;
+    bool stopped;
+
+    // Only touched by the emulating thread
+    // The last queued frame, its slot is only claimed again after the next frame was committed, so it stays
+    // readable here. Starts out as blank, a ROM that never draws writes no frames
+    const Captured_frame *last;
+    Captured_frame blank;
+
+    // Only touched by the encoder thread until it is joined
+    std::thread thread;
+    std::atomic<bool> stop;
+    Pacer *pacer;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t tick; // of the last frame written
+    uint8_t format;
+    uint8_t bits[2][FRAME_BYTES]; // the frame being encoded and the one before it
+    uint8_t delta[MAX_FRAME_DELTA];
+
+    Recorder() : dropped(0), stop(false) {}
+};
+
+struct Frames_file {
+    FILE *file;
+    uint64_t tick;
+    uint8_t format;
+    uint8_t bits[FRAME_BYTES];
+    uint8_t delta[MAX_FRAME_DELTA];
+};
+
+uint32_t
+frame_width(uint8_t format)
+{
+    return format & FRAME_HIRES ? HIRES_WIDTH : SCREEN_WIDTH;
+}
+
+uint32_t
+frame_height(uint8_t format)
+{
+    return format & FRAME_HIRES ? HIRES_HEIGHT : SCREEN_HEIGHT;
+}
+
+uint32_t
+frame_size(uint8_t format)
+{
+    return frame_width(format) * frame_height(format) / 8 * (format & FRAME_TWO_PLANES ? 2 : 1);
+}
+
+uint8_t
+frame_format(const Chip8 &c)
+{
+    return (c.hires ? FRAME_HIRES : 0) | (c.mode == MODE_XOCHIP ? FRAME_TWO_PLANES : 0);
+}
+
+// Each word is a row, or half of one in high resolution, column 0 in the top bit
+void
+frame_bits(const uint64_t *words, uint8_t format, uint8_t *bits)
+{
+    for (uint32_t i = 0; i < frame_size(format) / 8; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+        {
+            bits[i * 8 + j] = static_cast<uint8_t>(words[i] >> (56 - j * 8));
+        }
+    }
+}
+
+void
+frame_capture(const Chip8 &c, Captured_frame &frame)
+{
+    uint32_t rows = c.hires ? PLANE_WORDS : SCREEN_HEIGHT;
+    frame.format = frame_format(c);
+    frame.tick = c.ticks;
+
+    for (uint32_t plane = 0; plane < (frame.format & FRAME_TWO_PLANES ? 2u : 1u); ++plane)
+    {
+        std::memcpy(frame.words + plane * rows, c.video + plane * PLANE_WORDS, rows * sizeof(uint64_t));
+    }
+}
+
+static void
+write_frame(Recorder *recorder, const Captured_frame &queued)
+{
+    uint8_t *bits = recorder->bits[recorder->frames & 1];
+    uint8_t *previous = recorder->bits[~recorder->frames & 1];
+    uint32_t size = frame_size(queued.format);
+    frame_bits(queued.words, queued.format, bits);
+
+    if (queued.format != recorder->format || !recorder->frames)
+    {
+        std::memset(previous, 0, FRAME_BYTES);
+    }
+
+    uint8_t header[24];
+    size_t delta_length = delta_encode(bits, previous, size, recorder->delta);
+    size_t length = put_count(header, queued.tick > recorder->tick ? queued.tick - recorder->tick : 0); // 0 after a rewind
+    header[length++] = queued.format;
+    length += put_count(header + length, delta_length);
+
+    std::fwrite(header, 1, length, recorder->file);
+    std::fwrite(recorder->delta, 1, delta_length, recorder->file);
+
+    recorder->bytes += length + delta_length;
+    recorder->tick = queued.tick;
+    recorder->format = queued.format;
+    ++recorder->frames;
+}
+
+// Sleeps until half of the queue filled up or RECORDER_WAIT_MS passed, whichever is first, so a ROM at the default
+// speed costs one wakeup per frame or less and a headless run at full speed one per RECORDER_WAKE frames
+static void
+encode_frames(Recorder *recorder)
+{
+    for (;;)
+    {
+        bool stopping = recorder->stop.load(std::memory_order_acquire);
+
+        while (const Captured_frame *queued = recorder->queue.peek())
+        {
+            write_frame(recorder, *queued);
+            recorder->queue.release();
+        }
+
+        if (stopping)
+        {
+            return;
+        }
+
+        pacer_wait(recorder->pacer, RECORDER_WAIT_MS);
+    }
+}
+
+Recorder *
+recorder_create(const char *path)
+{
+    Recorder *recorder = new Recorder();
+    recorder->file = std::fopen(path, "wb");
+    recorder->pacer = pacer_create(false);
+
+    if (!recorder->file || !recorder->pacer)
+    {
+        if (recorder->file)
+        {
+            std::fclose(recorder->file);
+        }
+
+        if (recorder->pacer)
+        {
+            pacer_destroy(recorder->pacer);
+        }
+
+        delete recorder;
+        return NULL;
+    }
+
+    std::setvbuf(recorder->file, NULL, _IOFBF, RECORDER_BUFFER);
+
+    // The frame count is patched in when the file is finished
+    uint8_t header[FRAMES_HEADER_SIZE] = {};
+    put_le(header, FRAMES_MAGIC, 4);
+    put_le(header + 4, FRAMES_VERSION, 4);
+    std::fwrite(header, 1, sizeof(header), recorder->file);
+
+    recorder->stopped = false;
+    std::memset(&recorder->blank, 0, sizeof(recorder->blank));
+    recorder->last = &recorder->blank;
+    recorder->frames = 0;
+    recorder->bytes = FRAMES_HEADER_SIZE;
+    recorder->tick = 0;
+    recorder->format = 0;
+    recorder->thread = std::thread(encode_frames, recorder);
+    return recorder;
+}
+
+static void
+join_encoder(Recorder *recorder)
+{
+    if (recorder->stopped)
+    {
+        return;
+    }
+
+    recorder->stopped = true;
+    recorder->stop.store(true, std::memory_order_release);
+    pacer_wake(recorder->pacer);
+    recorder->thread.join();
+}
+
+void
+recorder_stop(Recorder *recorder, const Chip8 &c)
+{
+    if (recorder->stopped)
+    {
+        return;
+    }
+
+    join_encoder(recorder);
+
+    // The queue is empty now and nothing else writes the file, so a run that ended on a dropped frame gets it here
+    if (recorder_frame(recorder, c))
+    {
+        while (const Captured_frame *queued = recorder->queue.peek())
+        {
+            write_frame(recorder, *queued);
+            recorder->queue.release();
+        }
+    }
+
+    std::fflush(recorder->file);
+}
+
+void
+recorder_destroy(Recorder *recorder)
+{
+    join_encoder(recorder);
+
+    uint8_t count[8];
+    put_le(count, recorder->frames, 8);
+
+    if (std::fseek(recorder->file, 8, SEEK_SET) == 0)
+    {
+        std::fwrite(count, 1, sizeof(count), recorder->file);
+    }
+
+    std::fclose(recorder->file);
+    pacer_destroy(recorder->pacer);
+    delete recorder;
+}
+
+// A frame that finds the queue full leaves last alone, so the next tick tries again with whatever is on screen then.
+// A display that differs from the last frame is copied straight into the claimed slot
+bool
+recorder_frame(Recorder *recorder, const Chip8 &c)
+{
+    // Checked first, while the encoder is behind every tick costs only the two queue indices
+    Captured_frame *queued = recorder->queue.claim();
+
+    if (!queued)
+    {
+        // Only this thread writes it, a locked add would cost more than the rest of a dropped frame
+        recorder->dropped.store(recorder->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint8_t format = frame_format(c);
+    uint32_t rows = c.hires ? PLANE_WORDS : SCREEN_HEIGHT;
+    uint32_t planes = format & FRAME_TWO_PLANES ? 2 : 1;
+    bool changed = format != recorder->last->format;
+
+    for (uint32_t plane = 0; plane < planes && !changed; ++plane)
+    {
+        changed = std::memcmp(recorder->last->words + plane * rows, c.video + plane * PLANE_WORDS, rows * sizeof(uint64_t)) != 0;
+    }
+
+    if (!changed)
+    {
+        return true;
+    }
+
+    frame_capture(c, *queued);
+    recorder->last = queued;
+    recorder->queue.commit();
+
+    if (recorder->queue.size() == RECORDER_WAKE)
+    {
+        pacer_wake(recorder->pacer);
+    }
+
+    return true;
+}
+
+Recorder_stats
+recorder_stats(Recorder *recorder)
+{
+    Recorder_stats stats = {};
+    stats.dropped = recorder->dropped.load();
+
+    if (recorder->stopped)
+    {
+        stats.frames = recorder->frames;
+        stats.bytes = recorder->bytes;
+    }
+
+    return stats;
+}
+
+Frames_file *
+frames_open(const char *path)
+{
+    FILE *file = std::fopen(path, "rb");
+
+    if (!file)
+    {
+        return NULL;
+    }
+
+    uint8_t header[FRAMES_HEADER_SIZE];
+
+    if (std::fread(header, sizeof(header), 1, file) != 1 || get_le(header, 4) != FRAMES_MAGIC || get_le(header + 4, 4) != FRAMES_VERSION)
+    {
+        std::fclose(file);
+        return NULL;
+    }
+
+    Frames_file *frames = reinterpret_cast<Frames_file*>(calloc(1, sizeof(Frames_file)));
+    frames->file = file;
+    return frames;
+}
+
+void
+frames_close(Frames_file *file)
+{
+    std::fclose(file->file);
+    free(file);
+}
+
+bool
+frames_read(Frames_file *file, Recorded_frame &frame)
+{
+    uint64_t ticks;
+    uint64_t length;
+    int format;
+
+    // A stream cut short by a crash ends at its last whole frame
+    if (!read_count(file->file, &ticks) || (format = std::fgetc(file->file)) == EOF || !read_count(file->file, &length) ||
+        length > MAX_FRAME_DELTA || std::fread(file->delta, 1, static_cast<size_t>(length), file->file) != length)
+    {
+        return false;
+    }
+
+    if (format != file->format)
+    {
+        std::memset(file->bits, 0, sizeof(file->bits));
+    }
+
+    file->format = static_cast<uint8_t>(format);
+    file->tick += ticks;
+
+    if (!delta_apply(file->delta, static_cast<size_t>(length), file->bits, frame_size(file->format)))
+    {
+        return false;
+    }
+
+    frame.tick = file->tick;
+    frame.format = file->format;
+    std::memcpy(frame.bits, file->bits, sizeof(frame.bits));
+    return true;
+}
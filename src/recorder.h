@@ -0,0 +1,62 @@
+#pragma once
+#include "chip8.h"
+#include "codec.h"
+#include "win32.h"
+
+// Frame stream recording. On every timer tick that drew, cleared or scrolled, the emulating thread compares the
+// display with the last frame it handed over and, when it changed, copies the rows in use into a bounded lock-free queue. A thread of its own
+// encodes them and writes the file, so emulation never waits on the disk: a frame that finds the queue full is
+// dropped and the next one carries its time.
+// The file is a fixed header followed by one (LEB128 ticks since the previous frame, format byte, LEB128 delta
+// length, delta) per frame that changed. Frames are 1 bit per pixel rows, MSB first, one plane after the other,
+// and the delta holds runs of (unchanged bytes, changed bytes, changed bytes XORed) against the previous frame,
+// or against a blank one when the format changed
+struct Recorder;
+
+const uint32_t FRAMES_MAGIC = 0x53463843; // "C8FS" in a little-endian file
+const uint32_t FRAMES_VERSION = 1;
+const uint32_t RECORDER_QUEUE_SIZE = 512; // frames, over eight seconds of a ROM that redraws every tick
+
+enum FRAME_FORMATS {
+    FRAME_HIRES = 1, // 128x64, otherwise 64x32
+    FRAME_TWO_PLANES = 2 // XO-CHIP, otherwise only the first plane is kept
+};
+
+struct Recorded_frame {
+    uint64_t tick; // emulated 60Hz ticks since power-on
+    uint8_t format; // FRAME_FORMATS
+    uint8_t bits[PLANE_COUNT * HIRES_WIDTH * HIRES_HEIGHT / 8];
+};
+
+// The rows in use, plane after plane, as the emulating thread hands the display to the encoder or the broadcast
+struct Captured_frame {
+    uint64_t tick;
+    uint8_t format; // FRAME_FORMATS
+    uint64_t words[PLANE_COUNT * PLANE_WORDS];
+};
+
+const size_t FRAME_BYTES = sizeof(Recorded_frame::bits);
+const size_t MAX_FRAME_DELTA = max_delta(FRAME_BYTES);
+
+struct Frames_file;
+
+Recorder *recorder_create(const char *path); // NULL when the file can't be written
+void recorder_destroy(Recorder *recorder); // finishes the file
+bool recorder_frame(Recorder *recorder, const Chip8 &c); // queues the display when it changed, false if the queue was full
+// Joins the encoder after it wrote out every queued frame, then writes the display at exit if its frame was dropped.
+// The stats are final afterwards
+void recorder_stop(Recorder *recorder, const Chip8 &c);
+Recorder_stats recorder_stats(Recorder *recorder);
+
+// Reading a stream back for conversion
+Frames_file *frames_open(const char *path); // NULL on a missing file or wrong magic or version
+void frames_close(Frames_file *file);
+bool frames_read(Frames_file *file, Recorded_frame &frame); // the next frame, false at the end or on a corrupt one
+uint32_t frame_width(uint8_t format);
+uint32_t frame_height(uint8_t format);
+uint32_t frame_size(uint8_t format); // bytes of bits in use
+
+// Frames as the codec sees them, shared with the spectator broadcast
+uint8_t frame_format(const Chip8 &c);
+void frame_bits(const uint64_t *words, uint8_t format, uint8_t *bits); // the rows in use, plane after plane, to bytes
+void frame_capture(const Chip8 &c, Captured_frame &frame); // the display and its tick as they are now
@@ -0,0 +1,158 @@
+#include "rewind.h"
+#include "codec.h"
+#include "snapshot.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+const int LENGTH_BYTES = 3; // each delta has its length on both sides so the ring can be walked from either end
+const size_t MAX_DELTA = max_delta(sizeof(Snapshot));
+const uint64_t MIN_BUDGET = MAX_DELTA + 2 * LENGTH_BYTES;
+
+static_assert(MAX_DELTA < 1 << 8 * LENGTH_BYTES, "delta lengths must fit their length bytes");
+
+struct Rewind {
+    uint8_t *ring;
+    uint64_t budget;
+    uint64_t begin; // offset of the oldest delta, offsets only grow and wrap through % budget
+    uint64_t end;
+    uint64_t frames;
+    bool has_state;
+    int newest; // index into states of the latest frame, the other one is scratch
+    Snapshot states[2];
+    uint8_t delta[MAX_DELTA];
+};
+
+static void
+ring_write(Rewind *rewind, uint64_t offset, const uint8_t *data, size_t size)
+{
+    size_t at = static_cast<size_t>(offset % rewind->budget);
+    size_t first = std::min<size_t>(size, rewind->budget - at);
+
+    std::memcpy(rewind->ring + at, data, first);
+    std::memcpy(rewind->ring, data + first, size - first);
+}
+
+static void
+ring_read(const Rewind *rewind, uint64_t offset, uint8_t *data, size_t size)
+{
+    size_t at = static_cast<size_t>(offset % rewind->budget);
+    size_t first = std::min<size_t>(size, rewind->budget - at);
+
+    std::memcpy(data, rewind->ring + at, first);
+    std::memcpy(data + first, rewind->ring, size - first);
+}
+
+static uint32_t
+read_length(const Rewind *rewind, uint64_t offset)
+{
+    uint8_t bytes[LENGTH_BYTES];
+    ring_read(rewind, offset, bytes, sizeof(bytes));
+    return static_cast<uint32_t>(bytes[0] | bytes[1] << 8 | bytes[2] << 16);
+}
+
+Rewind *
+rewind_create(uint64_t budget)
+{
+    Rewind *rewind = reinterpret_cast<Rewind*>(calloc(1, sizeof(Rewind)));
+
+    if (!rewind)
+    {
+        return NULL;
+    }
+
+    rewind->budget = std::max(budget, MIN_BUDGET);
+    rewind->ring = reinterpret_cast<uint8_t*>(malloc(static_cast<size_t>(rewind->budget)));
+
+    if (!rewind->ring)
+    {
+        free(rewind);
+        return NULL;
+    }
+
+    return rewind;
+}
+
+void
+rewind_destroy(Rewind *rewind)
+{
+    free(rewind->ring);
+    free(rewind);
+}
+
+void
+rewind_clear(Rewind *rewind)
+{
+    rewind->begin = 0;
+    rewind->end = 0;
+    rewind->frames = 0;
+    rewind->has_state = false;
+}
+
+void
+rewind_push(Rewind *rewind, const Chip8 &c)
+{
+    Snapshot &latest = rewind->states[rewind->newest ^ 1];
+    snapshot_save(c, latest);
+
+    if (rewind->has_state)
+    {
+        // The delta takes the new frame back to the one before it
+        const uint8_t *after = reinterpret_cast<const uint8_t*>(&rewind->states[rewind->newest]);
+        const uint8_t *before = reinterpret_cast<const uint8_t*>(&latest);
+        size_t length = delta_encode(after, before, snapshot_size(latest), rewind->delta);
+        size_t size = length + 2 * LENGTH_BYTES;
+
+        while (rewind->end - rewind->begin + size > rewind->budget)
+        {
+            rewind->begin += read_length(rewind, rewind->begin) + 2 * LENGTH_BYTES;
+            --rewind->frames;
+        }
+
+        uint8_t header[LENGTH_BYTES] = { static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+            static_cast<uint8_t>(length >> 16) };
+        ring_write(rewind, rewind->end, header, LENGTH_BYTES);
+        ring_write(rewind, rewind->end + LENGTH_BYTES, rewind->delta, length);
+        ring_write(rewind, rewind->end + LENGTH_BYTES + length, header, LENGTH_BYTES);
+        rewind->end += size;
+        ++rewind->frames;
+    }
+
+    rewind->newest ^= 1;
+    rewind->has_state = true;
+}
+
+bool
+rewind_step(Rewind *rewind, Chip8 &c)
+{
+    if (!rewind->frames)
+    {
+        return false;
+    }
+
+    uint32_t length = read_length(rewind, rewind->end - LENGTH_BYTES);
+    rewind->end -= length + 2 * LENGTH_BYTES;
+    --rewind->frames;
+
+    ring_read(rewind, rewind->end + LENGTH_BYTES, rewind->delta, length);
+
+    Snapshot &state = rewind->states[rewind->newest];
+    delta_apply(rewind->delta, length, reinterpret_cast<uint8_t*>(&state), sizeof(state));
+    snapshot_restore(c, state);
+
+    return true;
+}
+
+Rewind_stats
+rewind_stats(const Rewind *rewind)
+{
+    Rewind_stats stats;
+    stats.frames = rewind->frames;
+    stats.used = rewind->end - rewind->begin;
+    stats.budget = rewind->budget;
+    stats.ratio = stats.used ? static_cast<double>(stats.frames) * snapshot_size(rewind->states[rewind->newest]) / stats.used : 0;
+
+    return stats;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "chip8.h"
+
+// Frame history for hold-to-rewind under a fixed memory budget. The newest state is kept whole, every older
+// frame is stored as the XOR of its snapshot with the next one, run-length encoded, since most frames only touch
+// a few bytes. Stepping back undoes one delta, so it costs the same however long the history is.
+// When the budget is full the oldest frames are dropped
+struct Rewind;
+
+struct Rewind_stats {
+    uint64_t frames; // steps back available
+    uint64_t used; // bytes of deltas held
+    uint64_t budget;
+    double ratio; // uncompressed snapshots over bytes held
+};
+
+Rewind *rewind_create(uint64_t budget); // NULL when the budget can't be allocated
+void rewind_destroy(Rewind *rewind);
+void rewind_clear(Rewind *rewind);
+void rewind_push(Rewind *rewind, const Chip8 &c); // once per emulated frame
+bool rewind_step(Rewind *rewind, Chip8 &c); // back to the frame before the newest one, false when out of history
+Rewind_stats rewind_stats(const Rewind *rewind);
@@ -0,0 +1,319 @@
+#include "win32.h"
+#include "posix.h"
+#include "chip8.h"
+#include "jit.h"
+#include "aot.h"
+#include "movie.h"
+#include "quirks.h"
+#include "pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Runs every ROM once per seed headless across all cores and reports how each instance ended, e.g.
+// ./bin/runner --seeds=1000 --frames=3600 --keys=random ./roms
+// Instances are independent jobs on a work-stealing pool, each worker reuses one machine for all of its jobs
+const uint64_t DEFAULT_FRAMES = 3600; // a minute of emulated time
+const uint64_t DEFAULT_SEEDS = 1;
+const uint64_t KEY_FRAMES = 60; // with --keys=random every instance picks a new key once a second
+
+enum EXITS {
+    EXIT_FRAMES, // ran for every frame asked for
+    EXIT_HALTED, // jumped to itself, nothing but the timers can change any more
+    EXIT_KEY_WAIT, // waiting on FX0A with no input coming
+    EXIT_NO_MEMORY, // the worker couldn't allocate its machine, never ran
+    EXIT_COUNT
+};
+
+const char *EXIT_NAMES[EXIT_COUNT] = { "frames", "halted", "key-wait", "no-memory" };
+
+struct Rom {
+    std::string path;
+    uint8_t *data;
+    uint64_t size;
+    uint8_t quirks; // QUIRK_PROFILES, from the database unless --quirks overrides it
+};
+
+struct Result {
+    uint64_t hash; // of the final framebuffer
+    uint64_t cycles;
+    uint64_t frames;
+    uint8_t exit; // EXITS
+};
+
+struct Farm {
+    std::vector<Rom> roms;
+    uint64_t seeds;
+    uint64_t frames;
+    uint8_t core;
+    bool random_keys;
+    std::vector<Chip8*> machines; // one per worker, allocated by the worker on its first job
+    std::vector<Result> results; // indexed by job, rom-major
+};
+
+// FNV-1a over the rows, stable across hosts since the bytes are taken from each row MSB first
+static uint64_t
+hash_video(const uint64_t *video)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (int i = 0; i < SCREEN_HEIGHT; ++i)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            hash = (hash ^ ((video[i] >> shift) & 0xFF)) * 0x100000001B3ULL;
+        }
+    }
+
+    return hash;
+}
+
+static Chip8 *
+create_machine(uint8_t core)
+{
+    Chip8 *machine = reinterpret_cast<Chip8*>(calloc(1, sizeof(Chip8)));
+
+    if (!machine)
+    {
+        return NULL;
+    }
+
+    machine->core = core;
+    machine->ips = DEFAULT_IPS;
+    machine->speed = 1;
+
+    if (core == CORE_JIT)
+    {
+        machine->jit = jit_create();
+        machine->core = machine->jit ? CORE_JIT : CORE_INTERPRETER;
+    }
+    else if (core == CORE_AOT)
+    {
+        machine->aot = aot_create();
+        machine->core = machine->aot ? CORE_AOT : CORE_INTERPRETER;
+    }
+
+    return machine;
+}
+
+static void
+run_instance(void *context, uint32_t worker, uint64_t job)
+{
+    Farm *farm = reinterpret_cast<Farm*>(context);
+    Chip8 *&machine = farm->machines[worker];
+
+    if (!machine)
+    {
+        machine = create_machine(farm->core);
+    }
+
+    const Rom &rom = farm->roms[job / farm->seeds];
+    uint32_t seed = static_cast<uint32_t>(job % farm->seeds);
+    uint32_t keys = random_seed(seed, 1); // the machine itself draws from stream 0
+    Result &result = farm->results[job];
+    Run_stats stats = {};
+
+    // The next job on this worker tries again
+    if (!machine)
+    {
+        result.exit = EXIT_NO_MEMORY;
+        return;
+    }
+
+    machine->quirks = rom.quirks;
+    machine->load(rom.data, rom.size, seed);
+    result.exit = EXIT_FRAMES;
+
+    while (stats.frames < farm->frames)
+    {
+        if (farm->random_keys && stats.frames % KEY_FRAMES == 0)
+        {
+            uint32_t value = next_random(keys);
+            std::memset(machine->keypad, false, sizeof(machine->keypad));
+            machine->keypad[value & 0xF] = (value >> 4) & 1;
+        }
+
+        run_application(machine, 0, stats.frames + 1, stats);
+
+        uint16_t pc = machine->pc & MEMORY_MASK;
+        uint16_t opcode = machine->memory[pc] << 8 | machine->memory[(pc + 1) & MEMORY_MASK];
+
+        if (opcode == (0x1000 | pc))
+        {
+            result.exit = EXIT_HALTED;
+            break;
+        }
+
+        if (!farm->random_keys && (opcode & 0xF0FF) == 0xF00A && !machine->any_key())
+        {
+            result.exit = EXIT_KEY_WAIT;
+            break;
+        }
+    }
+
+    result.hash = hash_video(machine->video);
+    result.cycles = stats.cycles;
+    result.frames = stats.frames;
+}
+
+int
+main(int argc, char **argv)
+{
+    Farm farm;
+    farm.seeds = DEFAULT_SEEDS;
+    farm.frames = DEFAULT_FRAMES;
+    farm.core = CORE_INTERPRETER;
+    farm.random_keys = false;
+
+    uint32_t threads = pool_default_threads();
+    const char *report_path = NULL;
+    const char *quirks_name = NULL;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "threads", &value))
+        {
+            threads = static_cast<uint32_t>(std::max<uint64_t>(parse_u64(value, threads), 1));
+        }
+        else if (parse_option(argv[i], "seeds", &value))
+        {
+            farm.seeds = std::max<uint64_t>(parse_u64(value, DEFAULT_SEEDS), 1);
+        }
+        else if (parse_option(argv[i], "frames", &value))
+        {
+            farm.frames = parse_u64(value, DEFAULT_FRAMES);
+        }
+        else if (parse_option(argv[i], "core", &value) && value)
+        {
+            farm.core = std::strcmp(value, "jit") == 0 ? CORE_JIT : std::strcmp(value, "threaded") == 0 ? CORE_THREADED :
+                std::strcmp(value, "aot") == 0 ? CORE_AOT : CORE_INTERPRETER;
+        }
+        else if (parse_option(argv[i], "keys", &value) && value)
+        {
+            farm.random_keys = std::strcmp(value, "random") == 0;
+        }
+        else if (parse_option(argv[i], "quirks", &value) && value)
+        {
+            quirks_name = value;
+        }
+        else if (parse_option(argv[i], "report", &value))
+        {
+            report_path = value;
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            add_roms(argv[i], paths);
+        }
+    }
+
+    if (paths.empty())
+    {
+        add_roms("roms", paths);
+    }
+
+    for (std::string &path : paths)
+    {
+        Rom rom;
+        rom.path = path;
+        rom.data = read_file(&path[0], &rom.size);
+
+        if (rom.data)
+        {
+            rom.quirks = rom_quirks(hash_bytes(rom.data, rom.size));
+
+            if (quirks_name && !parse_quirks(quirks_name, rom.quirks))
+            {
+                std::fprintf(stderr, "Unknown quirk profile %s\n", quirks_name);
+                return 1;
+            }
+
+            farm.roms.push_back(rom);
+        }
+        else
+        {
+            std::fprintf(stderr, "Can't read %s\n", path.c_str());
+        }
+    }
+
+    uint64_t count = farm.roms.size() * farm.seeds;
+    farm.machines.assign(threads, NULL);
+    farm.results.assign(count, Result());
+
+    std::vector<Pool_stats> workers(threads);
+    double start_time = time_ms();
+    pool_run(threads, count, run_instance, &farm, workers.data());
+    double elapsed = (time_ms() - start_time) / 1000;
+
+    // Per instance lines in job order, so reports from different thread counts can be diffed
+    FILE *report = report_path ? std::fopen(report_path, "w") : stdout;
+
+    if (!report)
+    {
+        std::fprintf(stderr, "Can't write %s\n", report_path);
+        report = stdout;
+    }
+
+    uint64_t total_cycles = 0;
+    uint64_t exits[EXIT_COUNT] = {};
+
+    std::fprintf(report, "%-24s%12s%10s%10s%14s%18s\n", "rom", "seed", "exit", "frames", "cycles", "hash");
+
+    for (uint64_t job = 0; job < count; ++job)
+    {
+        const Result &result = farm.results[job];
+        const std::string &path = farm.roms[job / farm.seeds].path;
+        const char *name = std::strrchr(path.c_str(), '/');
+
+        std::fprintf(report, "%-24s%12llu%10s%10llu%14llu  %016llx\n", name ? name + 1 : path.c_str(),
+            static_cast<unsigned long long>(job % farm.seeds), EXIT_NAMES[result.exit],
+            static_cast<unsigned long long>(result.frames), static_cast<unsigned long long>(result.cycles),
+            static_cast<unsigned long long>(result.hash));
+
+        total_cycles += result.cycles;
+        ++exits[result.exit];
+    }
+
+    if (report != stdout)
+    {
+        std::fclose(report);
+    }
+
+    std::printf("\n%llu instances on %u threads in %.2f s, %.1f MIPS\n", static_cast<unsigned long long>(count), threads,
+        elapsed, elapsed > 0 ? total_cycles / elapsed / 1000000 : 0);
+
+    for (int i = 0; i < EXIT_COUNT; ++i)
+    {
+        std::printf("%-10s%12llu\n", EXIT_NAMES[i], static_cast<unsigned long long>(exits[i]));
+    }
+
+    std::printf("\n%-8s%12s%10s%12s\n", "worker", "jobs", "steals", "busy ms");
+
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        std::printf("%-8u%12llu%10llu%12.1f\n", i, static_cast<unsigned long long>(workers[i].jobs),
+            static_cast<unsigned long long>(workers[i].steals), workers[i].busy_ms);
+    }
+
+    for (Chip8 *machine : farm.machines)
+    {
+        if (machine)
+        {
+            destroy_application(machine);
+        }
+    }
+
+    for (Rom &rom : farm.roms)
+    {
+        free(rom.data);
+    }
+
+    return exits[EXIT_NO_MEMORY] ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+
+const int SNAPSHOT_BLOCK = 256; // bytes of memory compared at once on restore
+
+void
+snapshot_save(const Chip8 &c, Snapshot &snapshot)
+{
+    snapshot.magic = SNAPSHOT_MAGIC;
+    snapshot.version = SNAPSHOT_VERSION;
+    snapshot.cycles = c.cycles;
+    snapshot.ticks = c.ticks;
+    snapshot.cycle_budget = c.cycle_budget;
+    std::memcpy(snapshot.video, c.video, sizeof(snapshot.video));
+    snapshot.rng = c.rng;
+    snapshot.index = c.index;
+    snapshot.pc = c.pc;
+    snapshot.sp = c.sp;
+    snapshot.delay_timer = c.delay_timer;
+    snapshot.sound_timer = c.sound_timer;
+    std::memcpy(snapshot.stack, c.stack, sizeof(snapshot.stack));
+    std::memcpy(snapshot.registers, c.registers, sizeof(snapshot.registers));
+    std::memcpy(snapshot.keypad, c.keypad, sizeof(snapshot.keypad));
+    snapshot.prev_key_press = c.prev_key_press;
+    snapshot.latest_key_press = c.latest_key_press;
+    snapshot.running = c.running;
+    snapshot.hires = c.hires;
+    snapshot.planes = c.planes;
+    snapshot.pitch = c.pitch;
+    std::memcpy(snapshot.flags, c.flags, sizeof(snapshot.flags));
+    std::memcpy(snapshot.pattern, c.pattern, sizeof(snapshot.pattern));
+    snapshot.mode = c.mode;
+    std::memset(snapshot.reserved, 0, sizeof(snapshot.reserved));
+    std::memcpy(snapshot.memory, c.memory, c.memory_mask + 1);
+}
+
+void
+snapshot_restore(Chip8 &c, const Snapshot &snapshot)
+{
+    c.cycles = snapshot.cycles;
+    c.ticks = snapshot.ticks;
+    c.cycle_budget = snapshot.cycle_budget;
+    c.rng = snapshot.rng;
+    c.index = snapshot.index;
+    c.pc = snapshot.pc;
+    c.sp = snapshot.sp;
+    c.delay_timer = snapshot.delay_timer;
+    c.sound_timer = snapshot.sound_timer;
+    std::memcpy(c.stack, snapshot.stack, sizeof(c.stack));
+    std::memcpy(c.registers, snapshot.registers, sizeof(c.registers));
+
+    for (int i = 0; i < 16; ++i)
+    {
+        c.keypad[i] = snapshot.keypad[i] != 0;
+    }
+
+    c.prev_key_press = snapshot.prev_key_press;
+    c.latest_key_press = snapshot.latest_key_press;
+    c.running = snapshot.running != 0;
+    c.planes = snapshot.planes;
+    c.pitch = snapshot.pitch;
+    std::memcpy(c.flags, snapshot.flags, sizeof(c.flags));
+    std::memcpy(c.pattern, snapshot.pattern, sizeof(c.pattern));
+
+    if (c.hires != (snapshot.hires != 0))
+    {
+        c.hires = snapshot.hires != 0;
+        std::memset(c.dirty, 0xFF, sizeof(c.dirty));
+    }
+
+    ++c.video_writes;
+
+    // A word is a whole row in low resolution and half of one of the two rows under a dirty row in high resolution
+    for (int plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        uint64_t *words = c.video + plane * PLANE_WORDS;
+        const uint64_t *saved = snapshot.video + plane * PLANE_WORDS;
+
+        if (std::memcmp(words, saved, PLANE_WORDS * sizeof(uint64_t)) == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < PLANE_WORDS; ++i)
+        {
+            if (words[i] != saved[i])
+            {
+                words[i] = saved[i];
+                c.dirty[c.hires ? i / 4 : i % SCREEN_HEIGHT] = 0xFF;
+            }
+        }
+    }
+
+    // Restoring usually goes back a few frames, where at most a handful of data bytes differ
+    for (int i = 0; i <= c.memory_mask; i += SNAPSHOT_BLOCK)
+    {
+        uint64_t differ = 0;
+
+        for (int j = i; j < i + SNAPSHOT_BLOCK; j += 8)
+        {
+            uint64_t current, saved;
+            std::memcpy(&current, c.memory + j, sizeof(current));
+            std::memcpy(&saved, snapshot.memory + j, sizeof(saved));
+            differ |= current ^ saved;
+        }
+
+        if (!differ)
+        {
+            continue;
+        }
+
+        for (int j = i; j < i + SNAPSHOT_BLOCK; j += 8)
+        {
+            uint64_t current, saved;
+            std::memcpy(&current, c.memory + j, sizeof(current));
+            std::memcpy(&saved, snapshot.memory + j, sizeof(saved));
+
+            for (int k = j; current != saved && k < j + 8; ++k)
+            {
+                if (c.memory[k] != snapshot.memory[k])
+                {
+                    c.write_memory(static_cast<uint16_t>(k), snapshot.memory[k]);
+                }
+            }
+        }
+    }
+}
+
+bool
+snapshot_write(const Snapshot &snapshot, const char *path)
+{
+    FILE *file = std::fopen(path, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    bool written = std::fwrite(&snapshot, snapshot_size(snapshot), 1, file) == 1;
+    return std::fclose(file) == 0 && written;
+}
+
+bool
+snapshot_read(Snapshot &snapshot, const char *path)
+{
+    FILE *file = std::fopen(path, "rb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    // Anything past the snapshot means the file is something else
+    size_t size = std::fread(&snapshot, 1, sizeof(snapshot), file);
+    bool longer = std::fgetc(file) != EOF;
+    std::fclose(file);
+
+    return size >= offsetof(Snapshot, memory) && size == snapshot_size(snapshot) && !longer &&
+        snapshot.magic == SNAPSHOT_MAGIC && snapshot.version == SNAPSHOT_VERSION;
+}
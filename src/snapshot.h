@@ -0,0 +1,55 @@
+#pragma once
+#include "chip8.h"
+
+#include <cstddef>
+
+// Everything a ROM can observe about a running machine, for save states, rewind and run-ahead.
+// Saving and restoring are plain copies into and out of caller storage, the file form is the same bytes behind
+// a magic and version. Only XO-CHIP states use all of memory, the others end after the first 4KB of it.
+// Settings chosen at startup (core, ips, speed, display) are not part of a snapshot, the mode is only recorded
+const uint32_t SNAPSHOT_MAGIC = 0x38504843; // "CHP8" in a little-endian file
+const uint32_t SNAPSHOT_VERSION = 2; // 2 added the SUPER-CHIP and XO-CHIP state
+
+struct Snapshot {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t cycles;
+    uint64_t ticks;
+    double cycle_budget;
+    uint64_t video[PLANE_COUNT * PLANE_WORDS];
+    uint32_t rng;
+    uint16_t index;
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t delay_timer;
+    uint16_t sound_timer;
+    uint16_t stack[16];
+    uint8_t registers[16];
+    uint8_t keypad[16];
+    uint8_t prev_key_press;
+    uint8_t latest_key_press;
+    uint8_t running;
+    uint8_t hires;
+    uint8_t planes;
+    uint8_t pitch;
+    uint8_t flags[16];
+    uint8_t pattern[16];
+    uint8_t mode; // MODES it was saved in
+    uint8_t reserved[3]; // zero, keeps memory 8 byte aligned and the size free of padding
+    uint8_t memory[XO_MEMORY_SIZE]; // past snapshot_size nothing is saved
+};
+
+static_assert(sizeof(Snapshot) == 2200 + XO_MEMORY_SIZE, "Snapshot must not contain padding, the file form is its bytes");
+
+// Bytes from the start of the snapshot that are saved, written, compared and hashed
+inline size_t
+snapshot_size(const Snapshot &snapshot)
+{
+    return offsetof(Snapshot, memory) + (snapshot.mode == MODE_XOCHIP ? XO_MEMORY_SIZE : MEMORY_SIZE);
+}
+
+void snapshot_save(const Chip8 &c, Snapshot &snapshot);
+// Only the memory that differs is re-decoded and dropped from the JIT, only the tiles that differ are redrawn
+void snapshot_restore(Chip8 &c, const Snapshot &snapshot);
+bool snapshot_write(const Snapshot &snapshot, const char *path);
+bool snapshot_read(Snapshot &snapshot, const char *path); // false on a missing file, wrong magic, version or size
@@ -0,0 +1,205 @@
+#include "posix.h"
+#include "broadcast.h"
+#include "movie.h"
+#include "recorder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Subscribes to an emulator started with --serve and rebuilds every frame from the deltas, checking each one
+// against the hash the server sent with it, e.g.
+// ./bin/emulator --serve=unix:/tmp/chip8.sock ./roms/BRIX & ./bin/spectate unix:/tmp/chip8.sock --clients=8
+// Exits with 1 when any frame didn't match or a client got none
+const uint64_t DEFAULT_FRAMES = 600;
+const uint64_t MAX_CLIENTS = BROADCAST_MAX_SUBSCRIBERS;
+
+struct Spectator {
+    const char *address;
+    uint64_t max_frames;
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t mismatches; // frames whose bits didn't hash to what the server sent
+    uint64_t bytes;
+    uint64_t last_tick;
+    const char *error; // why it stopped early, NULL when it got max_frames or the server closed the stream
+};
+
+static bool
+read_exact(int fd, uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t received = recv(fd, data, size, 0);
+
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (received <= 0)
+        {
+            return false;
+        }
+
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+
+    return true;
+}
+
+static void
+spectate(Spectator *spectator)
+{
+    int fd = open_socket(spectator->address, false);
+
+    if (fd < 0)
+    {
+        spectator->error = "can't connect";
+        return;
+    }
+
+    uint8_t header[BROADCAST_HEADER_SIZE];
+
+    if (!read_exact(fd, header, sizeof(header)) || get_le(header, 4) != BROADCAST_MAGIC || get_le(header + 4, 4) != BROADCAST_VERSION)
+    {
+        spectator->error = "not a spectator stream";
+        close(fd);
+        return;
+    }
+
+    spectator->bytes += sizeof(header);
+
+    std::vector<uint8_t> message(BROADCAST_MESSAGE_HEADER + MAX_FRAME_DELTA);
+    uint8_t bits[FRAME_BYTES] = {};
+    bool synced = false;
+    uint8_t format = 0;
+
+    while (spectator->frames < spectator->max_frames)
+    {
+        // A closed stream is the emulator exiting, not an error
+        if (!read_exact(fd, &message[0], 4))
+        {
+            break;
+        }
+
+        uint64_t length = get_le(&message[0], 4);
+
+        if (length < BROADCAST_MESSAGE_HEADER - 4 || length > message.size() - 4 || !read_exact(fd, &message[4], length))
+        {
+            spectator->error = "corrupt message";
+            break;
+        }
+
+        bool keyframe = (message[12] & BROADCAST_KEYFRAME) != 0;
+        uint8_t frame_format = message[12] & ~BROADCAST_KEYFRAME;
+
+        // Deltas only ever follow a keyframe of the same format
+        if (!keyframe && (!synced || frame_format != format))
+        {
+            spectator->error = "delta without a keyframe";
+            break;
+        }
+
+        if (keyframe)
+        {
+            std::memset(bits, 0, sizeof(bits));
+            ++spectator->keyframes;
+        }
+
+        synced = true;
+        format = frame_format;
+        uint32_t size = frame_size(format);
+
+        if (!delta_apply(&message[BROADCAST_MESSAGE_HEADER], length + 4 - BROADCAST_MESSAGE_HEADER, bits, size))
+        {
+            spectator->error = "corrupt delta";
+            break;
+        }
+
+        if (hash_bytes(bits, size) != get_le(&message[13], 8))
+        {
+            ++spectator->mismatches;
+        }
+
+        spectator->last_tick = get_le(&message[4], 8);
+        spectator->bytes += length + 4;
+        ++spectator->frames;
+    }
+
+    close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+    char *address = NULL;
+    uint64_t max_frames = DEFAULT_FRAMES;
+    uint64_t clients = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char *value;
+
+        if (parse_option(argv[i], "frames", &value))
+        {
+            max_frames = std::max<uint64_t>(parse_u64(value, DEFAULT_FRAMES), 1);
+        }
+        else if (parse_option(argv[i], "clients", &value))
+        {
+            clients = std::min<uint64_t>(std::max<uint64_t>(parse_u64(value, 1), 1), MAX_CLIENTS);
+        }
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            address = argv[i];
+        }
+    }
+
+    if (!address)
+    {
+        std::fprintf(stderr, "usage: ./bin/spectate ADDRESS [--frames=N] [--clients=N]\n");
+        return 1;
+    }
+
+    std::vector<Spectator> spectators(clients);
+    std::vector<std::thread> threads;
+
+    for (Spectator &spectator : spectators)
+    {
+        spectator = Spectator();
+        spectator.address = address;
+        spectator.max_frames = max_frames;
+        threads.push_back(std::thread(spectate, &spectator));
+    }
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    bool failed = false;
+    std::printf("%-8s%10s%11s%12s%12s%12s\n", "client", "frames", "keyframes", "mismatches", "bytes", "last tick");
+
+    for (uint64_t i = 0; i < clients; ++i)
+    {
+        const Spectator &spectator = spectators[i];
+        std::printf("%-8llu%10llu%11llu%12llu%12llu%12llu", static_cast<unsigned long long>(i),
+            static_cast<unsigned long long>(spectator.frames), static_cast<unsigned long long>(spectator.keyframes),
+            static_cast<unsigned long long>(spectator.mismatches), static_cast<unsigned long long>(spectator.bytes),
+            static_cast<unsigned long long>(spectator.last_tick));
+        std::printf("  %s\n", spectator.error ? spectator.error : "");
+        failed |= spectator.error != NULL || spectator.mismatches > 0 || spectator.frames == 0;
+    }
+
+    std::printf(failed ? "FAILED\n" : "every frame matched\n");
+    return failed ? 1 : 0;
+}
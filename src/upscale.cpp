@@ -0,0 +1,299 @@
+#include "upscale.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define UPSCALE_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+typedef void (*Expand_kernel)(const uint8_t *bits, int first, int count, int scale, uint32_t *out);
+
+static inline bool
+get_bit(const uint8_t *bits, int index)
+{
+    return (bits[index >> 3] >> (7 - (index & 7))) & 1;
+}
+
+static void
+expand_scalar(const uint8_t *bits, int first, int count, int scale, uint32_t *out)
+{
+    for (int i = 0; i < count; ++i, out += scale)
+    {
+        std::fill(out, out + scale, get_bit(bits, first + i) ? PIXEL_ON : PIXEL_OFF);
+    }
+}
+
+#if UPSCALE_X86
+// Each cell is a run of unaligned stores that may overshoot into the next cell, which then overwrites it
+static void
+expand_sse2(const uint8_t *bits, int first, int count, int scale, uint32_t *out)
+{
+    const __m128i on = _mm_set1_epi32(static_cast<int>(PIXEL_ON));
+    const __m128i off = _mm_set1_epi32(static_cast<int>(PIXEL_OFF));
+
+    for (int i = 0; i < count; ++i, out += scale)
+    {
+        __m128i value = get_bit(bits, first + i) ? on : off;
+
+        for (int k = 0; k < scale; k += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), value);
+        }
+    }
+}
+
+TARGET_AVX2 static void
+expand_avx2(const uint8_t *bits, int first, int count, int scale, uint32_t *out)
+{
+    const __m256i on = _mm256_set1_epi32(static_cast<int>(PIXEL_ON));
+    const __m256i off = _mm256_set1_epi32(static_cast<int>(PIXEL_OFF));
+
+    for (int i = 0; i < count; ++i, out += scale)
+    {
+        __m256i value = get_bit(bits, first + i) ? on : off;
+
+        for (int k = 0; k < scale; k += 8)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), value);
+        }
+    }
+}
+
+static bool
+cpu_has_avx2()
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS has to save the ymm registers as well
+    __cpuid(info, 1);
+
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+#endif
+
+static Expand_kernel
+find_kernel(int kernel)
+{
+    switch (kernel)
+    {
+        case KERNEL_SCALAR:
+            return expand_scalar;
+#if UPSCALE_X86
+        case KERNEL_SSE2:
+            return expand_sse2;
+        case KERNEL_AVX2:
+            return cpu_has_avx2() ? expand_avx2 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static Expand_kernel
+best_kernel()
+{
+    for (int kernel = KERNEL_COUNT - 1; kernel > KERNEL_SCALAR; --kernel)
+    {
+        if (Expand_kernel found = find_kernel(kernel))
+        {
+            return found;
+        }
+    }
+
+    return expand_scalar;
+}
+
+static Expand_kernel expand = best_kernel();
+
+void
+expand_line(const uint8_t *bits, int first, int count, int scale, uint32_t *out)
+{
+    expand(bits, first, count, scale, out);
+}
+
+bool
+upscale_select(int kernel)
+{
+    Expand_kernel found = find_kernel(kernel);
+
+    if (found)
+    {
+        expand = found;
+    }
+
+    return found != NULL;
+}
+
+const char *
+upscale_kernel_name(int kernel)
+{
+    static const char *names[KERNEL_COUNT] = { "scalar", "sse2", "avx2" };
+    return kernel >= 0 && kernel < KERNEL_COUNT ? names[kernel] : "unknown";
+}
+
+int
+filter_factor(uint8_t filter)
+{
+    return filter == FILTER_SCALE3X ? 3 : filter == FILTER_SCALE2X ? 2 : 1;
+}
+
+// Spreads the bits of a byte 2 or 3 apart, MSB first, so filtered sub-columns can be OR'd together
+struct Spread_tables {
+    uint16_t two[256];
+    uint32_t three[256];
+
+    Spread_tables()
+    {
+        for (int value = 0; value < 256; ++value)
+        {
+            two[value] = 0;
+            three[value] = 0;
+
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                if (value & (0x80 >> bit))
+                {
+                    two[value] |= 0x8000 >> (bit * 2);
+                    three[value] |= 0x800000 >> (bit * 3);
+                }
+            }
+        }
+    }
+};
+
+static const Spread_tables spread;
+
+static inline uint8_t
+row_byte(uint64_t row, int index)
+{
+    return static_cast<uint8_t>(row >> (56 - 8 * index));
+}
+
+// Neighbours with the edges clamped, column 0 is the top bit so the left neighbour is a right shift
+static inline uint64_t
+left_of(uint64_t row)
+{
+    return (row >> 1) | (row & 0x8000000000000000ULL);
+}
+
+static inline uint64_t
+right_of(uint64_t row)
+{
+    return (row << 1) | (row & 1);
+}
+
+static inline uint64_t
+choose(uint64_t mask, uint64_t taken, uint64_t otherwise)
+{
+    return (mask & taken) | (~mask & otherwise);
+}
+
+static void
+interleave2(uint64_t a, uint64_t b, uint8_t *out)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        uint16_t value = spread.two[row_byte(a, i)] | (spread.two[row_byte(b, i)] >> 1);
+        out[i * 2] = static_cast<uint8_t>(value >> 8);
+        out[i * 2 + 1] = static_cast<uint8_t>(value);
+    }
+}
+
+static void
+interleave3(uint64_t a, uint64_t b, uint64_t c, uint8_t *out)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        uint32_t value = spread.three[row_byte(a, i)] | (spread.three[row_byte(b, i)] >> 1) | (spread.three[row_byte(c, i)] >> 2);
+        out[i * 3] = static_cast<uint8_t>(value >> 16);
+        out[i * 3 + 1] = static_cast<uint8_t>(value >> 8);
+        out[i * 3 + 2] = static_cast<uint8_t>(value);
+    }
+}
+
+// Scale2x/Scale3x (AdvMAME) evaluated for all 64 columns at once, equality of 1-bit pixels is just XNOR
+void
+filter_row(const uint64_t *video, int rows, int row, uint8_t filter, uint8_t *out)
+{
+    uint64_t e = video[row];
+
+    if (filter == FILTER_NONE)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            out[i] = row_byte(e, i);
+        }
+
+        return;
+    }
+
+    uint64_t b = video[std::max(row - 1, 0)];
+    uint64_t h = video[std::min(row + 1, rows - 1)];
+    uint64_t d = left_of(e);
+    uint64_t f = right_of(e);
+
+    if (filter == FILTER_SCALE2X)
+    {
+        uint64_t e0 = choose(~(d ^ b) & (d ^ h) & (b ^ f), b, e);
+        uint64_t e1 = choose(~(b ^ f) & (b ^ d) & (f ^ h), f, e);
+        uint64_t e2 = choose(~(h ^ d) & (h ^ f) & (d ^ b), d, e);
+        uint64_t e3 = choose(~(f ^ h) & (f ^ b) & (h ^ d), h, e);
+
+        interleave2(e0, e1, out);
+        interleave2(e2, e3, out + 16);
+        return;
+    }
+
+    uint64_t a = left_of(b);
+    uint64_t c = right_of(b);
+    uint64_t g = left_of(h);
+    uint64_t i = right_of(h);
+
+    uint64_t top_left = ~(d ^ b) & (b ^ f) & (d ^ h);
+    uint64_t top_right = ~(b ^ f) & (b ^ d) & (f ^ h);
+    uint64_t bottom_left = ~(d ^ h) & (d ^ b) & (h ^ f);
+    uint64_t bottom_right = ~(h ^ f) & (d ^ h) & (b ^ f);
+
+    uint64_t e0 = choose(top_left, d, e);
+    uint64_t e1 = choose((top_left & (e ^ c)) | (top_right & (e ^ a)), b, e);
+    uint64_t e2 = choose(top_right, f, e);
+    uint64_t e3 = choose((top_left & (e ^ g)) | (bottom_left & (e ^ a)), d, e);
+    uint64_t e5 = choose((top_right & (e ^ i)) | (bottom_right & (e ^ c)), f, e);
+    uint64_t e6 = choose(bottom_left, d, e);
+    uint64_t e7 = choose((bottom_left & (e ^ i)) | (bottom_right & (e ^ g)), h, e);
+    uint64_t e8 = choose(bottom_right, f, e);
+
+    interleave3(e0, e1, e2, out);
+    interleave3(e3, e, e5, out + 24);
+    interleave3(e6, e7, e8, out + 48);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// Turns the packed 1-bit display into 32-bit pixels at an integer scale, optionally smoothing edges first
+
+enum FILTERS {
+    FILTER_NONE,
+    FILTER_SCALE2X,
+    FILTER_SCALE3X
+};
+
+enum UPSCALE_KERNELS {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_COUNT
+};
+
+const int MAX_SCALE = 128;
+const int MAX_FILTER_FACTOR = 3;
+const int EXPAND_PADDING = 8; // pixels a kernel may write past the end of its output
+const uint32_t PIXEL_ON = 0xFFFFFFFF;
+const uint32_t PIXEL_OFF = 0;
+
+// Filtered rows are MSB first bitmaps, factor rows of 8 * factor bytes for each display row
+int filter_factor(uint8_t filter);
+void filter_row(const uint64_t *video, int rows, int row, uint8_t filter, uint8_t *out);
+
+// Writes count * scale pixels for bits [first, first + count), out needs EXPAND_PADDING spare pixels
+void expand_line(const uint8_t *bits, int first, int count, int scale, uint32_t *out);
+
+// The best kernel the CPU supports is used by default, select fails for kernels the CPU lacks
+bool upscale_select(int kernel);
+const char *upscale_kernel_name(int kernel);
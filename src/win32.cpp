@@ -1,9 +1,12 @@
 #include "win32.h"
+#include "emulation.h"
 #include <windows.h>
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
 
+const double HOST_IDLE_TIME = 1000; // ms, frames and messages end the wait, this only bounds it
+
 struct Frame {
     int width;
     int height;
@@ -17,6 +20,7 @@ struct Window {
     HBITMAP frame_bitmap;
     HDC frame_device_context;
     Input_events input_events;
+    bool resized;
 };
 
 LRESULT CALLBACK 
@@ -79,6 +83,7 @@ WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
             window->frame.width = LOWORD(lParam);
             window->frame.height = HIWORD(lParam);
+            window->resized = true;
         } break;
         case WM_KEYDOWN:
             if (wParam == VK_ESCAPE)
@@ -178,7 +183,7 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdS
     void *application = NULL;
     int width = CW_USEDEFAULT;
     int height = CW_USEDEFAULT;
-    char *window_title = "Window";
+    const char *window_title = "Window";
 
 #if 1
     AllocConsole();
@@ -248,22 +253,21 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdS
 
     MSG msg = {};
     bool running = true;
+    Dirty_rects dirty_rects = {};
 
-    LARGE_INTEGER start_time, end_time, frame_time;
-    LARGE_INTEGER frequency;
+    // The emulator runs on its own thread, this one pumps messages and draws whatever frame is newest, sleeping
+    // in between until a message or a new frame arrives
+    Pacer *pacer = pacer_create(true);
+    Emulation *emulation = pacer ? emulation_start(application, pacer) : NULL;
 
-    QueryPerformanceFrequency(&frequency); 
-    QueryPerformanceCounter(&start_time);
+    if (!emulation)
+    {
+        MessageBoxExA(NULL, "Failed to start emulation", "Error", MB_ICONERROR | MB_OK, 0);
+        return -1;
+    }
 
     while (running) 
     {
-        QueryPerformanceCounter(&end_time);
-        frame_time.QuadPart = end_time.QuadPart - start_time.QuadPart;
-        start_time = end_time;
-
-        frame_time.QuadPart *= 1000000;
-        frame_time.QuadPart /= frequency.QuadPart;
-
         while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE)) 
         {
             if (msg.message == WM_QUIT) 
@@ -275,27 +279,47 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdS
             DispatchMessage(&msg);
         }
 
-        if (!running) 
+        // WM_QUIT doesn't end a wait, so the pump picks it up straight away
+        if (!emulation_running(emulation))
         {
             PostQuitMessage(0);
+            continue;
         }
 
-        if (!update_application(application, static_cast<double>(frame_time.QuadPart) / 1000))
+        emulation_send_input(emulation, window.input_events);
+
+        // A new DIB section starts out blank
+        if (window.resized)
         {
-            PostQuitMessage(0);
+            emulation_invalidate(emulation);
+            window.resized = false;
         }
 
-        // Sound?
-
-        handle_input(application, window.input_events);
-
-        if (render_application(application, window.frame.pixels, window.frame.width, window.frame.height)) 
+        if (window.frame.pixels && emulation_render(emulation, window.frame.pixels, window.frame.width, window.frame.height, dirty_rects)) 
         {
-            InvalidateRect(hwnd, NULL, false);
+            for (int i = 0; i < dirty_rects.count; ++i)
+            {
+                Rect &dirty = dirty_rects.rects[i];
+                RECT rect = { dirty.x, dirty.y, dirty.x + dirty.width, dirty.y + dirty.height };
+                InvalidateRect(hwnd, &rect, false);
+            }
+
             UpdateWindow(hwnd);
+            emulation_presented(emulation);
         }
+
+        pacer_wait(pacer, HOST_IDLE_TIME);
     }
 
+    Emulation_stats stats;
+    emulation_stop(emulation, &stats);
+    pacer_destroy(pacer);
+    print_emulation_stats(stats);
+
+    print_application_stats(application);
+
+    destroy_application(application);
+
     return 0;
 }
 
@@ -331,7 +355,7 @@ read_file(char *filename, uint64_t *file_size)
 }
 
 void
-message_box(char *title, char *msg)
+message_box(const char *title, const char *msg)
 {
     MessageBoxExA(NULL, msg, title, MB_OK, 0);
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
 
+struct Pacer;
+
 struct Input_events {
     enum CODES {
         ZERO, ONE, TWO, THREE, FOUR, FIVE, SIX, SEVEN, EIGHT, NINE,
@@ -17,11 +19,79 @@ struct Input_events {
     uint8_t event[255];
 };
 
-bool init_application(int argc, char **argv, void **app, int *width, int *height, char **window_title);
+struct Run_stats {
+    uint64_t cycles;
+    uint64_t frames; // emulated 60Hz timer ticks
+};
+
+// Window area in pixels with the origin at the top left
+struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+const int MAX_DIRTY_RECTS = 32;
+const int DISPLAY_ROWS = 32; // rows of 8 dirty tiles
+const int DISPLAY_PLANES = 2;
+const int DISPLAY_PLANE_WORDS = 128;
+
+struct Dirty_rects {
+    int count;
+    Rect rects[MAX_DIRTY_RECTS];
+};
+
+// A copy of the emulator's display. Each plane has one word per 64 column row, or two per 128 column row in high
+// resolution, column 0 in the top bit. Display row r and its tiles then cover pixel rows 2r and 2r + 1
+struct Display {
+    uint64_t words[DISPLAY_PLANES * DISPLAY_PLANE_WORDS];
+    bool hires;
+};
+
+struct Audio_stats {
+    uint64_t samples; // generated from the sound timer
+    uint64_t underruns; // device blocks padded with silence because the ring ran dry
+    uint64_t overruns; // times samples were dropped, the ring was full or ran ahead of the latency limit
+    double mean_latency; // ms from a sample being generated to it being played, device sink only
+    double max_latency;
+    double target_latency; // ms the device sink keeps queued at the end of the run
+};
+
+struct Recorder_stats {
+    uint64_t frames; // written to the stream, only ticks that changed the display make one
+    uint64_t dropped; // ticks that drew while the queue was full, emulation never waits for the encoder
+    uint64_t bytes; // of the file
+};
+
+struct Broadcast_stats {
+    uint64_t frames; // sent, keyframes included
+    uint64_t keyframes;
+    uint64_t subscribers; // connections accepted
+    uint64_t disconnected; // subscribers dropped for falling behind
+    uint64_t bytes; // written to all subscribers
+};
+
+bool init_application(int argc, char **argv, void **app, int *width, int *height, const char **window_title);
 bool update_application(void *app, double frame_time);
-void handle_input(void *app, Input_events &input_events);
-bool render_application(void *app, uint32_t *pixels, int width, int height);
+bool run_application(void *app, uint64_t max_cycles, uint64_t max_frames, Run_stats &stats);
+void destroy_application(void *app);
+bool save_application(void *app, const char *path); // a save state --load-state=path resumes from
+uint64_t hash_application(void *app); // of the whole machine state, equal hashes mean identical runs
+void handle_input(void *app, Input_events &input_events); // applies every event at once and clears them
+// Like handle_input, but keypad changes reach the ROM delay ms of host time into the next update_application
+void queue_input(void *app, Input_events &input_events, double delay);
+bool render_application(void *app, uint32_t *pixels, int width, int height, Dirty_rects &dirty);
+void invalidate_application(void *app); // the next render redraws everything, e.g. after the pixel buffer was recreated
+bool audio_stats_application(void *app, Audio_stats &stats); // false without --audio, ends playback
+void audio_pacer_application(void *app, Pacer *pacer); // woken when the audio device wants samples, NULL to stop
+bool recorder_stats_application(void *app, Recorder_stats &stats); // false without --video, finishes the file
+bool broadcast_stats_application(void *app, Broadcast_stats &stats); // false without --serve, stops serving
+// For hosts that run the emulator on its own thread: capture copies the display out when a new frame is ready,
+// render draws such a copy and may be called on another thread while the emulator runs
+bool capture_display(void *app, Display &display);
+bool render_display(void *app, const Display &display, const uint8_t *dirty_tiles, uint32_t *pixels, int width, int height, Dirty_rects &dirty);
 
 uint8_t *read_file(char *filename, uint64_t *file_size);
-void message_box(char *title, char *msg);
+void message_box(const char *title, const char *msg);
 void clear_console();
\ No newline at end of file